@@ -19,11 +19,18 @@ SOURCES += \
  ./src/ActionSetProperty.cpp \
  ./src/AttributeTreeModel.cpp \
  ./src/CodeEditor.cpp \
+ ./src/CompletionService.cpp \
  ./src/CSSHighlighter.cpp \
+ ./src/DocumentDependencies.cpp \
+ ./src/DocumentFormatter.cpp \
  ./src/DocumentHierarchyEventFilter.cpp \
+ ./src/DocumentHierarchyModel.cpp \
+ ./src/DocumentValidator.cpp \
  ./src/EditionHelper.cpp \
  ./src/EditionHelperColor.cpp \
+ ./src/FileWriter.cpp \
  ./src/GraphicSystem.cpp \
+ ./src/LatencyTracer.cpp \
  ./src/LocalizationManagerInterface.cpp \
  ./src/LuaHighlighter.cpp \
  ./src/main.cpp \
@@ -33,6 +40,7 @@ SOURCES += \
  ./src/OpenedLuaScript.cpp \
  ./src/OpenedStyleSheet.cpp \
  ./src/ProjectManager.cpp \
+ ./src/ProjectSearchIndex.cpp \
  ./src/PropertyTreeModel.cpp \
  ./src/RenderingView.cpp \
  ./src/Rockete.cpp \
@@ -42,7 +50,9 @@ SOURCES += \
  ./src/RocketSystem.cpp \
  ./src/Settings.cpp \
  ./src/SnippetsManager.cpp \
+ ./src/StringTableLocalizationManager.cpp \
  ./src/StyleSheet.cpp \
+ ./src/SymbolPopup.cpp \
  ./src/Tool.cpp \
  ./src/ToolDiv.cpp \
  ./src/ToolImage.cpp \
@@ -65,11 +75,18 @@ HEADERS += \
  ./src/ActionSetProperty.h \
  ./src/AttributeTreeModel.h \
  ./src/CodeEditor.h \
+ ./src/CompletionService.h \
  ./src/CSSHighlighter.h \
+ ./src/DocumentDependencies.h \
+ ./src/DocumentFormatter.h \
  ./src/DocumentHierarchyEventFilter.h \
+ ./src/DocumentHierarchyModel.h \
+ ./src/DocumentValidator.h \
  ./src/EditionHelper.h \
  ./src/EditionHelperColor.h \
+ ./src/FileWriter.h \
  ./src/GraphicSystem.h \
+ ./src/LatencyTracer.h \
  ./src/LocalizationManagerInterface.h \
  ./src/LuaHighlighter.h \
  ./src/OpenedDocument.h \
@@ -81,6 +98,7 @@ HEADERS += \
  ./src/QDRuler.h \
  ./src/QDLabel.h \
  ./src/ProjectManager.h \
+ ./src/ProjectSearchIndex.h \
  ./src/PropertyTreeModel.h \
  ./src/RenderingView.h \
  ./src/Rockete.h \
@@ -90,7 +108,10 @@ HEADERS += \
  ./src/RocketSystem.h \
  ./src/Settings.h \
  ./src/SnippetsManager.h \
+ ./src/StringTableLocalizationManager.h \
  ./src/StyleSheet.h \
+ ./src/SymbolPopup.h \
+ ./src/SyntaxHighlighter.h \
  ./src/Tool.h \
  ./src/ToolManager.h \
  ./src/ToolDiv.h \
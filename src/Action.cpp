@@ -8,3 +8,26 @@ Action::~Action()
 {
 }
 
+// Folds an action applied right after this one into it, so that both are undone in one step.
+// Only actions that set the same value on the same target can merge.
+
+bool Action::merge(const Action *)
+{
+    return false;
+}
+
+// An estimate of what the action holds, used to bound the undo history.
+
+int Action::getMemorySize() const
+{
+    return sizeof(Action);
+}
+
+// Whether the action can still be applied once the documents were unloaded, which frees their
+// elements.
+
+bool Action::survivesReload() const
+{
+    return false;
+}
+
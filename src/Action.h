@@ -18,6 +18,9 @@ public:
     Type getType() const { return type; };
     virtual void apply() = 0;
     virtual void unapply() = 0;
+    virtual bool merge(const Action *next_action);
+    virtual int getMemorySize() const;
+    virtual bool survivesReload() const;
 
 protected:
     Type type;
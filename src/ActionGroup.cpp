@@ -11,6 +11,13 @@ ActionGroup::ActionGroup(QList<Action*> &action_list)
     type = ActionTypeGroup;
 }
 
+ActionGroup::~ActionGroup()
+{
+    for (int i=0; i<actionList.size(); ++i) {
+        delete actionList[i];
+    }
+}
+
 void ActionGroup::apply()
 {
     for (int i=0; i<actionList.size(); ++i) {
@@ -25,6 +32,27 @@ void ActionGroup::unapply()
     }
 }
 
+int ActionGroup::getMemorySize() const
+{
+    int size = sizeof(ActionGroup);
+
+    for (int i=0; i<actionList.size(); ++i) {
+        size += actionList[i]->getMemorySize();
+    }
+
+    return size;
+}
+
+bool ActionGroup::survivesReload() const
+{
+    for (int i=0; i<actionList.size(); ++i) {
+        if (!actionList[i]->survivesReload())
+            return false;
+    }
+
+    return true;
+}
+
 void ActionGroup::add(Action *action)
 {
     actionList.push_back(action);
@@ -9,9 +9,13 @@ class ActionGroup : public Action
 public:
     ActionGroup();
     ActionGroup(QList<Action*> &actionList);
+    virtual ~ActionGroup();
     virtual void apply();
     virtual void unapply();
+    virtual int getMemorySize() const;
+    virtual bool survivesReload() const;
     void add(Action *action);
+    bool isEmpty() const { return actionList.isEmpty(); }
 
 private:
     QList<Action*> actionList;
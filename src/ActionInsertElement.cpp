@@ -30,3 +30,7 @@ void ActionInsertElement::unapply()
     Rockete::getInstance().repaintRenderingView();
 }
 
+int ActionInsertElement::getMemorySize() const
+{
+    return sizeof(ActionInsertElement);
+}
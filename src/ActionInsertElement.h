@@ -12,6 +12,7 @@ public:
     ActionInsertElement(OpenedDocument *document, Element *element, Element *_elementToInsert);
     virtual void apply();
     virtual void unapply();
+    virtual int getMemorySize() const;
 
 private:
     OpenedDocument *targetDocument;
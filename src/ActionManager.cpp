@@ -1,41 +1,171 @@
 #include "ActionManager.h"
+#include "RocketHelper.h"
 
 ActionManager::ActionManager()
+    : currentGroup(NULL), groupDepth(0), memorySize(0), itCanMerge(false)
 {
 
 }
 
 ActionManager::~ActionManager()
 {
-    for(int i=0;i<previousActionList.size();++i) {
-        delete previousActionList[i];
-    }
-
-    for(int i=0;i<nextActionList.size();++i) {
-        delete nextActionList[i];
-    }
+    delete currentGroup;
+    clear();
 }
 
 void ActionManager::applyNew(Action * action)
 {
     action->apply();
-    previousActionList.push_back(action);
+    RocketHelper::invalidateStyles();
+
+    // What was undone cannot be redone on top of a new change.
+    clearNextActions();
+
+    if (currentGroup) {
+        currentGroup->add(action);
+        return;
+    }
+
+    if (itCanMerge && lastActionTimer.isValid() && lastActionTimer.elapsed() < mergeInterval && !previousActionList.isEmpty()) {
+        Action *last_action = previousActionList.last();
+        const int last_size = last_action->getMemorySize();
+
+        if (last_action->merge(action)) {
+            memorySize += last_action->getMemorySize() - last_size;
+            delete action;
+            lastActionTimer.start();
+            return;
+        }
+    }
+
+    push(action);
 }
 
 void ActionManager::applyPrevious()
 {
+    if (currentGroup)
+        return;
+
     if (!previousActionList.isEmpty()) {
         Action *action = previousActionList.takeLast();
         action->unapply();
         nextActionList.push_back(action);
+        itCanMerge = false;
+        RocketHelper::invalidateStyles();
     }
 }
 
 void ActionManager::applyNext()
 {
+    if (currentGroup)
+        return;
+
     if (!nextActionList.isEmpty()) {
         Action *action = nextActionList.takeLast();
         action->apply();
         previousActionList.push_back(action);
+        itCanMerge = false;
+        RocketHelper::invalidateStyles();
     }
 }
+
+// Groups nest; the outermost endGroup() records everything applied since as one entry.
+
+void ActionManager::beginGroup()
+{
+    if (groupDepth++ == 0)
+        currentGroup = new ActionGroup();
+}
+
+void ActionManager::endGroup()
+{
+    Q_ASSERT(groupDepth > 0);
+
+    if (groupDepth == 0 || --groupDepth > 0)
+        return;
+
+    ActionGroup *group = currentGroup;
+
+    currentGroup = NULL;
+
+    if (group->isEmpty()) {
+        delete group;
+        return;
+    }
+
+    push(group);
+    itCanMerge = false;
+}
+
+void ActionManager::clear()
+{
+    for(int i=0;i<previousActionList.size();++i) {
+        delete previousActionList[i];
+    }
+
+    previousActionList.clear();
+    clearNextActions();
+    memorySize = 0;
+    itCanMerge = false;
+}
+
+// Called when documents are unloaded.
+
+void ActionManager::forgetElements()
+{
+    dropUnreplayableActions(previousActionList);
+    dropUnreplayableActions(nextActionList);
+    itCanMerge = false;
+}
+
+// Private:
+
+void ActionManager::push(Action *action)
+{
+    previousActionList.push_back(action);
+    memorySize += action->getMemorySize();
+    itCanMerge = true;
+    lastActionTimer.start();
+
+    trimHistory();
+}
+
+void ActionManager::clearNextActions()
+{
+    for(int i=0;i<nextActionList.size();++i) {
+        memorySize -= nextActionList[i]->getMemorySize();
+        delete nextActionList[i];
+    }
+
+    nextActionList.clear();
+}
+
+// The last action is always kept, however large, so that it can be undone.
+
+void ActionManager::trimHistory()
+{
+    while (previousActionList.size() > 1
+        && (previousActionList.size() > maximumActionCount || memorySize > maximumMemorySize)) {
+        Action *action = previousActionList.takeFirst();
+        memorySize -= action->getMemorySize();
+        delete action;
+    }
+}
+
+// Keeps the entries nearest to the end of the list, where undo and redo start, as long as they
+// can be replayed; the rest is dropped, so that stepping through the history never skips one.
+
+void ActionManager::dropUnreplayableActions(QList<Action*> &action_list)
+{
+    int kept_start = action_list.size();
+
+    while (kept_start > 0 && action_list[kept_start - 1]->survivesReload())
+        --kept_start;
+
+    for (int i = 0; i < kept_start; ++i) {
+        memorySize -= action_list[i]->getMemorySize();
+        delete action_list[i];
+    }
+
+    action_list.erase(action_list.begin(), action_list.begin() + kept_start);
+}
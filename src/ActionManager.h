@@ -2,9 +2,18 @@
 #define ACTIONMANAGER_H
 
 #include "Action.h"
+#include "ActionGroup.h"
+#include <QElapsedTimer>
 #include <QList>
 #include <QString>
 
+// The undo history. It is bounded both in entries and in the estimated memory the actions
+// hold, dropping the oldest ones first. An action applied shortly after one setting the same
+// value on the same target is merged into it, so that dragging a spin box is undone in one
+// step. Actions applied between beginGroup() and endGroup() are undone together. The actions
+// hold elements and documents: the history is cleared when a document is closed, and those
+// that cannot be replayed are forgotten when documents are unloaded.
+
 class ActionManager
 {
 public:
@@ -18,10 +27,28 @@ public:
     void applyNew(Action * action);
     void applyPrevious();
     void applyNext();
+    void beginGroup();
+    void endGroup();
+    void clear();
+    void forgetElements();
+
+    static const int maximumActionCount = 500;
+    static const int maximumMemorySize = 4 * 1024 * 1024;
+    static const int mergeInterval = 1000;
 
 private:
+    void push(Action *action);
+    void clearNextActions();
+    void trimHistory();
+    void dropUnreplayableActions(QList<Action*> &action_list);
+
     QList<Action*> previousActionList;
     QList<Action*> nextActionList;
+    ActionGroup *currentGroup;
+    int groupDepth;
+    int memorySize;
+    bool itCanMerge;
+    QElapsedTimer lastActionTimer;
 };
 
 #endif
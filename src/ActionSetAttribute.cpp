@@ -35,3 +35,22 @@ void ActionSetAttribute::unapply()
     targetDocument->regenerateBodyContent();
     Rockete::getInstance().repaintRenderingView();
 }
+
+bool ActionSetAttribute::merge(const Action *next_action)
+{
+    if (next_action->getType() != type)
+        return false;
+
+    const ActionSetAttribute *next_set_attribute = static_cast<const ActionSetAttribute *>(next_action);
+
+    if (next_set_attribute->targetElement != targetElement || next_set_attribute->attributeName != attributeName)
+        return false;
+
+    newValue = next_set_attribute->newValue;
+    return true;
+}
+
+int ActionSetAttribute::getMemorySize() const
+{
+    return sizeof(ActionSetAttribute) + (newValue.size() + oldValue.size() + attributeName.size()) * sizeof(QChar);
+}
@@ -12,6 +12,8 @@ public:
     ActionSetAttribute(OpenedDocument *document, Element *element, const QString &variable_name, const QString &new_value);
     virtual void apply();
     virtual void unapply();
+    virtual bool merge(const Action *next_action);
+    virtual int getMemorySize() const;
 
 private:
     QString newValue;
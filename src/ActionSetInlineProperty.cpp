@@ -20,7 +20,8 @@ void ActionSetInlineProperty::apply()
     else
         RocketHelper::replaceInlinedProperty(targetElement, propertyName, newValue);
 
-    targetDocument->regenerateBodyContent();
+    if (!targetDocument->updateElementStyleText(targetElement))
+        targetDocument->regenerateBodyContent();
     Rockete::getInstance().repaintRenderingView();
 }
 
@@ -31,6 +32,26 @@ void ActionSetInlineProperty::unapply()
     else
         RocketHelper::replaceInlinedProperty(targetElement, propertyName, oldValue);
 
-    targetDocument->regenerateBodyContent();
+    if (!targetDocument->updateElementStyleText(targetElement))
+        targetDocument->regenerateBodyContent();
     Rockete::getInstance().repaintRenderingView();
+}
+
+bool ActionSetInlineProperty::merge(const Action *next_action)
+{
+    if (next_action->getType() != type)
+        return false;
+
+    const ActionSetInlineProperty *next_set_property = static_cast<const ActionSetInlineProperty *>(next_action);
+
+    if (next_set_property->targetElement != targetElement || next_set_property->propertyName != propertyName)
+        return false;
+
+    newValue = next_set_property->newValue;
+    return true;
+}
+
+int ActionSetInlineProperty::getMemorySize() const
+{
+    return sizeof(ActionSetInlineProperty) + (newValue.size() + oldValue.size() + propertyName.size()) * sizeof(QChar);
 }
\ No newline at end of file
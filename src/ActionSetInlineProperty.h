@@ -11,6 +11,8 @@ public:
     ActionSetInlineProperty(OpenedDocument *document, Element *element, const QString &property_name, const QString &new_value);
     virtual void apply();
     virtual void unapply();
+    virtual bool merge(const Action *next_action);
+    virtual int getMemorySize() const;
 
 private:
     QString newValue;
@@ -4,6 +4,8 @@
 #include "OpenedDocument.h"
 #include "PropertyTreeModel.h"
 
+// The property is copied: the rows of the property tree are freed whenever it is refilled.
+
 ActionSetProperty::ActionSetProperty(OpenedDocument *document, Element *element, PropertyTreeModel::Property *property, const QString &new_value)
 {
     type = ActionTypeSetProperty;
@@ -11,70 +13,160 @@ ActionSetProperty::ActionSetProperty(OpenedDocument *document, Element *element,
     targetDocument = document;
     oldValue = property->value;
     newValue = new_value;
-    targetProperty = property;
+    propertyName = property->name;
+    sourceFile = property->sourceFile;
+    sourceLineNumber = property->sourceLineNumber;
+    ruleIndex = property->ruleIndex;
+    documentGeneration = RocketHelper::getDocumentGeneration();
     addedLineNumber = -1;
 }
 
 
 void ActionSetProperty::apply()
 {
-    if (targetProperty->sourceFile == "inline") {
-        targetProperty->value = newValue;
-        RocketHelper::replaceInlinedProperty(targetElement,targetProperty->name, newValue);
-        targetDocument->regenerateBodyContent();
-        Rockete::getInstance().repaintRenderingView();
+    if (sourceFile == "inline") {
+        updateInlinedProperty(newValue);
     }
     else {
-        OpenedFile *opened_file = Rockete::getInstance().getOpenedFile(targetProperty->sourceFile.toUtf8().data(), true);
+        OpenedFile *opened_file = Rockete::getInstance().getOpenedFile(sourceFile.toUtf8().data(), true);
 
         if (opened_file) {
-            int source_line_number;
-            QString new_line;
-
-            source_line_number = opened_file->findLineNumber(targetProperty->name, targetProperty->sourceLineNumber);
-            new_line = targetProperty->name + ": " + newValue + ";";
-
-            if(source_line_number != -1)
-                opened_file->replaceLine(source_line_number, new_line);
-            else
-                addedLineNumber = opened_file->insertLineBeforeBracket(targetProperty->sourceLineNumber, new_line);
+            if (!replaceDeclarationValue(opened_file, newValue))
+                addedLineNumber = opened_file->insertDeclaration(getRuleLineNumber(), propertyName, newValue);
 
-            targetProperty->value = newValue;
-
-            opened_file->save();
-            Rockete::getInstance().reloadCurrentDocument();
+            updateElementProperty(newValue);
+            opened_file->scheduleSave();
         }
     }
 }
 
 void ActionSetProperty::unapply()
 {
-    if (targetProperty->sourceFile == "inline") {
-        targetProperty->value = oldValue;
-        RocketHelper::replaceInlinedProperty(targetElement,targetProperty->name, oldValue);
-        targetDocument->regenerateBodyContent();
-        Rockete::getInstance().repaintRenderingView();
+    if (sourceFile == "inline") {
+        updateInlinedProperty(oldValue);
     }
     else {
-        OpenedFile *opened_file = Rockete::getInstance().getOpenedFile(targetProperty->sourceFile.toUtf8().data(), true);
+        OpenedFile *opened_file = Rockete::getInstance().getOpenedFile(sourceFile.toUtf8().data(), true);
 
         if (opened_file) {
-            if (addedLineNumber!= -1)
-                opened_file->removeLine(addedLineNumber);
+            if (addedLineNumber!= -1) {
+                opened_file->removeDeclaration(addedLineNumber, propertyName);
+                addedLineNumber = -1;
+            }
             else {
-                int source_line_number;
-                QString new_line;
+                replaceDeclarationValue(opened_file, oldValue);
+            }
 
-                source_line_number = opened_file->findLineNumber(targetProperty->name,targetProperty->sourceLineNumber);
-                new_line = "    " + targetProperty->name + ": " + oldValue + ";";
+            updateElementProperty(oldValue);
+            opened_file->scheduleSave();
+        }
+    }
+}
 
-                opened_file->replaceLine(source_line_number, new_line);
+bool ActionSetProperty::merge(const Action *next_action)
+{
+    if (next_action->getType() != type)
+        return false;
 
-                targetProperty->value = oldValue;
-            }
+    const ActionSetProperty *next_set_property = static_cast<const ActionSetProperty *>(next_action);
 
-            opened_file->save();
-            Rockete::getInstance().reloadCurrentDocument();
-        }
+    if (next_set_property->documentGeneration != documentGeneration
+        || next_set_property->targetElement != targetElement
+        || next_set_property->propertyName != propertyName
+        || next_set_property->sourceFile != sourceFile
+        || next_set_property->sourceLineNumber != sourceLineNumber
+        || next_set_property->ruleIndex != ruleIndex)
+        return false;
+
+    // The declaration this action added, if any, is the one the next action rewrote.
+    newValue = next_set_property->newValue;
+    return true;
+}
+
+int ActionSetProperty::getMemorySize() const
+{
+    return sizeof(ActionSetProperty) + (newValue.size() + oldValue.size() + propertyName.size() + sourceFile.size()) * sizeof(QChar);
+}
+
+// Declarations of style sheets are edited in the text; the element is left alone once reloaded.
+
+bool ActionSetProperty::survivesReload() const
+{
+    return sourceFile != "inline";
+}
+
+// Private:
+
+// The element is only touched while no document has been unloaded since, as that may free it.
+
+bool ActionSetProperty::isElementLoaded() const
+{
+    return documentGeneration == RocketHelper::getDocumentGeneration();
+}
+
+// The rule is looked up in the document's parse of the style sheet, which follows the edits made
+// to it; sources that are not linked style sheets are searched by line.
+
+const StyleSheet *ActionSetProperty::getStyleSheet() const
+{
+    const StyleSheet *style_sheet = ruleIndex != -1 ? targetDocument->getStyleSheet(sourceFile) : NULL;
+
+    if (!style_sheet || ruleIndex >= style_sheet->getRuleCount())
+        return NULL;
+
+    return style_sheet;
+}
+
+bool ActionSetProperty::replaceDeclarationValue(OpenedFile *opened_file, const QString &value)
+{
+    const StyleSheet *style_sheet = getStyleSheet();
+
+    if (style_sheet) {
+        const int declaration_index = style_sheet->findDeclaration(ruleIndex, propertyName);
+
+        if (declaration_index == -1)
+            return false;
+
+        const StyleSheet::SourceSpan &value_span = style_sheet->getDeclaration(declaration_index).valueSpan;
+
+        opened_file->replaceText(value_span.start, value_span.length, value);
+        return true;
     }
+
+    const int declaration_line_number = opened_file->findDeclaration(sourceLineNumber, propertyName);
+
+    return declaration_line_number != -1 && opened_file->replaceDeclarationValue(declaration_line_number, propertyName, value);
+}
+
+int ActionSetProperty::getRuleLineNumber() const
+{
+    const StyleSheet *style_sheet = getStyleSheet();
+
+    if (style_sheet)
+        return style_sheet->getLineNumber(style_sheet->getRule(ruleIndex).bodyStart);
+
+    return sourceLineNumber;
+}
+
+void ActionSetProperty::updateInlinedProperty(const QString &value)
+{
+    if (!isElementLoaded())
+        return;
+
+    RocketHelper::replaceInlinedProperty(targetElement, propertyName, value);
+    if (!targetDocument->updateElementStyleText(targetElement))
+        targetDocument->regenerateBodyContent();
+    Rockete::getInstance().repaintRenderingView();
+}
+
+// Other elements the rule matches, or all of them once the document was reloaded, follow on
+// the reload after the scheduled save.
+
+void ActionSetProperty::updateElementProperty(const QString &value)
+{
+    if (!isElementLoaded())
+        return;
+
+    RocketHelper::setElementProperty(targetElement, propertyName, value);
+    Rockete::getInstance().repaintRenderingView();
 }
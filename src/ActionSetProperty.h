@@ -13,14 +13,27 @@ public:
     ActionSetProperty(OpenedDocument *document, Element *element, PropertyTreeModel::Property *property, const QString &new_value);
     virtual void apply();
     virtual void unapply();
+    virtual bool merge(const Action *next_action);
+    virtual int getMemorySize() const;
+    virtual bool survivesReload() const;
 
 private:
+    bool isElementLoaded() const;
+    const StyleSheet *getStyleSheet() const;
+    bool replaceDeclarationValue(OpenedFile *opened_file, const QString &value);
+    int getRuleLineNumber() const;
+    void updateInlinedProperty(const QString &value);
+    void updateElementProperty(const QString &value);
+
     QString newValue;
     QString oldValue;
-    QString attributeName;
+    QString propertyName;
+    QString sourceFile;
+    int sourceLineNumber;
+    int ruleIndex;
     OpenedDocument *targetDocument;
     Element *targetElement;
-    PropertyTreeModel::Property * targetProperty;
+    int documentGeneration;
     int addedLineNumber;
 };
 
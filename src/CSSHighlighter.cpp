@@ -1,22 +1,19 @@
 #include "CSSHighlighter.h"
 #include <QTextDocument>
+#include "LatencyTracer.h"
 
 CssHighlighter::CssHighlighter(QTextDocument *document)
-: QSyntaxHighlighter(document)
+: SyntaxHighlighter(document)
 {
 }
 
-void CssHighlighter::setHighlightedString(const QString &str)
-{
-    if (highlightedString != str)
-    {
-        highlightedString = str;
-        rehighlight();
-    }
-}
-
 void CssHighlighter::highlightBlock(const QString& text)
 {
+    LatencyTracer::Scope scope(LatencyTracer::Highlighting);
+
+    if (skipDeferredBlock())
+        return;
+
     enum Token { ALNUM, LBRACE, RBRACE, COLON, SEMICOLON, COMMA, QUOTE, SLASH, STAR };
     static const int transitions[10][9] = {
         { Selector, Property, Selector, Pseudo,    Property, Selector, Quote, MaybeComment, Selector }, // Selector
@@ -110,22 +107,6 @@ void CssHighlighter::highlightBlock(const QString& text)
 
     highlight(text, lastIndex, text.length() - lastIndex, state);
 
-    if (!highlightedString.isEmpty()) {
-        int starting_index = 0;
-        QTextCharFormat keywordFormat;
-
-        keywordFormat.setBackground(Qt::green);
-        do
-        {
-            starting_index = text.indexOf(highlightedString, starting_index);
-            if (starting_index>=0)
-            {
-                setFormat(starting_index, highlightedString.size(), keywordFormat);
-                starting_index = starting_index+highlightedString.size();
-            }
-        } while (starting_index>=0);
-    }
-
     setCurrentBlockState(state + (save_state<<16));
 }
 
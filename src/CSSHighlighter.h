@@ -1,15 +1,14 @@
 #ifndef CSSHIGHLIGHTER_H
 #define CSSHIGHLIGHTER_H
 
-#include <QtGui/QSyntaxHighlighter>
+#include "SyntaxHighlighter.h"
 
-class CssHighlighter : public QSyntaxHighlighter
+class CssHighlighter : public SyntaxHighlighter
 {
     Q_OBJECT
 
 public:
     explicit CssHighlighter(QTextDocument *document);
-    virtual void setHighlightedString(const QString &str);
 
 protected:
     void highlightBlock(const QString&);
@@ -29,7 +28,6 @@ private:
         Comment,
         MaybeCommentEnd
     };
-    QString highlightedString;
 };
 
 #endif
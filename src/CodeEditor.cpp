@@ -4,253 +4,56 @@
 #include <QScrollBar>
 #include <QStringListModel>
 #include <QMimeData>
+#include <QTextBlock>
 #include "Settings.h"
 #include "Rockete.h"
-#include "ProjectManager.h"
+#include "SymbolPopup.h"
+#include "LatencyTracer.h"
 
 // Public:
 
-CodeEditor::CodeEditor() : QPlainTextEdit()
+CodeEditor::CodeEditor() : QPlainTextEdit(),
+    searchCaseSensitivity(Qt::CaseInsensitive), itIsRegularExpressionSearch(false), searchGeneration(0),
+    searchSelectionsFirstBlock(-1), searchSelectionsLastBlock(-1), itHasDirtySearchSelections(false), itIsInLargeFileMode(false),
+    completionContext(CompletionService::NoContext), tracedRevision(-1), tracedCursorPosition(-1), tracedCursorAnchor(-1)
 {
-    QFile
-        tags(ProjectManager::getInstance().getWordListPath() + "tag_list.txt"),
-        customs(ProjectManager::getInstance().getWordListPath() + "custom_list.txt"),
-        keywords(ProjectManager::getInstance().getWordListPath() + "keyword_list.txt");
+    completionModel = new QStringListModel(this);
 
-    tags.open(QFile::ReadOnly);
-    while (!tags.atEnd())
-    {
-        QByteArray line = tags.readLine();
-        if (!line.isEmpty())
-        {
-            tag_list << line.trimmed();
-        }
-    }
-
-    customs.open(QFile::ReadOnly);
-    while (!customs.atEnd())
-    {
-        QByteArray line = customs.readLine();
-        if (!line.isEmpty())
-        {
-            custom_list << line.trimmed();
-        }
-    }
-
-    keywords.open(QFile::ReadOnly);
-    while (!keywords.atEnd())
-    {
-        QByteArray line = keywords.readLine();
-        if (!line.isEmpty())
-        {
-            keyword_list << line.trimmed();
-        }
-    }
-
-    QStringList full_list;
-
-    full_list = keyword_list + custom_list;
-    full_list.sort();
-
-    AutoCompleter = new QCompleter(full_list, this);
+    AutoCompleter = new QCompleter(completionModel, this);
     AutoCompleter->setWidget(this);
     AutoCompleter->setCaseSensitivity(Qt::CaseInsensitive);
-    AutoCompleter->setModelSorting(QCompleter::CaseInsensitivelySortedModel);
     AutoCompleter->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
 
-    tag_list.sort();
-
-    TagAutoCompleter = new QCompleter(tag_list, this);
-    TagAutoCompleter->setWidget(this);
-    TagAutoCompleter->setCaseSensitivity(Qt::CaseInsensitive);
-    TagAutoCompleter->setModelSorting(QCompleter::CaseInsensitivelySortedModel);
-    TagAutoCompleter->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
-
     QObject::connect(AutoCompleter, SIGNAL(activated(const QString &)), this, SLOT(completeText(const QString &)));
-    QObject::connect(TagAutoCompleter, SIGNAL(activated(const QString &)), this, SLOT(completeTagText(const QString &)));
     QObject::connect(this, SIGNAL(cursorPositionChanged()), this, SLOT(HighlightClosingTag()));
 
-    PreviousHighlightedOpeningTag.setX(0);
-    PreviousHighlightedOpeningTag.setY(0);
-    PreviousHighlightedClosingTag.setX(0);
-    PreviousHighlightedClosingTag.setY(0);
+    QObject::connect(document(), SIGNAL(contentsChange(int, int, int)), this, SLOT(updateBlockStructure(int, int, int)));
+    QObject::connect(document(), SIGNAL(contentsChanged()), this, SLOT(invalidateSearchSelections()));
 
     lineNumberArea = new LineNumberArea(this);
     lineNumberArea->setFont(QFont(DEF_FONT_INFO));
 
+    headerLabel = new QLabel(this);
+    headerLabel->setAutoFillBackground(true);
+    headerLabel->setMargin(3);
+    headerLabel->setStyleSheet("QLabel { background-color: #fff5c0; color: #604000; }");
+    headerLabel->hide();
+
     connect(this, SIGNAL(blockCountChanged(int)), this, SLOT(updateLineNumberAreaWidth(int)));
     connect(this, SIGNAL(updateRequest(QRect,int)), this, SLOT(updateLineNumberArea(QRect,int)));
     connect(this, SIGNAL(cursorPositionChanged()), this, SLOT(highlightCurrentLine()));
+    connect(this, SIGNAL(cursorPositionChanged()), this, SLOT(revealCursorBlock()));
 
     updateLineNumberAreaWidth(0);
     highlightCurrentLine();
     setAcceptDrops(true);
 }
 
-bool CodeEditor::checkXmlCorrectness(QString & error_message)
-{
-    QTextCursor parsingTextCursor = textCursor();
-    int tag_delimiter_balance = 0;
-    int opened_brace_counter = 0;
-    int opened_quote = 0;
-    QStringList opened_tag_list;
-    QString plain_text = toPlainText();
-    bool isComentary = false;
-
-    parsingTextCursor.setPosition(0);
-
-    while(!parsingTextCursor.atEnd())
-    {
-        if(isComentary)
-        {
-            if(plain_text[parsingTextCursor.position()] == '>')
-            {
-                if(plain_text[parsingTextCursor.position()-1] == '-'&&plain_text[parsingTextCursor.position()-2] == '-')
-                {
-                    isComentary = false;
-                    parsingTextCursor.movePosition(QTextCursor::Right, tag_delimiter_balance > 0 ? QTextCursor::KeepAnchor : QTextCursor::MoveAnchor);
-                    continue;
-                }
-            }
-
-            parsingTextCursor.movePosition(QTextCursor::Right, tag_delimiter_balance > 0 ? QTextCursor::KeepAnchor : QTextCursor::MoveAnchor);
-            continue;
-        }
-
-        if( opened_quote == 0 && plain_text[parsingTextCursor.position()] == '"' && plain_text[parsingTextCursor.position()-1] != '\\')
-        {
-            opened_quote++;
-        }
-        else if(opened_quote > 0 && plain_text[parsingTextCursor.position()] == '"' && plain_text[parsingTextCursor.position()-1] != '\\')
-        {
-            opened_quote--;
-        }
-
-        if (opened_quote == 0)
-        {
-            if(plain_text[parsingTextCursor.position()] == '}')
-            {
-                opened_brace_counter--;
-            }
-            else if(plain_text[parsingTextCursor.position()] == '>')
-            {
-                tag_delimiter_balance--;
-            }
-            else if(plain_text[parsingTextCursor.position()] == '{')
-            {
-                opened_brace_counter++;
-            }
-            else if(plain_text[parsingTextCursor.position()] == '<')
-            {
-                if(toPlainText().count() > parsingTextCursor.position()+3 &&
-                    plain_text[parsingTextCursor.position()+1] == '!' && 
-                    plain_text[parsingTextCursor.position()+2] == '-' &&
-                    plain_text[parsingTextCursor.position()+3] == '-')
-                {
-                    isComentary = true;
-                    parsingTextCursor.movePosition(QTextCursor::Right, tag_delimiter_balance > 0 ? QTextCursor::KeepAnchor : QTextCursor::MoveAnchor, 3);
-                    continue;
-                }
-
-                if (opened_brace_counter > 0 && plain_text[parsingTextCursor.position() + 1] != '!')
-                {
-                    error_message = "xml tag detected inside css class";
-                    setTextCursor(parsingTextCursor);
-                    return false;
-                }
-                tag_delimiter_balance++;
-            }
-        }
-
-        if(opened_brace_counter > 1 || tag_delimiter_balance > 1)
-        {
-            error_message = "found two opening character('<' or '{') in a row";
-            parsingTextCursor.movePosition(QTextCursor::Right, QTextCursor::KeepAnchor);
-            setTextCursor(parsingTextCursor);
-            return false;
-        }
-
-        if(opened_brace_counter < 0 || tag_delimiter_balance < 0)
-        {
-            error_message = "closing character ('>' or '}') before any opening one";
-            parsingTextCursor.movePosition(QTextCursor::Right, QTextCursor::KeepAnchor);
-            setTextCursor(parsingTextCursor);
-            return false;
-        }
-
-        if ( tag_delimiter_balance == 0 && parsingTextCursor.hasSelection() )
-        {
-            QString 
-                tag_text = parsingTextCursor.selectedText().trimmed();
-            parsingTextCursor.clearSelection(); // remove selection - otherwise movePosition will fail
-
-            tag_text.remove('<');
-
-            if(!tag_text.contains("--"))
-            {
-                if( !tag_text.contains('/')  )
-                {
-                    if ( tag_text.contains(' ') )
-                    {
-                        int first_space = tag_text.indexOf(' ');
-                        tag_text.chop(tag_text.count() - first_space);
-                    }
-
-                    opened_tag_list.append(tag_text);
-                }
-                else
-                {
-                    if(tag_text.startsWith('/'))
-                    {
-                        tag_text.remove('/');
-                        if(!opened_tag_list.removeOne(tag_text))
-                        {
-                            error_message = tag_text + " is closed without being opened";
-                            setTextCursor(parsingTextCursor);
-                            return false;
-                        }
-                    }
-                    else
-                    {
-                         tag_text.remove('>');
-                         tag_text = tag_text.trimmed();
-                         if(!tag_text.endsWith('/')) // opening tag with source file behind a directory
-                         {
-                             if ( tag_text.contains(' ') )
-                             {
-                                 int first_space = tag_text.indexOf(' ');
-                                 tag_text.chop(tag_text.count() - first_space);
-                             }
-
-                             opened_tag_list.append(tag_text);
-                         }
-                    }
-                }
-            }
-        }
-
-        // TODO: check l'ordre de fermeture
-        if(!parsingTextCursor.movePosition(QTextCursor::Right, tag_delimiter_balance > 0 ? QTextCursor::KeepAnchor : QTextCursor::MoveAnchor))
-            qDebug() << "movePosition failed.";
-    }
-
-    if(isComentary)
-    {
-        error_message = "Comment section is not closed";
-        return false;
-    }
-    opened_tag_list.removeAll( "!--" );
-
-    if(!opened_tag_list.isEmpty())
-    {
-        error_message = opened_tag_list.first() + " is not closed";
-    }
-    return opened_tag_list.isEmpty();
-}
-
 void CodeEditor::lineNumberAreaPaintEvent(QPaintEvent *event)
 {
     QPainter painter(lineNumberArea);
+    const int marker_width = foldMarkerWidth();
+    const int number_width = lineNumberArea->width() - marker_width;
     painter.fillRect(event->rect(), Qt::lightGray);
 
     QTextBlock block = firstVisibleBlock();
@@ -261,9 +64,28 @@ void CodeEditor::lineNumberAreaPaintEvent(QPaintEvent *event)
     while (block.isValid() && top <= event->rect().bottom()) {
         if (block.isVisible() && bottom >= event->rect().top()) {
             QString number = QString::number(blockNumber + 1);
-            painter.setPen(Qt::darkGray);
-            painter.drawText(0, top, lineNumberArea->width(), fontMetrics().height(),
+
+            if (diagnosticLines.contains(blockNumber)) {
+                painter.fillRect(0, top, lineNumberArea->width(), bottom - top, QColor(255, 160, 160));
+                painter.setPen(Qt::darkRed);
+            }
+            else
+                painter.setPen(Qt::darkGray);
+
+            painter.drawText(0, top, number_width, fontMetrics().height(),
                 Qt::AlignRight, number);
+
+            if (marker_width > 0 && (isFolded(block) || isFoldable(block))) {
+                const int size = marker_width / 2;
+                const QRect box(number_width + (marker_width - size) / 2, top + (fontMetrics().height() - size) / 2, size, size);
+
+                painter.setPen(Qt::darkGray);
+                painter.drawRect(box);
+                painter.drawLine(box.left() + 2, box.center().y(), box.right() - 2, box.center().y());
+
+                if (isFolded(block))
+                    painter.drawLine(box.center().x(), box.top() + 2, box.center().x(), box.bottom() - 2);
+            }
         }
 
         block = block.next();
@@ -273,6 +95,22 @@ void CodeEditor::lineNumberAreaPaintEvent(QPaintEvent *event)
     }
 }
 
+// A click in the marker column folds or unfolds the region starting on that line.
+
+void CodeEditor::lineNumberAreaMousePressEvent(QMouseEvent *event)
+{
+    const int marker_width = foldMarkerWidth();
+    QTextBlock block;
+
+    if (marker_width == 0 || event->pos().x() < lineNumberArea->width() - marker_width)
+        return;
+
+    block = cursorForPosition(QPoint(0, event->pos().y())).block();
+
+    if (isFolded(block) || isFoldable(block))
+        setFolded(block, !isFolded(block));
+}
+
 int CodeEditor::lineNumberAreaWidth()
 {
     int digits = 1;
@@ -282,620 +120,1394 @@ int CodeEditor::lineNumberAreaWidth()
         ++digits;
     }
 
-    int space = 3 + fontMetrics().width(QLatin1Char('9')) * digits;
+    int space = 3 + fontMetrics().width(QLatin1Char('9')) * digits + foldMarkerWidth();
 
     return space;
 }
 
-// public slots:
+void CodeEditor::setDiagnosticLines(const QHash<int, QString> &lines)
+{
+    diagnosticLines = lines;
+    lineNumberArea->update();
+}
 
-void CodeEditor::completeText(const QString &text)
+QString CodeEditor::getDiagnosticAt(const QPoint &line_number_area_position)
 {
-    textCursor().beginEditBlock();
-    QTextCursor editingTextCursor = textCursor();
+    QTextBlock block = cursorForPosition(QPoint(0, line_number_area_position.y())).block();
 
-    editingTextCursor.setPosition(textCursor().selectionEnd());
+    return diagnosticLines.value(block.blockNumber());
+}
 
-    editingTextCursor.movePosition(QTextCursor::PreviousWord, QTextCursor::KeepAnchor);
-    editingTextCursor.movePosition(QTextCursor::Left, QTextCursor::KeepAnchor);
-    if(editingTextCursor.selectedText().contains('-'))
-    {
-        editingTextCursor.movePosition(QTextCursor::PreviousWord, QTextCursor::KeepAnchor);
-    }
-    else
-    {
-        editingTextCursor.movePosition(QTextCursor::Right, QTextCursor::KeepAnchor);
-    }
-    editingTextCursor.removeSelectedText();
+// Search matches are drawn as extra selections rather than by the highlighter, so changing the
+// searched text never re-lexes the document; only the blocks around the viewport are searched.
 
-    editingTextCursor.insertText(text);
-    setTextCursor(editingTextCursor);
+void CodeEditor::setSearchPattern(const QString &pattern, const bool case_sensitive, const bool regular_expression)
+{
+    const Qt::CaseSensitivity case_sensitivity = case_sensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
 
-    textCursor().endEditBlock();
+    if (pattern == searchPattern && case_sensitivity == searchCaseSensitivity && regular_expression == itIsRegularExpressionSearch)
+        return;
+
+    searchPattern = pattern;
+    searchCaseSensitivity = case_sensitivity;
+    itIsRegularExpressionSearch = regular_expression;
+    searchExpression = QRegExp(pattern, case_sensitivity, QRegExp::RegExp2);
+    ++searchGeneration;
+    itHasDirtySearchSelections = true;
+    updateSearchSelections();
 }
 
-void CodeEditor::completeTagText(const QString &text)
+// Walks the blocks from the cursor, wrapping around the document, using the matches cached in
+// each block; blocks are only searched again once their text or the pattern changed.
+
+bool CodeEditor::findNextMatch(const bool backward)
 {
-    textCursor().beginEditBlock();
-    QString adding_text;
-    QTextCursor editingTextCursor = textCursor();
+    QTextCursor cursor = textCursor();
+    const int start_position = backward ? cursor.selectionStart() : cursor.selectionEnd();
+    const int block_count = document()->blockCount();
+    QTextBlock block;
 
-    editingTextCursor.setPosition(textCursor().selectionStart());
-    editingTextCursor.movePosition( QTextCursor::EndOfWord, QTextCursor::MoveAnchor );
-    editingTextCursor.movePosition( QTextCursor::StartOfWord, QTextCursor::KeepAnchor );
-    editingTextCursor.removeSelectedText();
-    adding_text = text;
-
-    adding_text += ">";
-    adding_text += "</";
-    adding_text += text;
-    adding_text += ">";
-
-    editingTextCursor.insertText(adding_text);
-    editingTextCursor.movePosition( QTextCursor::PreviousWord, QTextCursor::MoveAnchor );
-    editingTextCursor.movePosition( QTextCursor::PreviousWord, QTextCursor::MoveAnchor );
-    editingTextCursor.movePosition( QTextCursor::PreviousWord, QTextCursor::MoveAnchor );
-    editingTextCursor.movePosition( QTextCursor::Right, QTextCursor::MoveAnchor );
-    setTextCursor(editingTextCursor);
+    if (searchPattern.isEmpty())
+        return false;
 
-    textCursor().endEditBlock();
-}
+    block = document()->findBlock(start_position);
 
-void CodeEditor::HighlightClosingTag()
-{
-    if(textCursor().hasSelection())
-        return;
+    for (int visited_count = 0; visited_count <= block_count; ++visited_count) {
+        const QVector<SearchMatch> &matches = getSearchMatches(block)->searchMatches;
+        const int start_offset = start_position - block.position();
+        const bool it_is_start_block = visited_count == 0;
 
-    QTextCursor parsingTextCursor = textCursor();
-    QTextCursor unHighlightingTextCursor = textCursor();
-    QString plain_text = toPlainText();
-    QString opening_tag;
-    QStringList opened_tag_list;
-    int opened_quote = 0,
-        tag_delimiter_balance = 0,
-        start_parse_position = 0;
-    BlockData
-        * data;
+        for (int index = 0; index < matches.size(); ++index) {
+            const SearchMatch &match = matches[backward ? matches.size() - 1 - index : index];
 
-    if(!PreviousHighlightedOpeningTag.isNull())
-    {
-        unHighlightingTextCursor.setPosition(PreviousHighlightedOpeningTag.x());
-        unHighlightingTextCursor.setPosition(PreviousHighlightedOpeningTag.y(), QTextCursor::KeepAnchor);
-        unHighlightingTextCursor.block().setUserData(NULL);
-        //unHighlightingTextCursor.mergeCharFormat(format);
-        PreviousHighlightedOpeningTag.setX(0);
-        PreviousHighlightedOpeningTag.setY(0);
-    }
+            if (it_is_start_block && (backward ? match.position + match.length > start_offset : match.position < start_offset))
+                continue;
 
-    if(!PreviousHighlightedClosingTag.isNull())
-    {
-        unHighlightingTextCursor.setPosition(PreviousHighlightedClosingTag.x());
-        unHighlightingTextCursor.setPosition(PreviousHighlightedClosingTag.y(), QTextCursor::KeepAnchor);
-        unHighlightingTextCursor.block().setUserData(NULL);
-        //unHighlightingTextCursor.mergeCharFormat(format);
-        PreviousHighlightedClosingTag.setX(0);
-        PreviousHighlightedClosingTag.setY(0);
+            cursor.setPosition(block.position() + match.position);
+            cursor.setPosition(block.position() + match.position + match.length, QTextCursor::KeepAnchor);
+            setTextCursor(cursor);
+            return true;
+        }
+
+        if (backward)
+            block = block.previous().isValid() ? block.previous() : document()->lastBlock();
+        else
+            block = block.next().isValid() ? block.next() : document()->firstBlock();
     }
 
-    parsingTextCursor.movePosition(QTextCursor::StartOfWord);
-    parsingTextCursor.movePosition(QTextCursor::Left);
+    return false;
+}
 
-    if(plain_text[parsingTextCursor.position()] != '<')
-        return; // not a(n opening) tag
+int CodeEditor::countMatches()
+{
+    int count = 0;
 
-    parsingTextCursor.movePosition(QTextCursor::Right);
-    do
-    {
-        parsingTextCursor.movePosition(QTextCursor::Right, QTextCursor::KeepAnchor);
-    } while (plain_text[parsingTextCursor.position()] != '>');
+    if (searchPattern.isEmpty())
+        return 0;
 
-    start_parse_position = parsingTextCursor.position();
-    opening_tag = parsingTextCursor.selectedText();
-    opening_tag = opening_tag.trimmed();
+    for (QTextBlock block = document()->firstBlock(); block.isValid(); block = block.next())
+        count += getSearchMatches(block)->searchMatches.size();
 
-    if(opening_tag.endsWith("/"))
-        return; // closing tag is the opening one
+    return count;
+}
 
-    if(opening_tag.contains(' '))
-    {
-        int index_space;
-        index_space = opening_tag.indexOf(' ');
-        opening_tag.chop(opening_tag.count() - index_space);
-    }
+// Replaces the selection; when it is a match of a regular expression search, captures are
+// expanded in the replacement as in replaceAllMatches().
 
-    parsingTextCursor.setPosition(parsingTextCursor.selectionStart());
+void CodeEditor::replaceSelectedMatch(const QString &replacement)
+{
+    QTextCursor cursor = textCursor();
+    const QTextBlock block = document()->findBlock(cursor.selectionStart());
+    const int match_offset = cursor.selectionStart() - block.position();
+    const int match_length = cursor.selectionEnd() - cursor.selectionStart();
 
-    do
-    {
-        parsingTextCursor.movePosition(QTextCursor::Right, QTextCursor::KeepAnchor);
-    } while (plain_text[parsingTextCursor.position()] != '>' && plain_text[parsingTextCursor.position()] != ' ');
+    if (!cursor.hasSelection())
+        return;
 
-    data = new BlockData();
-    data->format.setFontUnderline(true);
-    data->format.setFontOverline(true);
-    parsingTextCursor.block().setUserData(data);
+    if (itIsRegularExpressionSearch && !searchPattern.isEmpty() && match_offset + match_length <= block.length() - 1
+        && searchExpression.indexIn(block.text(), match_offset) == match_offset && searchExpression.matchedLength() == match_length)
+        cursor.insertText(expandReplacement(replacement));
+    else
+        cursor.insertText(replacement);
+}
+
+// Each block holding matches gets one edit, from its first match to the end of its last one, so
+// the blocks in between keep their data. Blocks are visited from the last one, so the cached
+// match positions of the blocks not edited yet stay valid; the whole is a single undo step.
 
-    PreviousHighlightedOpeningTag.setX(parsingTextCursor.selectionStart());
-    PreviousHighlightedOpeningTag.setY(parsingTextCursor.selectionEnd());
+int CodeEditor::replaceAllMatches(const QString &replacement)
+{
+    QTextCursor replacing_cursor(document());
+    int count = 0;
 
-    parsingTextCursor.setPosition(start_parse_position+1);
+    if (searchPattern.isEmpty())
+        return 0;
 
-    while(!parsingTextCursor.atEnd())
+    for (QTextBlock block = document()->lastBlock(); block.isValid(); block = block.previous())
     {
-        if( opened_quote == 0 && plain_text[parsingTextCursor.position()] == '"' && plain_text[parsingTextCursor.position()-1] != '\\')
-        {
-            opened_quote++;
-        }
-        else if(opened_quote > 0 && plain_text[parsingTextCursor.position()] == '"' && plain_text[parsingTextCursor.position()-1] != '\\')
-        {
-            opened_quote--;
-        }
+        const QVector<SearchMatch> matches = getSearchMatches(block)->searchMatches;
+        const QString text = block.text();
+        QString result;
+        int copied_position;
 
-        if (opened_quote == 0)
-        {
-            if(plain_text[parsingTextCursor.position()] == '>')
-            {
-                tag_delimiter_balance--;
-            }
-            else if(plain_text[parsingTextCursor.position()] == '<')
-            {
-                tag_delimiter_balance++;
-            }
-        }
+        if (matches.isEmpty())
+            continue;
 
+        copied_position = matches.first().position;
 
-        if ( tag_delimiter_balance == 0 && parsingTextCursor.hasSelection() )
+        foreach (const SearchMatch &match, matches)
         {
-            QString 
-                tag_text = parsingTextCursor.selectedText().trimmed();
+            result += text.midRef(copied_position, match.position - copied_position);
 
-            tag_text.remove('<');
+            if (itIsRegularExpressionSearch && searchExpression.indexIn(text, match.position) == match.position)
+                result += expandReplacement(replacement);
+            else
+                result += replacement;
 
-            if(!tag_text.contains("--"))
-            {
-                if(tag_text.startsWith('/'))
-                {
-                    tag_text.remove('/');
-                    if(opened_tag_list.empty())
-                    {
-                        //found our tag, select it
-                        parsingTextCursor.movePosition(QTextCursor::PreviousWord);
-                        parsingTextCursor.movePosition(QTextCursor::EndOfWord, QTextCursor::KeepAnchor);
-
-                        data = new BlockData();
-                        data->format.setFontUnderline(true);
-                        data->format.setFontOverline(true);
-                        parsingTextCursor.block().setUserData(data);
-                        PreviousHighlightedClosingTag.setX(parsingTextCursor.selectionStart());
-                        PreviousHighlightedClosingTag.setY(parsingTextCursor.selectionEnd());
-                        break;
-                    }
-                    else
-                    {
-                        opened_tag_list.removeOne(tag_text);
-                    }
-                }
-                else if(!tag_text.contains('/'))
-                {
-                    if (tag_text.contains(' '))
-                    {
-                        int first_space = tag_text.indexOf(' ');
-                        tag_text.chop(tag_text.count() - first_space);
-                    }
-                    opened_tag_list.append(tag_text);
-                }
-                // we don't need to test for <... /> since it won't influence the position of the closing tag
-            }
+            copied_position = match.position + match.length;
         }
 
-        parsingTextCursor.movePosition(QTextCursor::Right, tag_delimiter_balance > 0 ? QTextCursor::KeepAnchor : QTextCursor::MoveAnchor);
+        if (count == 0)
+            replacing_cursor.beginEditBlock();
+
+        count += matches.size();
+        replacing_cursor.setPosition(block.position() + matches.first().position);
+        replacing_cursor.setPosition(block.position() + copied_position, QTextCursor::KeepAnchor);
+        replacing_cursor.insertText(result);
     }
+
+    if (count > 0)
+        replacing_cursor.endEditBlock();
+
+    return count;
 }
 
-// Protected:
+// Used for huge files: the tag structure is no longer maintained, so matching tags are not
+// marked, and no completion popup is offered.
 
-void CodeEditor::keyPressEvent(QKeyEvent * e)
+void CodeEditor::setLargeFileMode(const bool enabled)
 {
-    if (e->key() == Qt::Key_Tab || e->key() == Qt::Key_Backtab) {
-        if (AutoCompleter->popup()->isVisible()||TagAutoCompleter->popup()->isVisible())
-        {
-            e->ignore();
-            return;
-        }
+    itIsInLargeFileMode = enabled;
 
-        textCursor().beginEditBlock();
-        bool shiftIsPressed = e->key() == Qt::Key_Backtab;
+    if(enabled)
+        AutoCompleter->popup()->hide();
 
-        QTextCursor editingTextCursor = textCursor();
-        QTextCursor endingTextCursor = textCursor();
+    updateLineNumberAreaWidth(0);
+}
 
-        editingTextCursor.setPosition(textCursor().selectionStart());
-        endingTextCursor.setPosition(textCursor().selectionEnd());
-        endingTextCursor.movePosition( QTextCursor::Down );
-        endingTextCursor.movePosition( QTextCursor::StartOfLine );
+// The header is a line of text shown above the code, hidden while it is empty.
 
-        do{
-            editingTextCursor.movePosition( QTextCursor::StartOfLine );
+void CodeEditor::setHeaderText(const QString &text)
+{
+    headerLabel->setText(text);
+    headerLabel->setHidden(text.isEmpty());
+    updateLineNumberAreaWidth(0);
+    updateMarginWidgetsGeometry();
+}
 
-            if (!shiftIsPressed) {
-                for(int j=0; j<Settings::getTabSize(); ++j) {
-                    editingTextCursor.insertText(" ");
-                }
-            }
-            else {
-                for(int j=0; j<Settings::getTabSize(); ++j) {
-                    if (toPlainText()[editingTextCursor.position()] == ' ') {
-                        editingTextCursor.deleteChar();
-                    }
-                }
-            }
-            editingTextCursor.movePosition( QTextCursor::Down );
-            editingTextCursor.movePosition( QTextCursor::StartOfLine );
+// A block opens a foldable region when one of its tags or braces is still open at its end.
 
-        } while(editingTextCursor.position() != endingTextCursor.position());
-        textCursor().endEditBlock();
+bool CodeEditor::isFoldable(const QTextBlock &block)
+{
+    const BlockData *data;
 
-    }
-    else if (e->key() == Qt::Key_Enter || e->key() == Qt::Key_Return) {
-        QStringList lineList = toPlainText().split("\n");
-        int currentPosition = 0;
-        int lineStartIndex = 0;
-        int nextLineStartIndex;
-        int spaceCount;
+    if (foldMarkerWidth() == 0 || !block.isValid())
+        return false;
 
-        if (AutoCompleter->popup()->isVisible()||TagAutoCompleter->popup()->isVisible())
-        {
-            e->ignore();
-            return;
-        }
+    data = getBlockStructure(block);
 
-        textCursor().beginEditBlock();
-        // TODO: refactor using same kind of functions as the tabbing system
-        currentPosition = textCursor().selectionStart();
+    return data->depthChange - data->minimumDepth > 0;
+}
 
-        for(int i=0; i<lineList.size(); ++i){
-            nextLineStartIndex = lineStartIndex + lineList[i].size() + 1;
+bool CodeEditor::isFolded(const QTextBlock &block) const
+{
+    return block.userData() && static_cast<BlockData *>(block.userData())->itIsFolded;
+}
 
-            if ((lineStartIndex >= currentPosition || (currentPosition >= lineStartIndex && currentPosition < nextLineStartIndex))) {
-                for( spaceCount = 0; lineList[i][spaceCount].isSpace(); spaceCount++ ) ;
-                textCursor().insertText("\n");
-                for( ;spaceCount>0; spaceCount-- ){
-                    textCursor().insertText(" ");
-                }
-                break;
-            }
-            lineStartIndex = nextLineStartIndex;
-        }
-        textCursor().endEditBlock();
-    }
-    else if (e->key() == Qt::Key_Left)
-    {
-        if(textCursor().hasSelection() && (e->modifiers() & Qt::ShiftModifier) == 0)
-        {
-            textCursor().beginEditBlock();
-            QTextCursor newCursor = textCursor();
-            newCursor.setPosition(textCursor().selectionStart());
-            setTextCursor(newCursor);
-            document()->setModified(false);
-            textCursor().endEditBlock();
-        }
-        else
-        {
-            QPlainTextEdit::keyPressEvent(e);
+// Folding hides the lines between the block and the one closing its region. Unfolding shows
+// them again, except for the content of nested regions that are still folded.
+
+void CodeEditor::setFolded(const QTextBlock &block, const bool folded)
+{
+    BlockData *data;
+    QTextBlock end_block;
+    QTextBlock current_block;
+
+    if (!block.isValid() || isFolded(block) == folded || (folded && !isFoldable(block)))
+        return;
+
+    data = getBlockStructure(block);
+    data->itIsFolded = folded;
+    end_block = findFoldEnd(block);
+    current_block = block.next();
+
+    while (current_block.isValid() && current_block != end_block) {
+        current_block.setVisible(!folded);
+
+        if (!folded && isFolded(current_block)) {
+            current_block = findFoldEnd(current_block);
+            continue;
         }
+
+        current_block = current_block.next();
     }
-    else if (e->key() == Qt::Key_Right)
-    {
-        if(textCursor().hasSelection() && (e->modifiers() & Qt::ShiftModifier) == 0)
-        {
-            textCursor().beginEditBlock();
-            QTextCursor newCursor = textCursor();
-            newCursor.setPosition(textCursor().selectionEnd());
-            setTextCursor(newCursor);
-            document()->setModified(false);
-            textCursor().endEditBlock();
-        }
-        else if(toPlainText()[textCursor().position()] == '\n')
-        {
-            textCursor().beginEditBlock();
-            QTextCursor editingTextCursor = textCursor();
-            do
-            {
-                editingTextCursor.movePosition( QTextCursor::Right, (e->modifiers() & Qt::ShiftModifier) == 0 ? QTextCursor::MoveAnchor : QTextCursor::KeepAnchor );
-            } while (toPlainText()[editingTextCursor.position()] == ' ');
 
-            setTextCursor(editingTextCursor);
-            textCursor().endEditBlock();
-        }
-        else
-        {
-            QPlainTextEdit::keyPressEvent(e);
+    // After an edit, the region may have shrunk; lines it hid before are shown as well.
+    if (!folded) {
+        while (current_block.isValid() && current_block.next().isValid() && !current_block.next().isVisible() && !isFolded(current_block)) {
+            current_block = current_block.next();
+            current_block.setVisible(true);
         }
     }
-    else if (e->key() == Qt::Key_Delete)
-    {
-        if(textCursor().hasSelection())
-        {
-            QPlainTextEdit::keyPressEvent(e);
-            return;
-        }
 
-        if(toPlainText()[textCursor().position()] == '\n')
-        {
-            textCursor().beginEditBlock();
-            textCursor().deleteChar();
-            QTextCursor editingTextCursor = textCursor();
-            do
-            {
-                editingTextCursor.movePosition( QTextCursor::Right, QTextCursor::KeepAnchor );
-            } while (toPlainText()[editingTextCursor.position()] == ' ');
+    document()->markContentsDirty(block.position(), (end_block.isValid() ? end_block.position() : document()->characterCount()) - block.position());
 
-            editingTextCursor.removeSelectedText();
-            textCursor().endEditBlock();
-        }
-        else if(toPlainText()[textCursor().position()] == ' ')
-        {
-            QTextCursor editingTextCursor = textCursor();
+    if (folded && !textCursor().block().isVisible()) {
+        QTextCursor cursor = textCursor();
 
-            textCursor().beginEditBlock();
+        cursor.setPosition(block.position() + block.length() - 1);
+        setTextCursor(cursor);
+    }
 
-            for(int i = 0; i < Settings::getTabSize(); i++)
-            {
-                if( toPlainText()[editingTextCursor.position()] == ' ' )
+    viewport()->update();
+    lineNumberArea->update();
+}
+
+// Unfolds the regions hiding a block, outermost first.
+
+void CodeEditor::revealBlock(const QTextBlock &block)
+{
+    while (block.isValid() && !block.isVisible()) {
+        QTextBlock header_block = block.previous();
+
+        while (header_block.isValid() && !(header_block.isVisible() && isFolded(header_block)))
+            header_block = header_block.previous();
+
+        if (!header_block.isValid()) {
+            QTextBlock(block).setVisible(true);
+            document()->markContentsDirty(block.position(), block.length());
+            break;
+        }
+
+        setFolded(header_block, false);
+    }
+}
+
+void CodeEditor::showSymbolPopup()
+{
+    SymbolPopup *popup;
+    const QList<OutlineEntry> outline = getOutline();
+
+    if (outline.isEmpty())
+        return;
+
+    popup = new SymbolPopup(this, outline);
+    connect(popup, SIGNAL(symbolChosen(int)), this, SLOT(jumpToPosition(int)));
+    popup->move(viewport()->mapToGlobal(QPoint((viewport()->width() - popup->width()) / 2, 0)));
+    popup->show();
+}
+
+// Gathers the symbols cached in the blocks; only the blocks edited since the last call are
+// scanned again.
+
+QList<CodeEditor::OutlineEntry> CodeEditor::getOutline()
+{
+    QList<OutlineEntry> outline;
+    int block_number = 0;
+
+    if (getLanguage() == NoLanguage || itIsInLargeFileMode)
+        return outline;
+
+    for (QTextBlock block = document()->firstBlock(); block.isValid(); block = block.next(), ++block_number) {
+        foreach (const OutlineSymbol &symbol, getBlockStructure(block)->symbols) {
+            OutlineEntry entry;
+
+            entry.position = block.position() + symbol.position;
+            entry.lineNumber = block_number;
+            entry.name = symbol.name;
+
+            if (entry.name.isEmpty() && block.previous().isValid())
+                entry.name = block.previous().text().trimmed();
+
+            if (!entry.name.isEmpty())
+                outline << entry;
+        }
+    }
+
+    return outline;
+}
+
+// public slots:
+
+// Replaces the prefix the completions were looked up with; a tag name also gets its closing
+// tag, the cursor being left between the two.
+
+void CodeEditor::completeText(const QString &text)
+{
+    QTextCursor editingTextCursor = textCursor();
+
+    editingTextCursor.beginEditBlock();
+    editingTextCursor.setPosition(textCursor().selectionEnd());
+    editingTextCursor.movePosition(QTextCursor::Left, QTextCursor::KeepAnchor, completionPrefix.length());
+
+    if(completionContext == CompletionService::TagContext && document()->characterAt(editingTextCursor.selectionStart() - 1) != '/')
+    {
+        editingTextCursor.insertText(text + "></" + text + ">");
+        editingTextCursor.movePosition(QTextCursor::Left, QTextCursor::MoveAnchor, text.length() + 3);
+    }
+    else if(completionContext == CompletionService::TagContext)
+    {
+        editingTextCursor.insertText(text + ">");
+    }
+    else
+    {
+        editingTextCursor.insertText(text);
+    }
+
+    editingTextCursor.endEditBlock();
+    setTextCursor(editingTextCursor);
+}
+
+// Scanner states carried from one block to the next.
+enum TagScanState { InText, InComment, InOpenTag, InCloseTag, InDoubleQuote, InSingleQuote, InSpecialTag };
+
+static int getTagNameLength(const QString &text, const int index)
+{
+    int length = 0;
+
+    while (index + length < text.length())
+    {
+        const QChar c = text[index + length];
+
+        if (!c.isLetterOrDigit() && c != '_' && c != '-' && c != ':' && c != '.')
+            break;
+
+        length++;
+    }
+
+    return length;
+}
+
+void CodeEditor::HighlightClosingTag()
+{
+    LatencyTracer::Scope scope(LatencyTracer::TagMatching);
+
+    if(itIsInLargeFileMode)
+        return;
+
+    QTextBlock block = textCursor().block();
+    QTextBlock opening_block;
+    QTextBlock closing_block;
+    QTextBlock previous_blocks[2];
+    BlockData *data;
+    const int position_in_block = textCursor().positionInBlock();
+
+    if(!textCursor().hasSelection())
+    {
+        data = getBlockStructure(block);
+
+        for(int i = 0; i < data->tagTokens.size(); ++i)
+        {
+            const TagToken &token = data->tagTokens[i];
+
+            if((token.type == TagToken::OpenName || token.type == TagToken::CloseName) && position_in_block > token.position && position_in_block <= token.position + token.length)
+            {
+                QTextBlock matching_block = block;
+                int matching_index = i;
+
+                if(findMatchingTag(matching_block, matching_index))
                 {
-                    editingTextCursor.movePosition( QTextCursor::Right, QTextCursor::KeepAnchor );
+                    opening_block = block;
+                    closing_block = matching_block;
+                }
+                break;
+            }
+        }
+    }
+
+    // Only the blocks whose marker actually changes are rehighlighted.
+    previous_blocks[0] = PreviousHighlightedOpeningTag.isNull() ? QTextBlock() : PreviousHighlightedOpeningTag.block();
+    previous_blocks[1] = PreviousHighlightedClosingTag.isNull() ? QTextBlock() : PreviousHighlightedClosingTag.block();
+
+    for(int i = 0; i < 2; ++i)
+    {
+        if(previous_blocks[i].isValid() && previous_blocks[i] != opening_block && previous_blocks[i] != closing_block && previous_blocks[i].userData())
+        {
+            static_cast<BlockData *>(previous_blocks[i].userData())->format = QTextCharFormat();
+            rehighlightBlock(previous_blocks[i]);
+        }
+    }
+
+    setBlockHighlighted(PreviousHighlightedOpeningTag, opening_block);
+    setBlockHighlighted(PreviousHighlightedClosingTag, closing_block);
+}
+
+// Protected:
+
+// Editing commands below only look at the blocks around the cursor, never at the whole text.
+
+static int countLeadingSpaces(const QString &text, const int maximum = -1)
+{
+    int count = 0;
+
+    while (count < text.length() && text[count] == ' ' && (maximum < 0 || count < maximum))
+        count++;
+
+    return count;
+}
+
+static bool isLineEnd(const QChar &character)
+{
+    return character == QChar::ParagraphSeparator || character == '\n';
+}
+
+void CodeEditor::keyPressEvent(QKeyEvent * e)
+{
+    if (e->key() != Qt::Key_Shift && e->key() != Qt::Key_Control && e->key() != Qt::Key_Alt && e->key() != Qt::Key_Meta) {
+        LatencyTracer::getInstance().beginTrace(document()->characterCount());
+        tracedRevision = document()->revision();
+        tracedCursorPosition = textCursor().position();
+        tracedCursorAnchor = textCursor().anchor();
+    }
+
+    LatencyTracer::Scope scope(LatencyTracer::KeyHandling);
+
+    if (e->key() == Qt::Key_Tab || e->key() == Qt::Key_Backtab) {
+        if (AutoCompleter->popup()->isVisible())
+        {
+            e->ignore();
+            return;
+        }
+
+        bool shiftIsPressed = e->key() == Qt::Key_Backtab;
+        QTextCursor editingTextCursor = textCursor();
+        QTextBlock block = document()->findBlock(textCursor().selectionStart());
+        const QTextBlock lastBlock = document()->findBlock(textCursor().selectionEnd());
+
+        editingTextCursor.beginEditBlock();
+
+        for (;;) {
+            editingTextCursor.setPosition(block.position());
+
+            if (!shiftIsPressed) {
+                editingTextCursor.insertText(QString(Settings::getTabSize(), ' '));
+            }
+            else {
+                const int spaceCount = countLeadingSpaces(block.text(), Settings::getTabSize());
+
+                if (spaceCount > 0) {
+                    editingTextCursor.setPosition(block.position() + spaceCount, QTextCursor::KeepAnchor);
+                    editingTextCursor.removeSelectedText();
                 }
-                else
+            }
+
+            if (block == lastBlock || !block.next().isValid())
+                break;
+
+            block = block.next();
+        }
+
+        editingTextCursor.endEditBlock();
+    }
+    else if (e->key() == Qt::Key_Enter || e->key() == Qt::Key_Return) {
+        if (AutoCompleter->popup()->isVisible())
+        {
+            e->ignore();
+            return;
+        }
+
+        QTextCursor editingTextCursor = textCursor();
+        const QString lineText = document()->findBlock(editingTextCursor.selectionStart()).text();
+        int spaceCount = 0;
+
+        while (spaceCount < lineText.length() && lineText[spaceCount].isSpace())
+            spaceCount++;
+
+        editingTextCursor.insertText("\n" + QString(spaceCount, ' '));
+        setTextCursor(editingTextCursor);
+    }
+    else if (e->key() == Qt::Key_Left)
+    {
+        if(textCursor().hasSelection() && (e->modifiers() & Qt::ShiftModifier) == 0)
+        {
+            QTextCursor newCursor = textCursor();
+            newCursor.setPosition(textCursor().selectionStart());
+            setTextCursor(newCursor);
+        }
+        else
+        {
+            QPlainTextEdit::keyPressEvent(e);
+        }
+    }
+    else if (e->key() == Qt::Key_Right)
+    {
+        if(textCursor().hasSelection() && (e->modifiers() & Qt::ShiftModifier) == 0)
+        {
+            QTextCursor newCursor = textCursor();
+            newCursor.setPosition(textCursor().selectionEnd());
+            setTextCursor(newCursor);
+        }
+        else if(isLineEnd(document()->characterAt(textCursor().position())) && textCursor().block().next().isValid())
+        {
+            QTextCursor editingTextCursor = textCursor();
+            const int spaceCount = countLeadingSpaces(editingTextCursor.block().next().text());
+
+            editingTextCursor.movePosition( QTextCursor::Right, (e->modifiers() & Qt::ShiftModifier) == 0 ? QTextCursor::MoveAnchor : QTextCursor::KeepAnchor, 1 + spaceCount );
+            setTextCursor(editingTextCursor);
+        }
+        else
+        {
+            QPlainTextEdit::keyPressEvent(e);
+        }
+    }
+    else if (e->key() == Qt::Key_Delete)
+    {
+        if(textCursor().hasSelection())
+        {
+            QPlainTextEdit::keyPressEvent(e);
+            return;
+        }
+
+        QTextCursor editingTextCursor = textCursor();
+        const QTextBlock block = editingTextCursor.block();
+        const int positionInBlock = editingTextCursor.positionInBlock();
+
+        if(positionInBlock == block.length() - 1 && block.next().isValid())
+        {
+            // joining lines also swallows the indentation of the next one
+            const int spaceCount = countLeadingSpaces(block.next().text());
+
+            editingTextCursor.movePosition( QTextCursor::Right, QTextCursor::KeepAnchor, 1 + spaceCount );
+            editingTextCursor.removeSelectedText();
+        }
+        else if(document()->characterAt(editingTextCursor.position()) == ' ')
+        {
+            const int spaceCount = countLeadingSpaces(block.text().mid(positionInBlock), Settings::getTabSize());
+
+            editingTextCursor.movePosition( QTextCursor::Right, QTextCursor::KeepAnchor, spaceCount );
+            editingTextCursor.removeSelectedText();
+        }
+        else
+        {
+            QPlainTextEdit::keyPressEvent(e);
+        }
+    }
+    else if (e->key() == Qt::Key_Backspace)
+    {
+        const int positionInBlock = textCursor().positionInBlock();
+
+        if(positionInBlock > 0 && document()->characterAt(textCursor().position() - 1) == ' ' && !textCursor().hasSelection() )
+        {
+            QTextCursor editingTextCursor = textCursor();
+            const QString lineText = editingTextCursor.block().text();
+            int spaceCount = 0;
+
+            while (spaceCount < Settings::getTabSize() && positionInBlock - spaceCount > 0 && lineText[positionInBlock - spaceCount - 1] == ' ')
+                spaceCount++;
+
+            editingTextCursor.movePosition( QTextCursor::Left, QTextCursor::KeepAnchor, spaceCount );
+            editingTextCursor.removeSelectedText();
+        }
+        else
+        {
+            QPlainTextEdit::keyPressEvent(e);
+        }
+    }
+    else if (e->key() == Qt::Key_Home) {
+
+        QTextCursor editingTextCursor = textCursor();
+        editingTextCursor.movePosition( QTextCursor::StartOfLine, (e->modifiers() & Qt::ShiftModifier) == 0 ? QTextCursor::MoveAnchor : QTextCursor::KeepAnchor );
+
+        const int spaceCount = countLeadingSpaces(editingTextCursor.block().text().mid(editingTextCursor.positionInBlock()));
+
+        editingTextCursor.movePosition( QTextCursor::Right, (e->modifiers() & Qt::ShiftModifier) == 0 ? QTextCursor::MoveAnchor : QTextCursor::KeepAnchor, spaceCount );
+
+        setTextCursor(editingTextCursor);
+    }
+    else if (e->key() == Qt::Key_Space && (e->modifiers() & Qt::ControlModifier) != 0) {
+        if (itIsInLargeFileMode)
+            return;
+
+        if (AutoCompleter->popup()->isVisible())
+        {
+            AutoCompleter->popup()->hide();
+            return;
+        }
+
+        updateCompletionPopup(true);
+    }
+    else
+    {
+        QPlainTextEdit::keyPressEvent(e);
+    }
+
+    {
+        LatencyTracer::Scope text_changed_scope(LatencyTracer::TextChanged);
+        Rockete::getInstance().checkTextChanged(-1);
+    }
+
+    // end of event is dedicated to auto completion pop up/out. Do not place anything important under this comment
+
+    if(itIsInLargeFileMode)
+        return;
+
+    if(e->key()==Qt::Key_Space||e->key()==Qt::Key_Control||(e->modifiers() & Qt::ControlModifier) != 0||(e->modifiers() & Qt::AltModifier) != 0)
+        return;
+
+    if (!AutoCompleter->popup()->isVisible())
+    {
+        if(e->key()==Qt::Key_Left||e->key()==Qt::Key_Right||e->key()==Qt::Key_Up||e->key()==Qt::Key_Down)
+            return;
+    }
+
+    updateCompletionPopup(false);
+
+    // end of event is dedicated to auto completion pop up/out. Do not place anything important under this comment
+
+}
+
+void CodeEditor::keyReleaseEvent(QKeyEvent * /*e*/)
+{
+}
+
+// The first paint after a key ends its latency trace. A key that changed neither the text nor
+// the cursor and its selection did not request a paint; the paint that comes is an unrelated
+// one, such as a cursor blink, and its trace is dropped.
+
+void CodeEditor::paintEvent(QPaintEvent *e)
+{
+    if (LatencyTracer::getInstance().isTracing() && document()->revision() == tracedRevision
+        && textCursor().position() == tracedCursorPosition && textCursor().anchor() == tracedCursorAnchor)
+        LatencyTracer::getInstance().cancelTrace();
+
+    {
+        LatencyTracer::Scope scope(LatencyTracer::Painting);
+        QPlainTextEdit::paintEvent(e);
+    }
+
+    LatencyTracer::getInstance().endTrace();
+}
+
+void CodeEditor::resizeEvent(QResizeEvent *e)
+{
+    QPlainTextEdit::resizeEvent(e);
+
+    updateMarginWidgetsGeometry();
+}
+
+void CodeEditor::dragEnterEvent(QDragEnterEvent *event)
+{
+    if (event->mimeData()->hasFormat("text/plain"))
+        event->acceptProposedAction();
+}
+
+void CodeEditor::dragMoveEvent ( QDragMoveEvent * e )
+{
+    if (e->mimeData()->hasFormat("text/plain"))
+    {
+        e->acceptProposedAction();
+    }
+}
+
+void CodeEditor::dropEvent(QDropEvent *event)
+{
+    QTextCursor insertingCursor = cursorForPosition(event->pos());
+    insertingCursor.insertText(event->mimeData()->text());
+    setTextCursor(insertingCursor);
+    event->acceptProposedAction();
+}
+
+// private slots
+
+void CodeEditor::updateLineNumberArea(const QRect &rect, int dy)
+{
+    if (dy)
+        lineNumberArea->scroll(0, dy);
+    else
+        lineNumberArea->update(0, rect.y(), lineNumberArea->width(), rect.height());
+
+    if (rect.contains(viewport()->rect()))
+        updateLineNumberAreaWidth(0);
+
+    updateSearchSelections();
+}
+
+void CodeEditor::highlightCurrentLine()
+{
+    QList<QTextEdit::ExtraSelection> extraSelections;
+
+    if (!isReadOnly()) {
+        QTextEdit::ExtraSelection selection;
+
+        QColor lineColor = QColor(Qt::yellow).lighter(160);
+
+        selection.format.setBackground(lineColor);
+        selection.format.setProperty(QTextFormat::FullWidthSelection, true);
+        selection.cursor = textCursor();
+        selection.cursor.clearSelection();
+        extraSelections.append(selection);
+    }
+
+    currentLineSelections = extraSelections;
+    applyExtraSelections();
+}
+
+void CodeEditor::updateLineNumberAreaWidth(int /* newBlockCount */)
+{
+    setViewportMargins(lineNumberAreaWidth(), headerLabel->isHidden() ? 0 : headerLabel->sizeHint().height(), 0, 0);
+}
+
+// Keeps the per-block tag structure current: edited blocks are rescanned, then the following
+// ones only for as long as the state they start in changes (a comment or tag left open).
+
+void CodeEditor::updateBlockStructure(int position, int /*removed_count*/, int added_count)
+{
+    LatencyTracer::Scope scope(LatencyTracer::StructureUpdate);
+
+    if(itIsInLargeFileMode)
+        return;
+
+    QTextBlock block = document()->findBlock(position);
+    QTextBlock last_block = document()->findBlock(position + added_count);
+
+    if(!last_block.isValid())
+        last_block = document()->lastBlock();
+
+    // An edited region header or hidden line is unfolded, as its region may no longer match.
+    for(QTextBlock edited_block = block; edited_block.isValid() && edited_block.position() <= last_block.position(); edited_block = edited_block.next())
+    {
+        if(isFolded(edited_block))
+            setFolded(edited_block, false);
+        else if(!edited_block.isVisible())
+            revealBlock(edited_block);
+    }
+
+    while(block.isValid())
+    {
+        const BlockData *old_data = static_cast<BlockData *>(block.userData());
+        const int old_exit_state = old_data && old_data->itIsScanned ? old_data->exitState : -1;
+        const BlockData *data = getBlockStructure(block);
+
+        if(block.position() > last_block.position() && data->exitState == old_exit_state)
+            break;
+
+        block = block.next();
+    }
+}
+
+void CodeEditor::invalidateSearchSelections()
+{
+    if (!searchPattern.isEmpty())
+        itHasDirtySearchSelections = true;
+}
+
+void CodeEditor::revealCursorBlock()
+{
+    if (!textCursor().block().isVisible())
+        revealBlock(textCursor().block());
+}
+
+void CodeEditor::jumpToPosition(int position)
+{
+    QTextCursor cursor = textCursor();
+
+    cursor.setPosition(qMin(position, document()->characterCount() - 1));
+    setTextCursor(cursor);
+    centerCursor();
+    setFocus();
+}
+
+// Private:
+
+CodeEditor::BlockData *CodeEditor::getBlockStructure(const QTextBlock &block)
+{
+    BlockData *data = static_cast<BlockData *>(block.userData());
+    const QTextBlock previous_block = block.previous();
+    const BlockData *previous_data = previous_block.isValid() ? static_cast<BlockData *>(previous_block.userData()) : NULL;
+    const int entry_state = previous_data && previous_data->itIsScanned ? previous_data->exitState : InText;
+
+    if(!data)
+    {
+        data = new BlockData;
+        QTextBlock(block).setUserData(data);
+    }
+
+    if(!data->itIsScanned || data->revision != block.revision() || data->entryState != entry_state)
+    {
+        data->entryState = entry_state;
+        data->revision = block.revision();
+        data->itIsScanned = true;
+
+        if(getLanguage() == StyleSheetLanguage)
+            scanStyleSheetStructure(block.text(), data);
+        else
+            scanTagStructure(block.text(), data);
+    }
+
+    return data;
+}
+
+// Walks the cached tokens from a tag name to the name of its counterpart. Blocks that cannot
+// bring the nesting back to the starting level are skipped using their depth summary only.
+
+bool CodeEditor::findMatchingTag(QTextBlock &block, int &token_index)
+{
+    BlockData *data = getBlockStructure(block);
+    const bool it_is_forward = data->tagTokens[token_index].type == TagToken::OpenName;
+    const TagToken::Type expected_end = it_is_forward ? TagToken::OpenEnd : TagToken::CloseEnd;
+    const TagToken::Type searched_end = it_is_forward ? TagToken::CloseEnd : TagToken::OpenEnd;
+    const TagToken::Type searched_name = it_is_forward ? TagToken::CloseName : TagToken::OpenName;
+    const QString name = block.text().mid(data->tagTokens[token_index].position + (it_is_forward ? 1 : 2), data->tagTokens[token_index].length - (it_is_forward ? 1 : 2));
+    QTextBlock current_block = block;
+    int index = token_index + 1;
+    int depth = 0;
+
+    // The tag must be properly ended, and a self-closing one has no counterpart.
+    for(;;)
+    {
+        while(index >= data->tagTokens.size())
+        {
+            current_block = current_block.next();
+
+            if(!current_block.isValid())
+                return false;
+
+            data = getBlockStructure(current_block);
+            index = 0;
+        }
+
+        if(data->tagTokens[index].type != expected_end)
+            return false;
+
+        break;
+    }
+
+    if(it_is_forward)
+    {
+        index++;
+    }
+    else
+    {
+        current_block = block;
+        data = getBlockStructure(current_block);
+        index = token_index - 1;
+    }
+
+    for(;;)
+    {
+        if(index < 0 || index >= data->tagTokens.size())
+        {
+            current_block = it_is_forward ? current_block.next() : current_block.previous();
+
+            while(current_block.isValid())
+            {
+                data = getBlockStructure(current_block);
+
+                if(it_is_forward ? depth + data->minimumDepth >= 0 : depth - (data->depthChange - data->minimumDepth) >= 0)
                 {
-                    break;
+                    depth += it_is_forward ? data->depthChange : -data->depthChange;
+                    current_block = it_is_forward ? current_block.next() : current_block.previous();
+                    continue;
                 }
+
+                break;
             }
 
-            editingTextCursor.removeSelectedText();
-            textCursor().endEditBlock();
+            if(!current_block.isValid())
+                return false;
+
+            index = it_is_forward ? 0 : data->tagTokens.size() - 1;
+            continue;
         }
-        else
+
+        const TagToken::Type type = data->tagTokens[index].type;
+
+        if(type == TagToken::OpenEnd)
+            depth += it_is_forward ? 1 : -1;
+        else if(type == TagToken::CloseEnd)
+            depth += it_is_forward ? -1 : 1;
+
+        if(depth < 0 && type == searched_end)
+            break;
+
+        index += it_is_forward ? 1 : -1;
+    }
+
+    // The counterpart's name is the closest name token before its end.
+    for(index--;; index--)
+    {
+        while(index < 0)
         {
-            QPlainTextEdit::keyPressEvent(e);
+            current_block = current_block.previous();
+
+            if(!current_block.isValid())
+                return false;
+
+            data = getBlockStructure(current_block);
+            index = data->tagTokens.size() - 1;
+        }
+
+        const TagToken &token = data->tagTokens[index];
+
+        if(token.type == TagToken::OpenName || token.type == TagToken::CloseName)
+        {
+            const int name_offset = searched_name == TagToken::OpenName ? 1 : 2;
+
+            if(token.type != searched_name || current_block.text().mid(token.position + name_offset, token.length - name_offset) != name)
+                return false;
+
+            block = current_block;
+            token_index = index;
+            return true;
         }
     }
-    else if (e->key() == Qt::Key_Backspace)
+}
+
+void CodeEditor::setBlockHighlighted(QTextCursor &marker, const QTextBlock &block)
+{
+    BlockData *data;
+
+    if(!block.isValid())
     {
-        if(textCursor().position()>0 && toPlainText()[textCursor().position()-1] == ' ' && !textCursor().hasSelection() )
-        {
-            QTextCursor editingTextCursor = textCursor();
+        marker = QTextCursor();
+        return;
+    }
+
+    marker = QTextCursor(block);
+    data = getBlockStructure(block);
+
+    if(data->format.fontUnderline())
+        return;
+
+    data->format.setFontUnderline(true);
+    data->format.setFontOverline(true);
+    rehighlightBlock(block);
+}
+
+void CodeEditor::scanTagStructure(const QString &text, BlockData *data)
+{
+    int state = data->entryState;
+    int depth = 0;
+    int name_length;
 
-            textCursor().beginEditBlock();
+    data->tagTokens.clear();
+    data->symbols.clear();
+    data->minimumDepth = 0;
+
+    for(int i = 0; i < text.length(); ++i)
+    {
+        const QChar c = text[i];
+        TagToken token;
+
+        switch(state)
+        {
+        case InText:
+            if(c != '<')
+                break;
 
-            for(int i = 0; i < Settings::getTabSize(); i++)
+            if(text.midRef(i, 4) == QLatin1String("<!--"))
             {
-                if( textCursor().position()>0 && toPlainText()[editingTextCursor.position()-1] == ' ' )
-                {
-                    editingTextCursor.movePosition( QTextCursor::Left, QTextCursor::KeepAnchor );
-                }
-                else
-                {
-                    break;
-                }
+                state = InComment;
+                i += 3;
+            }
+            else if(i + 1 < text.length() && text[i + 1] == '/')
+            {
+                name_length = getTagNameLength(text, i + 2);
+                token.position = i;
+                token.length = 2 + name_length;
+                token.type = TagToken::CloseName;
+                data->tagTokens.append(token);
+                state = InCloseTag;
+                i += 1 + name_length;
+            }
+            else if(i + 1 < text.length() && (text[i + 1] == '!' || text[i + 1] == '?'))
+            {
+                state = InSpecialTag;
+            }
+            else if((name_length = getTagNameLength(text, i + 1)) > 0)
+            {
+                token.position = i;
+                token.length = 1 + name_length;
+                token.type = TagToken::OpenName;
+                data->tagTokens.append(token);
+                state = InOpenTag;
+                i += name_length;
+            }
+            break;
+        case InComment:
+            if(c == '>' && i >= 2 && text[i - 1] == '-' && text[i - 2] == '-')
+                state = InText;
+            break;
+        case InOpenTag:
+            if(c == '"')
+            {
+                state = InDoubleQuote;
+            }
+            else if(c == '\'')
+            {
+                state = InSingleQuote;
             }
+            else if(c == '>')
+            {
+                const bool it_is_self_closing = i > 0 && text[i - 1] == '/';
 
-            editingTextCursor.removeSelectedText();
-            textCursor().endEditBlock();
-        }
-        else
-        {
-            QPlainTextEdit::keyPressEvent(e);
+                token.position = it_is_self_closing ? i - 1 : i;
+                token.length = it_is_self_closing ? 2 : 1;
+                token.type = it_is_self_closing ? TagToken::SelfClosingEnd : TagToken::OpenEnd;
+                data->tagTokens.append(token);
+                state = InText;
+
+                if(!it_is_self_closing)
+                    depth++;
+            }
+            break;
+        case InDoubleQuote:
+            if(c == '"')
+                state = InOpenTag;
+            break;
+        case InSingleQuote:
+            if(c == '\'')
+                state = InOpenTag;
+            break;
+        case InCloseTag:
+            if(c == '>')
+            {
+                token.position = i;
+                token.length = 1;
+                token.type = TagToken::CloseEnd;
+                data->tagTokens.append(token);
+                state = InText;
+                data->minimumDepth = qMin(data->minimumDepth, --depth);
+            }
+            break;
+        case InSpecialTag:
+            if(c == '>')
+                state = InText;
+            break;
         }
     }
-    else if (e->key() == Qt::Key_Home) {
 
-        textCursor().beginEditBlock();
-        QTextCursor editingTextCursor = textCursor();
-        editingTextCursor.movePosition( QTextCursor::StartOfLine, (e->modifiers() & Qt::ShiftModifier) == 0 ? QTextCursor::MoveAnchor : QTextCursor::KeepAnchor );
+    data->depthChange = depth;
+    data->exitState = state;
+
+    // Outline names read as selectors: tag#id.class, from the attributes on the tag's line.
+    QRegExp attribute_expression("(^|\\s)(id|class)\\s*=\\s*(\"([^\"]*)\"|'([^']*)')");
+
+    for(int i = 0; i < data->tagTokens.size(); ++i)
+    {
+        const TagToken &token = data->tagTokens[i];
+        OutlineSymbol symbol;
+        QString attributes;
+        QString id;
+        QString classes;
+
+        if(token.type != TagToken::OpenName)
+            continue;
+
+        attributes = text.mid(token.position + token.length, (i + 1 < data->tagTokens.size() ? data->tagTokens[i + 1].position : text.length()) - token.position - token.length);
 
-        while (toPlainText()[editingTextCursor.position()] == ' ') 
+        for(int index = attribute_expression.indexIn(attributes); index != -1; index = attribute_expression.indexIn(attributes, index + attribute_expression.matchedLength()))
         {
-            editingTextCursor.movePosition( QTextCursor::Right, (e->modifiers() & Qt::ShiftModifier) == 0 ? QTextCursor::MoveAnchor : QTextCursor::KeepAnchor );
+            const QString value = attribute_expression.cap(4).isEmpty() ? attribute_expression.cap(5) : attribute_expression.cap(4);
+
+            if(attribute_expression.cap(2) == "id")
+                id = value.trimmed();
+            else
+                classes = value.simplified().replace(' ', '.');
         }
 
-        setTextCursor(editingTextCursor);
-        document()->setModified(false);
-        textCursor().endEditBlock();
+        symbol.position = token.position;
+        symbol.name = text.mid(token.position + 1, token.length - 1);
+
+        if(!id.isEmpty())
+            symbol.name += "#" + id;
+
+        if(!classes.isEmpty())
+            symbol.name += "." + classes;
+
+        data->symbols.append(symbol);
     }
-    else if (e->key() == Qt::Key_Space && (e->modifiers() & Qt::ControlModifier) != 0) {
-        int character_position = 0;
-        QTextCursor editingTextCursor = textCursor();
+}
 
-        if (AutoCompleter->popup()->isVisible())
+// Braces give the depth, and the text before each '{' since the previous rule or declaration
+// is the selector; comments, possibly spanning several blocks, are skipped.
+
+void CodeEditor::scanStyleSheetStructure(const QString &text, BlockData *data)
+{
+    int state = data->entryState;
+    int depth = 0;
+    int segment_start = 0;
+
+    data->tagTokens.clear();
+    data->symbols.clear();
+    data->minimumDepth = 0;
+
+    for(int i = 0; i < text.length(); ++i)
+    {
+        const QChar c = text[i];
+
+        if(state == InComment)
         {
-            AutoCompleter->popup()->hide();
-            return;
+            if(c == '/' && i > 0 && text[i - 1] == '*')
+            {
+                state = InText;
+                segment_start = i + 1;
+            }
         }
-        if (TagAutoCompleter->popup()->isVisible())
+        else if(c == '/' && i + 1 < text.length() && text[i + 1] == '*')
         {
-            TagAutoCompleter->popup()->hide();
-            return;
+            state = InComment;
+            i++;
         }
-
-        editingTextCursor.setPosition(textCursor().selectionStart());
-        editingTextCursor.movePosition( QTextCursor::StartOfWord, QTextCursor::KeepAnchor );
-        if(editingTextCursor.position()-1 >=0 )
+        else if(c == '{')
         {
-            character_position = editingTextCursor.position() - 1;
-        }
+            OutlineSymbol symbol;
+
+            symbol.position = segment_start + countLeadingSpaces(text.mid(segment_start));
+            symbol.name = text.mid(segment_start, i - segment_start).simplified();
 
-        QRect cursor_rect = cursorRect();
-        cursor_rect.setWidth(150);
+            if(symbol.name.isEmpty())
+                symbol.position = i;
 
-        if (toPlainText()[character_position] == '<')
+            data->symbols.append(symbol);
+            depth++;
+            segment_start = i + 1;
+        }
+        else if(c == '}')
         {
-            TagAutoCompleter->setCompletionPrefix( editingTextCursor.selectedText().trimmed() );
-            TagAutoCompleter->complete(cursor_rect);
+            data->minimumDepth = qMin(data->minimumDepth, --depth);
+            segment_start = i + 1;
         }
-        else
+        else if(c == ';')
         {
-            AutoCompleter->setCompletionPrefix( editingTextCursor.selectedText().trimmed() );
-            AutoCompleter->complete(cursor_rect);
+            segment_start = i + 1;
         }
-
     }
-    else
+
+    data->depthChange = depth;
+    data->exitState = state == InComment ? InComment : InText;
+}
+
+// The region of a block ends on the first following block that closes what it left open.
+
+QTextBlock CodeEditor::findFoldEnd(const QTextBlock &block)
+{
+    const BlockData *data = getBlockStructure(block);
+    int depth = data->depthChange - data->minimumDepth;
+
+    for(QTextBlock current_block = block.next(); current_block.isValid(); current_block = current_block.next())
     {
-        QPlainTextEdit::keyPressEvent(e);
+        const BlockData *current_data = getBlockStructure(current_block);
+
+        if(depth + current_data->minimumDepth <= 0)
+            return current_block;
+
+        depth += current_data->depthChange;
     }
 
-    Rockete::getInstance().checkTextChanged(-1);
+    return QTextBlock();
+}
+
+// Folding follows the block structure, which is not kept for huge files nor for Lua.
 
-    // end of event is dedicated to auto completion pop up/out. Do not place anything important under this comment
+int CodeEditor::foldMarkerWidth()
+{
+    return getLanguage() == NoLanguage || itIsInLargeFileMode ? 0 : fontMetrics().height();
+}
 
-    if(e->key()==Qt::Key_Space||e->key()==Qt::Key_Control||(e->modifiers() & Qt::ControlModifier) != 0||(e->modifiers() & Qt::AltModifier) != 0)
-        return;
+CodeEditor::BlockData *CodeEditor::getSearchMatches(const QTextBlock &block)
+{
+    BlockData *data = static_cast<BlockData *>(block.userData());
 
-    if (!AutoCompleter->popup()->isVisible()&&!TagAutoCompleter->popup()->isVisible())
+    if (!data)
     {
-        if(e->key()==Qt::Key_Left||e->key()==Qt::Key_Right||e->key()==Qt::Key_Up||e->key()==Qt::Key_Down)
-            return;
+        data = new BlockData;
+        QTextBlock(block).setUserData(data);
     }
 
-    QTextCursor editingTextCursor = textCursor();
-    
-    QRect cursor_rect = cursorRect();
-    cursor_rect.setWidth(150);
-    
-    editingTextCursor.setPosition(textCursor().selectionEnd());
-    editingTextCursor.movePosition(QTextCursor::PreviousWord, QTextCursor::KeepAnchor);
-    editingTextCursor.movePosition(QTextCursor::Left, QTextCursor::KeepAnchor);
-    if(editingTextCursor.selectedText().contains('-'))
+    if (data->searchGeneration != searchGeneration || data->searchRevision != block.revision())
     {
-        editingTextCursor.movePosition(QTextCursor::PreviousWord, QTextCursor::KeepAnchor);
+        data->searchGeneration = searchGeneration;
+        data->searchRevision = block.revision();
+        data->searchMatches.clear();
+        findSearchMatches(block.text(), data->searchMatches);
     }
 
-    if(!editingTextCursor.selectedText().trimmed().isEmpty())
+    return data;
+}
+
+void CodeEditor::findSearchMatches(const QString &text, QVector<SearchMatch> &matches)
+{
+    SearchMatch match;
+    int index;
+
+    if (searchPattern.isEmpty())
+        return;
+
+    if (!itIsRegularExpressionSearch)
     {
-        if(editingTextCursor.selectedText().trimmed().startsWith('<'))
+        match.length = searchPattern.length();
+
+        for (index = text.indexOf(searchPattern, 0, searchCaseSensitivity); index != -1; index = text.indexOf(searchPattern, index + match.length, searchCaseSensitivity))
         {
-            editingTextCursor.movePosition(QTextCursor::Right, QTextCursor::KeepAnchor);
-            TagAutoCompleter->setCompletionPrefix( editingTextCursor.selectedText().trimmed() );
-            if(TagAutoCompleter->completionCount()>0)
-            {
-                TagAutoCompleter->complete(cursor_rect);
-                if (AutoCompleter->popup()->isVisible())
-                {
-                    AutoCompleter->popup()->hide();
-                }
-            }
-            else
-            {
-                if (TagAutoCompleter->popup()->isVisible())
-                {
-                    TagAutoCompleter->popup()->hide();
-                }
-            }
+            match.position = index;
+            matches << match;
         }
-        else
+
+        return;
+    }
+
+    if (!searchExpression.isValid())
+        return;
+
+    for (index = searchExpression.indexIn(text); index != -1; index = searchExpression.indexIn(text, index + qMax(match.length, 1)))
+    {
+        match.position = index;
+        match.length = searchExpression.matchedLength();
+
+        if (match.length > 0)
+            matches << match;
+    }
+}
+
+// Same rules as QString::replace(QRegExp): \1 to \9 stand for the texts captured by the last match.
+
+QString CodeEditor::expandReplacement(const QString &replacement)
+{
+    QString expanded;
+
+    for (int index = 0; index < replacement.length(); ++index)
+    {
+        const QChar c = replacement.at(index);
+
+        if (c == '\\' && index + 1 < replacement.length())
         {
+            const QChar next = replacement.at(index + 1);
 
-            AutoCompleter->setCompletionPrefix(editingTextCursor.selectedText().trimmed());
-            if(AutoCompleter->completionCount()>0)
+            if (next.isDigit() && next != '0')
             {
-                AutoCompleter->complete(cursor_rect);
-                if (TagAutoCompleter->popup()->isVisible())
-                {
-                    TagAutoCompleter->popup()->hide();
-                }
+                expanded += searchExpression.cap(next.digitValue());
+                ++index;
+                continue;
             }
-            else
+
+            if (next == '\\')
             {
-                if (AutoCompleter->popup()->isVisible())
-                {
-                    AutoCompleter->popup()->hide();
-                }
+                expanded += next;
+                ++index;
+                continue;
             }
         }
-    }
-    else
-    {
-        if (AutoCompleter->popup()->isVisible())
-        {
-            AutoCompleter->popup()->hide();
-        }
-        if (TagAutoCompleter->popup()->isVisible())
-        {
-            TagAutoCompleter->popup()->hide();
-        }
-    }
 
-    // end of event is dedicated to auto completion pop up/out. Do not place anything important under this comment
+        expanded += c;
+    }
 
+    return expanded;
 }
 
-void CodeEditor::keyReleaseEvent(QKeyEvent * /*e*/)
+void CodeEditor::updateSearchSelections()
 {
-}
+    const int margin = 32;
+    int first_block_number;
+    int last_block_number;
+    int block_number;
+    QTextCharFormat format;
 
-void CodeEditor::resizeEvent(QResizeEvent *e)
-{
-    QPlainTextEdit::resizeEvent(e);
+    if (searchPattern.isEmpty())
+    {
+        if (!searchSelections.isEmpty())
+        {
+            searchSelections.clear();
+            applyExtraSelections();
+        }
 
-    QRect cr = contentsRect();
-    lineNumberArea->setGeometry(QRect(cr.left(), cr.top(), lineNumberAreaWidth(), cr.height()));
-}
+        searchSelectionsFirstBlock = -1;
+        itHasDirtySearchSelections = false;
+        return;
+    }
 
-void CodeEditor::dragEnterEvent(QDragEnterEvent *event)
-{
-    if (event->mimeData()->hasFormat("text/plain"))
-        event->acceptProposedAction();
-}
+    first_block_number = qMax(0, firstVisibleBlock().blockNumber() - margin);
+    last_block_number = cursorForPosition(QPoint(0, viewport()->height())).blockNumber() + margin;
 
-void CodeEditor::dragMoveEvent ( QDragMoveEvent * e )
-{
-    if (e->mimeData()->hasFormat("text/plain"))
+    if (!itHasDirtySearchSelections && first_block_number == searchSelectionsFirstBlock && last_block_number == searchSelectionsLastBlock)
+        return;
+
+    searchSelectionsFirstBlock = first_block_number;
+    searchSelectionsLastBlock = last_block_number;
+    itHasDirtySearchSelections = false;
+    searchSelections.clear();
+    format.setBackground(Qt::green);
+    block_number = first_block_number;
+
+    for (QTextBlock block = document()->findBlockByNumber(first_block_number); block.isValid() && block_number <= last_block_number; block = block.next(), ++block_number)
     {
-        e->acceptProposedAction();
+        foreach (const SearchMatch &match, getSearchMatches(block)->searchMatches)
+        {
+            QTextEdit::ExtraSelection selection;
+
+            selection.format = format;
+            selection.cursor = QTextCursor(block);
+            selection.cursor.setPosition(block.position() + match.position);
+            selection.cursor.setPosition(block.position() + match.position + match.length, QTextCursor::KeepAnchor);
+            searchSelections << selection;
+        }
     }
+
+    applyExtraSelections();
 }
 
-void CodeEditor::dropEvent(QDropEvent *event)
+void CodeEditor::applyExtraSelections()
 {
-    QTextCursor insertingCursor = cursorForPosition(event->pos());
-    insertingCursor.insertText(event->mimeData()->text());
-    setTextCursor(insertingCursor);
-    event->acceptProposedAction();
+    setExtraSelections(currentLineSelections + searchSelections);
 }
 
-// private slots
+// The context is read from the text before the cursor, starting a few lines above it. Without
+// Ctrl+Space, a popup needs a typed prefix, except for tag names and class or id values.
 
-void CodeEditor::updateLineNumberArea(const QRect &rect, int dy)
+void CodeEditor::updateCompletionPopup(const bool it_is_forced)
 {
-    if (dy)
-        lineNumberArea->scroll(0, dy);
-    else
-        lineNumberArea->update(0, rect.y(), lineNumberArea->width(), rect.height());
+    const int context_line_count = 50;
+    const Language language = getLanguage();
+    QTextBlock block = textCursor().block();
+    QString text = block.text().left(textCursor().positionInBlock());
+    QStringList completions;
 
-    if (rect.contains(viewport()->rect()))
-        updateLineNumberAreaWidth(0);
-}
+    if(language == NoLanguage)
+        return;
 
-void CodeEditor::highlightCurrentLine()
-{
-    QList<QTextEdit::ExtraSelection> extraSelections;
+    for(int i = 0; i < context_line_count && block.previous().isValid(); ++i)
+    {
+        block = block.previous();
+        text.prepend(block.text() + "\n");
+    }
 
-    if (!isReadOnly()) {
-        QTextEdit::ExtraSelection selection;
+    completionContext = CompletionService::getContext(text, language == MarkupLanguage, completionPrefix);
 
-        QColor lineColor = QColor(Qt::yellow).lighter(160);
+    if(it_is_forced || !completionPrefix.isEmpty() || completionContext == CompletionService::TagContext
+        || completionContext == CompletionService::ClassContext || completionContext == CompletionService::IdContext)
+    {
+        completions = CompletionService::getInstance().getCompletions(completionContext, completionPrefix);
+    }
 
-        selection.format.setBackground(lineColor);
-        selection.format.setProperty(QTextFormat::FullWidthSelection, true);
-        selection.cursor = textCursor();
-        selection.cursor.clearSelection();
-        extraSelections.append(selection);
+    if(completions.isEmpty() || (completions.size() == 1 && completions.first() == completionPrefix))
+    {
+        AutoCompleter->popup()->hide();
+        return;
     }
 
-    setExtraSelections(extraSelections);
+    QRect cursor_rect = cursorRect();
+    cursor_rect.setWidth(150);
+
+    completionModel->setStringList(completions);
+    AutoCompleter->setCompletionPrefix(completionPrefix);
+    AutoCompleter->complete(cursor_rect);
 }
 
-void CodeEditor::updateLineNumberAreaWidth(int /* newBlockCount */)
+void CodeEditor::updateMarginWidgetsGeometry()
 {
-    setViewportMargins(lineNumberAreaWidth(), 0, 0, 0);
+    const QRect cr = contentsRect();
+    const int header_height = headerLabel->isHidden() ? 0 : headerLabel->sizeHint().height();
+
+    headerLabel->setGeometry(QRect(cr.left(), cr.top(), cr.width(), header_height));
+    lineNumberArea->setGeometry(QRect(cr.left(), cr.top() + header_height, lineNumberAreaWidth(), cr.height() - header_height));
 }
@@ -5,7 +5,16 @@
 #include <QObject>
 #include <QKeyEvent>
 #include <QCompleter>
+#include <QStringListModel>
 #include <QTextBlockUserData>
+#include <QTextBlock>
+#include <QVector>
+#include <QHash>
+#include <QToolTip>
+#include <QHelpEvent>
+#include <QLabel>
+#include <QRegExp>
+#include "CompletionService.h"
 
 class OpenedFile; 
 class LineNumberArea;
@@ -17,19 +26,79 @@ class CodeEditor : public QPlainTextEdit
 public:
     CodeEditor();
 
-    // this function is intended as basic "check before saving/commiting" that is meant to be extented upon, even rewritten completely if need be
-    bool checkXmlCorrectness(QString & error_message);
     void lineNumberAreaPaintEvent(QPaintEvent *event);
+    void lineNumberAreaMousePressEvent(QMouseEvent *event);
     int lineNumberAreaWidth();
+    void setDiagnosticLines(const QHash<int, QString> &lines);
+    QString getDiagnosticAt(const QPoint &line_number_area_position);
+    void setSearchPattern(const QString &pattern, const bool case_sensitive, const bool regular_expression = false);
+    bool findNextMatch(const bool backward = false);
+    int countMatches();
+    void replaceSelectedMatch(const QString &replacement);
+    int replaceAllMatches(const QString &replacement);
+    void setLargeFileMode(const bool enabled);
+    bool isInLargeFileMode() const {return itIsInLargeFileMode;}
+    void setHeaderText(const QString &text);
+    bool isFoldable(const QTextBlock &block);
+    bool isFolded(const QTextBlock &block) const;
+    void setFolded(const QTextBlock &block, const bool folded);
+    void revealBlock(const QTextBlock &block);
+    void showSymbolPopup();
+
+    // Element or rule starting in a block, as listed by the outline. A rule whose selector is on
+    // the line above its '{' has an empty name; the outline then takes that line.
+    struct OutlineSymbol
+    {
+        int position;
+        QString name;
+    };
+
+    struct OutlineEntry
+    {
+        int position;
+        int lineNumber;
+        QString name;
+    };
+
+    QList<OutlineEntry> getOutline();
 
+    // Structure of one block, kept up to date as the block is edited. In markup, depth only
+    // changes on the '>' ending an opening or closing tag; in style sheets, on braces. Whole
+    // blocks can thus be skipped when matching tags or finding the end of a folded region.
+    struct TagToken
+    {
+        enum Type { OpenName, CloseName, OpenEnd, SelfClosingEnd, CloseEnd };
+        int position;
+        int length;
+        Type type;
+    };
+
+    struct SearchMatch
+    {
+        int position;
+        int length;
+    };
+
     struct BlockData : public QTextBlockUserData
     {
+        BlockData() : itIsScanned(false), revision(0), entryState(0), exitState(0), depthChange(0), minimumDepth(0), itIsFolded(false), searchRevision(0), searchGeneration(-1) {}
         QTextCharFormat format;
-    };
+        QVector<TagToken> tagTokens;
+        QVector<OutlineSymbol> symbols;
+        bool itIsScanned;
+        int revision;
+        int entryState;
+        int exitState;
+        int depthChange;
+        int minimumDepth;
+        bool itIsFolded;
+        QVector<SearchMatch> searchMatches;
+        int searchRevision;
+        int searchGeneration;
+    };
 
 public slots:
     void completeText(const QString &text);
-    void completeTagText(const QString &text);
     virtual void HighlightClosingTag();
 
 
@@ -37,25 +106,64 @@ protected:
     virtual void keyPressEvent(QKeyEvent * e);
     virtual void keyReleaseEvent(QKeyEvent * e);
     void resizeEvent(QResizeEvent *event);
+    virtual void paintEvent(QPaintEvent *event);
     virtual void dragEnterEvent(QDragEnterEvent *event);
     virtual void dragMoveEvent ( QDragMoveEvent * e );
     virtual void dropEvent(QDropEvent *event);
+    virtual void rehighlightBlock(const QTextBlock &/*block*/) {}
+
+    enum Language { NoLanguage, StyleSheetLanguage, MarkupLanguage };
+    virtual Language getLanguage() const {return NoLanguage;}
 
     QCompleter *AutoCompleter;
-    QCompleter *TagAutoCompleter;
 
 private slots:
     void updateLineNumberAreaWidth(int newBlockCount);
     void highlightCurrentLine();
     void updateLineNumberArea(const QRect &, int);
+    void updateBlockStructure(int position, int removed_count, int added_count);
+    void invalidateSearchSelections();
+    void revealCursorBlock();
+    void jumpToPosition(int position);
 
 private:
-    QStringList tag_list;
-    QStringList custom_list;
-    QStringList keyword_list;
-    QPoint PreviousHighlightedOpeningTag;
-    QPoint PreviousHighlightedClosingTag;
+    BlockData *getBlockStructure(const QTextBlock &block);
+    bool findMatchingTag(QTextBlock &block, int &token_index);
+    void setBlockHighlighted(QTextCursor &marker, const QTextBlock &block);
+    static void scanTagStructure(const QString &text, BlockData *data);
+    static void scanStyleSheetStructure(const QString &text, BlockData *data);
+    QTextBlock findFoldEnd(const QTextBlock &block);
+    int foldMarkerWidth();
+    BlockData *getSearchMatches(const QTextBlock &block);
+    void findSearchMatches(const QString &text, QVector<SearchMatch> &matches);
+    QString expandReplacement(const QString &replacement);
+    void updateSearchSelections();
+    void applyExtraSelections();
+    void updateCompletionPopup(const bool it_is_forced);
+    void updateMarginWidgetsGeometry();
+
+    QTextCursor PreviousHighlightedOpeningTag;
+    QTextCursor PreviousHighlightedClosingTag;
     QWidget *lineNumberArea;
+    QLabel *headerLabel;
+    QHash<int, QString> diagnosticLines;
+    QString searchPattern;
+    QRegExp searchExpression;
+    Qt::CaseSensitivity searchCaseSensitivity;
+    bool itIsRegularExpressionSearch;
+    int searchGeneration;
+    int searchSelectionsFirstBlock;
+    int searchSelectionsLastBlock;
+    bool itHasDirtySearchSelections;
+    bool itIsInLargeFileMode;
+    QStringListModel *completionModel;
+    CompletionService::Context completionContext;
+    QString completionPrefix;
+    QList<QTextEdit::ExtraSelection> currentLineSelections;
+    QList<QTextEdit::ExtraSelection> searchSelections;
+    int tracedRevision;
+    int tracedCursorPosition;
+    int tracedCursorAnchor;
 };
 
 
@@ -77,6 +185,26 @@ protected:
         codeEditor->lineNumberAreaPaintEvent(event);
     }
 
+    void mousePressEvent(QMouseEvent *event) {
+        codeEditor->lineNumberAreaMousePressEvent(event);
+    }
+
+    bool event(QEvent *event) {
+        if (event->type() == QEvent::ToolTip) {
+            QHelpEvent *help_event = static_cast<QHelpEvent *>(event);
+            QString diagnostic = codeEditor->getDiagnosticAt(help_event->pos());
+
+            if (diagnostic.isEmpty())
+                QToolTip::hideText();
+            else
+                QToolTip::showText(help_event->globalPos(), diagnostic, this);
+
+            return true;
+        }
+
+        return QWidget::event(event);
+    }
+
 private:
     CodeEditor *codeEditor;
 };
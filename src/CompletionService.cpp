@@ -0,0 +1,518 @@
+#include "CompletionService.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSet>
+#include <QTextStream>
+#include <algorithm>
+#include "ProjectSearchIndex.h"
+
+static const int maximumCompletionCount = 200;
+static const char *wordListsSource = ":word_lists";
+static const char *spritesSource = ":sprites";
+static const char *attributesSource = ":attributes";
+static const char *attributeNames[] = {
+    "id", "class", "style", "src", "href", "rel", "type", "name", "value", "checked", "disabled", "selected",
+    "maxlength", "size", "min", "max", "step", "cols", "rows", "for", "template",
+    "onload", "onunload", "onshow", "onhide", "onclick", "ondblclick", "onmouseover", "onmouseout", "onmousedown",
+    "onmouseup", "onfocus", "onblur", "onkeydown", "onkeyup", "onchange", "onsubmit", "ondragstart", "ondragend",
+    NULL
+};
+
+class CompletionIndexingTask : public QRunnable
+{
+public:
+    CompletionIndexingTask(CompletionService *completion_service, const QStringList &file_list = QStringList())
+        : service(completion_service), files(file_list)
+    {
+    }
+
+    virtual void run()
+    {
+        if (files.isEmpty())
+            service->rescan();
+        else
+            service->indexFiles(files);
+    }
+
+private:
+    CompletionService *service;
+    QStringList files;
+};
+
+static bool caseInsensitiveLessThan(const QString &first, const QString &second)
+{
+    return first.compare(second, Qt::CaseInsensitive) < 0;
+}
+
+static bool isNameCharacter(const QChar &c)
+{
+    return c.isLetterOrDigit() || c == '-' || c == '_';
+}
+
+// Public:
+
+CompletionService::CompletionService()
+    : itIsStopping(0)
+{
+    Symbols attributes;
+
+    indexingPool.setMaxThreadCount(1);
+
+    for (int kind = 0; kind < KindCount; ++kind)
+        itIsSorted[kind] = false;
+
+    for (int i = 0; attributeNames[i]; ++i)
+        attributes.words[AttributeName] << attributeNames[i];
+
+    setSource(attributesSource, attributes);
+
+    connect(&ProjectSearchIndex::getInstance(), SIGNAL(indexingFinished(int)), this, SLOT(projectIndexingFinished()));
+}
+
+CompletionService::~CompletionService()
+{
+    itIsStopping.store(1);
+    indexingPool.waitForDone();
+}
+
+// tag_list.txt gives the tags, keyword_list.txt the properties and values, and custom_list.txt
+// words offered for attributes, properties and values alike.
+
+void CompletionService::loadWordLists(const QString &word_list_path)
+{
+    Symbols word_lists;
+    QStringList custom_words;
+    QStringList keywords;
+
+    readWordList(word_list_path + "tag_list.txt", word_lists.words[TagName]);
+    readWordList(word_list_path + "keyword_list.txt", keywords);
+    readWordList(word_list_path + "custom_list.txt", custom_words);
+
+    word_lists.words[AttributeName] = custom_words;
+    word_lists.words[PropertyName] = keywords + custom_words;
+    word_lists.words[ValueWord] = keywords + custom_words;
+
+    QMutexLocker locker(&mutex);
+
+    wordListPath = QDir::cleanPath(QFileInfo(word_list_path).absoluteFilePath());
+    setSource(wordListsSource, word_lists);
+}
+
+void CompletionService::setProject(const QStringList &directory_list)
+{
+    itIsStopping.store(1);
+    indexingPool.waitForDone();
+    itIsStopping.store(0);
+
+    mutex.lock();
+
+    foreach (const QString &source_name, sources.keys()) {
+        if (!source_name.startsWith(':'))
+            removeSource(source_name);
+    }
+
+    directories.clear();
+
+    foreach (const QString &directory, directory_list) {
+        const QString path = QDir::cleanPath(QFileInfo(directory).absoluteFilePath());
+
+        if (!directory.isEmpty() && QFileInfo(path).isDir() && !directories.contains(path))
+            directories << path;
+    }
+
+    mutex.unlock();
+
+    indexingPool.start(new CompletionIndexingTask(this));
+}
+
+void CompletionService::updateFile(const QString &file_path)
+{
+    const QString path = QDir::cleanPath(QFileInfo(file_path).absoluteFilePath());
+
+    if (!wordListPath.isEmpty() && QFileInfo(path).absolutePath() == wordListPath && path.endsWith("_list.txt")) {
+        loadWordLists(wordListPath + "/");
+        return;
+    }
+
+    if (!isIndexedFile(path))
+        return;
+
+    foreach (const QString &directory, directories) {
+        if (path.startsWith(directory + "/")) {
+            indexingPool.start(new CompletionIndexingTask(this, QStringList(path)));
+            return;
+        }
+    }
+}
+
+void CompletionService::setSpriteNames(const QStringList &sprite_names)
+{
+    Symbols sprites;
+    QMutexLocker locker(&mutex);
+
+    sprites.words[SpriteName] = sprite_names;
+    setSource(spritesSource, sprites);
+}
+
+QStringList CompletionService::getCompletions(const Context context, const QString &prefix)
+{
+    QStringList completions;
+    QMutexLocker locker(&mutex);
+
+    switch (context) {
+    case TagContext:
+        appendCompletions(completions, TagName, prefix);
+        break;
+    case AttributeContext:
+        appendCompletions(completions, AttributeName, prefix);
+        break;
+    case ClassContext:
+        appendCompletions(completions, ClassName, prefix);
+        break;
+    case IdContext:
+        appendCompletions(completions, IdName, prefix);
+        break;
+    case SelectorContext:
+        if (prefix.startsWith('.'))
+            appendCompletions(completions, ClassName, prefix.mid(1), ".");
+        else if (prefix.startsWith('#'))
+            appendCompletions(completions, IdName, prefix.mid(1), "#");
+        else
+            appendCompletions(completions, TagName, prefix);
+        break;
+    case PropertyContext:
+        appendCompletions(completions, PropertyName, prefix);
+        appendCompletions(completions, DecoratorId, prefix);
+        break;
+    case ValueContext:
+        appendCompletions(completions, ValueWord, prefix);
+        appendCompletions(completions, SpriteName, prefix);
+        break;
+    default:
+        break;
+    }
+
+    std::sort(completions.begin(), completions.end(), caseInsensitiveLessThan);
+    completions.removeDuplicates();
+
+    return completions;
+}
+
+// Looks at the text before the cursor, which should start a few lines above it: inside a tag,
+// its name, attribute or the value of a class or id attribute; elsewhere a style sheet selector,
+// property or value. In a RML document, only the content of a <style> tag is a style sheet.
+
+CompletionService::Context CompletionService::getContext(const QString &text_before_cursor, const bool it_is_markup, QString &prefix)
+{
+    int start = text_before_cursor.length();
+
+    while (start > 0 && isNameCharacter(text_before_cursor.at(start - 1)))
+        --start;
+
+    prefix = text_before_cursor.mid(start);
+
+    const QString before = text_before_cursor.left(start);
+
+    if (it_is_markup) {
+        const int tag_start = before.lastIndexOf('<');
+
+        if (tag_start != -1 && tag_start > before.lastIndexOf('>')) {
+            const QString tag_text = before.mid(tag_start + 1);
+
+            if (tag_text.isEmpty() || tag_text == "/")
+                return TagContext;
+
+            if (tag_text.count('"') % 2 == 1 || tag_text.count('\'') % 2 == 1) {
+                const int quote = qMax(tag_text.lastIndexOf('"'), tag_text.lastIndexOf('\''));
+                QString attribute = tag_text.left(quote).trimmed();
+
+                if (!attribute.endsWith('='))
+                    return NoContext;
+
+                attribute.chop(1);
+                attribute = attribute.trimmed();
+                attribute = attribute.mid(attribute.lastIndexOf(' ') + 1);
+
+                if (attribute.compare("class", Qt::CaseInsensitive) == 0)
+                    return ClassContext;
+
+                if (attribute.compare("id", Qt::CaseInsensitive) == 0)
+                    return IdContext;
+
+                return NoContext;
+            }
+
+            return AttributeContext;
+        }
+
+        if (before.lastIndexOf("<style", -1, Qt::CaseInsensitive) <= before.lastIndexOf("</style", -1, Qt::CaseInsensitive))
+            return NoContext;
+    }
+
+    if (before.lastIndexOf('{') <= before.lastIndexOf('}')) {
+        if (before.endsWith('.') || before.endsWith('#'))
+            prefix.prepend(before.right(1));
+        else if (before.endsWith(':'))
+            return NoContext;
+
+        return SelectorContext;
+    }
+
+    return before.lastIndexOf(':') > qMax(before.lastIndexOf(';'), before.lastIndexOf('{')) ? ValueContext : PropertyContext;
+}
+
+// Only style sheets whose modification date changed are read again.
+
+void CompletionService::rescan()
+{
+    QSet<QString> found_paths;
+
+    mutex.lock();
+    const QStringList directory_list = directories;
+    mutex.unlock();
+
+    foreach (const QString &directory, directory_list) {
+        QDirIterator iterator(directory, QStringList("*.rcss"), QDir::Files | QDir::NoSymLinks, QDirIterator::Subdirectories);
+
+        while (iterator.hasNext()) {
+            iterator.next();
+
+            const QString path = QDir::cleanPath(iterator.fileInfo().absoluteFilePath());
+            const qint64 last_modified = iterator.fileInfo().lastModified().toMSecsSinceEpoch();
+
+            if (itIsStopping.load())
+                return;
+
+            found_paths.insert(path);
+
+            mutex.lock();
+            const bool it_is_up_to_date = sources.contains(path) && sources[path].lastModified == last_modified;
+            mutex.unlock();
+
+            if (!it_is_up_to_date)
+                indexFiles(QStringList(path));
+        }
+    }
+
+    QMutexLocker locker(&mutex);
+
+    foreach (const QString &source_name, sources.keys()) {
+        if (!source_name.startsWith(':') && !found_paths.contains(source_name))
+            removeSource(source_name);
+    }
+}
+
+void CompletionService::indexFiles(const QStringList &file_list)
+{
+    foreach (const QString &path, file_list) {
+        QFile file(path);
+        Symbols symbols;
+
+        if (!file.open(QIODevice::ReadOnly)) {
+            QMutexLocker locker(&mutex);
+            removeSource(path);
+            continue;
+        }
+
+        QTextStream in(&file);
+
+        in.setCodec("UTF-8");
+        symbols.lastModified = QFileInfo(path).lastModified().toMSecsSinceEpoch();
+        scanStyleSheet(in.readAll(), symbols);
+
+        QMutexLocker locker(&mutex);
+        setSource(path, symbols);
+    }
+}
+
+// Private slots:
+
+// The search index rescans after every change on disk; the style sheets that changed are read again.
+
+void CompletionService::projectIndexingFinished()
+{
+    if (!directories.isEmpty())
+        indexingPool.start(new CompletionIndexingTask(this));
+}
+
+// Private:
+
+// The mutex is held by the callers. Words are shared with the count table, so each distinct
+// word is stored once whatever the number of files using it.
+
+void CompletionService::setSource(const QString &source_name, Symbols &symbols)
+{
+    removeSource(source_name);
+
+    for (int kind = 0; kind < KindCount; ++kind) {
+        QStringList &words = symbols.words[kind];
+
+        words.removeDuplicates();
+
+        for (int i = 0; i < words.size(); ++i) {
+            QHash<QString, int>::iterator count = wordCounts[kind].find(words[i]);
+
+            if (count == wordCounts[kind].end()) {
+                count = wordCounts[kind].insert(words[i], 0);
+                itIsSorted[kind] = false;
+            }
+
+            ++count.value();
+            words[i] = count.key();
+        }
+    }
+
+    sources.insert(source_name, symbols);
+}
+
+void CompletionService::removeSource(const QString &source_name)
+{
+    QHash<QString, Symbols>::iterator source = sources.find(source_name);
+
+    if (source == sources.end())
+        return;
+
+    for (int kind = 0; kind < KindCount; ++kind) {
+        foreach (const QString &word, source.value().words[kind]) {
+            QHash<QString, int>::iterator count = wordCounts[kind].find(word);
+
+            if (count != wordCounts[kind].end() && --count.value() == 0) {
+                wordCounts[kind].erase(count);
+                itIsSorted[kind] = false;
+            }
+        }
+    }
+
+    sources.erase(source);
+}
+
+void CompletionService::appendCompletions(QStringList &completions, const Kind kind, const QString &prefix, const QString &added_prefix)
+{
+    if (!itIsSorted[kind]) {
+        sortedWords[kind] = wordCounts[kind].keys().toVector();
+        std::sort(sortedWords[kind].begin(), sortedWords[kind].end(), caseInsensitiveLessThan);
+        itIsSorted[kind] = true;
+    }
+
+    const QVector<QString> &words = sortedWords[kind];
+    QVector<QString>::const_iterator word = std::lower_bound(words.begin(), words.end(), prefix, caseInsensitiveLessThan);
+
+    for (int count = 0; word != words.end() && word->startsWith(prefix, Qt::CaseInsensitive) && count < maximumCompletionCount; ++word, ++count)
+        completions << added_prefix + *word;
+}
+
+bool CompletionService::isIndexedFile(const QString &file_path)
+{
+    return file_path.endsWith(".rcss", Qt::CaseInsensitive);
+}
+
+void CompletionService::readWordList(const QString &file_path, QStringList &words)
+{
+    QFile file(file_path);
+
+    if (!file.open(QFile::ReadOnly))
+        return;
+
+    while (!file.atEnd()) {
+        const QString word = QString::fromUtf8(file.readLine()).trimmed();
+
+        if (!word.isEmpty())
+            words << word;
+    }
+}
+
+// Names before a '{' are tags, or classes and ids after a '.' or a '#'; inside a rule, names
+// before a ':' are properties, "<id>-decorator" ones naming a decorator, and the words of a
+// value outside parentheses are offered as values.
+
+void CompletionService::scanStyleSheet(const QString &text, Symbols &symbols)
+{
+    const int length = text.length();
+    bool it_is_in_rule = false;
+    bool it_is_in_value = false;
+    int parenthesis_depth = 0;
+    QChar previous = ' ';
+    int i = 0;
+
+    while (i < length) {
+        const QChar c = text.at(i);
+
+        if (c == '/' && i + 1 < length && text.at(i + 1) == '*') {
+            const int comment_end = text.indexOf("*/", i + 2);
+
+            i = comment_end == -1 ? length : comment_end + 2;
+            previous = ' ';
+            continue;
+        }
+
+        if (c == '"' || c == '\'') {
+            const int quote_end = text.indexOf(c, i + 1);
+
+            i = quote_end == -1 ? length : quote_end + 1;
+            previous = c;
+            continue;
+        }
+
+        if (isNameCharacter(c)) {
+            int end = i;
+
+            while (end < length && isNameCharacter(text.at(end)))
+                ++end;
+
+            const QString name = text.mid(i, end - i);
+
+            if (!it_is_in_rule) {
+                if (previous == '.')
+                    symbols.words[ClassName] << name;
+                else if (previous == '#')
+                    symbols.words[IdName] << name;
+                else if (previous != ':' && name.at(0).isLetter())
+                    symbols.words[TagName] << name;
+            }
+            else if (!it_is_in_value) {
+                symbols.words[PropertyName] << name;
+
+                if (name.endsWith("-decorator") && name.length() > 10)
+                    symbols.words[DecoratorId] << name.left(name.length() - 10);
+            }
+            else if (parenthesis_depth == 0 && name.at(0).isLetter()) {
+                symbols.words[ValueWord] << name;
+            }
+
+            previous = name.at(name.length() - 1);
+            i = end;
+            continue;
+        }
+
+        if (c == '{') {
+            it_is_in_rule = true;
+            it_is_in_value = false;
+        }
+        else if (c == '}') {
+            it_is_in_rule = false;
+            it_is_in_value = false;
+        }
+        else if (c == ':' && it_is_in_rule) {
+            it_is_in_value = true;
+            parenthesis_depth = 0;
+        }
+        else if (c == ';') {
+            it_is_in_value = false;
+        }
+        else if (c == '(') {
+            ++parenthesis_depth;
+        }
+        else if (c == ')' && parenthesis_depth > 0) {
+            --parenthesis_depth;
+        }
+
+        previous = c;
+        ++i;
+    }
+}
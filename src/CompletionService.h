@@ -0,0 +1,74 @@
+#ifndef COMPLETIONSERVICE_H
+#define COMPLETIONSERVICE_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+
+// Completion words shared by every editor. The word lists are read once per project, and the
+// tags, classes, ids, properties and decorators of the project style sheets are indexed on a
+// pool thread, then kept current as files are saved or change on disk. Each kind of word is a
+// sorted array of strings shared with the index, so a prefix lookup is a binary search.
+
+class CompletionService : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Context { NoContext, TagContext, AttributeContext, ClassContext, IdContext, SelectorContext, PropertyContext, ValueContext };
+
+    CompletionService();
+    virtual ~CompletionService();
+
+    static CompletionService & getInstance() {
+        static CompletionService instance;
+        return instance;
+    }
+
+    void loadWordLists(const QString &word_list_path);
+    void setProject(const QStringList &directory_list);
+    void updateFile(const QString &file_path);
+    void setSpriteNames(const QStringList &sprite_names);
+    QStringList getCompletions(const Context context, const QString &prefix);
+    static Context getContext(const QString &text_before_cursor, const bool it_is_markup, QString &prefix);
+
+    // Called from the pool thread.
+    void rescan();
+    void indexFiles(const QStringList &file_list);
+
+private slots:
+    void projectIndexingFinished();
+
+private:
+    enum Kind { TagName, AttributeName, ClassName, IdName, PropertyName, ValueWord, DecoratorId, SpriteName, KindCount };
+
+    struct Symbols
+    {
+        Symbols() : lastModified(0) {}
+        qint64 lastModified;
+        QStringList words[KindCount];
+    };
+
+    void setSource(const QString &source_name, Symbols &symbols);
+    void removeSource(const QString &source_name);
+    void appendCompletions(QStringList &completions, const Kind kind, const QString &prefix, const QString &added_prefix = QString());
+    static bool isIndexedFile(const QString &file_path);
+    static void readWordList(const QString &file_path, QStringList &words);
+    static void scanStyleSheet(const QString &text, Symbols &symbols);
+
+    QMutex mutex;
+    QHash<QString, Symbols> sources;
+    QHash<QString, int> wordCounts[KindCount];
+    QVector<QString> sortedWords[KindCount];
+    bool itIsSorted[KindCount];
+    QString wordListPath;
+    QStringList directories;
+    QThreadPool indexingPool;
+    QAtomicInt itIsStopping;
+};
+
+#endif
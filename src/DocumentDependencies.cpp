@@ -0,0 +1,217 @@
+#include "DocumentDependencies.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QHash>
+#include <QRegExp>
+#include <QTextStream>
+#include "Rockete.h"
+
+void DocumentDependencies::clear()
+{
+    styleSheets.clear();
+    templates.clear();
+    textures.clear();
+    fonts.clear();
+    fileNameSet.clear();
+}
+
+void DocumentDependencies::scanDocument(const QString &document_content, const QString &document_path)
+{
+    clear();
+    scanMarkup(document_content, QFileInfo(document_path).absolutePath());
+}
+
+bool DocumentDependencies::dependsOn(const QString &file_name) const
+{
+    return fileNameSet.contains(QFileInfo(file_name).fileName().toLower());
+}
+
+// Private:
+
+// Single pass over the tags; only <link>, <img>, <style> and style attributes matter here,
+// templates are followed so that their style sheets are reported with the document's own.
+
+void DocumentDependencies::scanMarkup(const QString &content, const QString &base_path)
+{
+    int index = 0;
+
+    while ((index = content.indexOf('<', index)) != -1) {
+        QHash<QString, QString> attributes;
+        QString tag_name;
+
+        if (content.midRef(index, 4) == QLatin1String("<!--")) {
+            index = content.indexOf("-->", index + 4);
+
+            if (index == -1)
+                return;
+
+            continue;
+        }
+
+        ++index;
+
+        while (index < content.length() && (content[index].isLetterOrDigit() || content[index] == '_' || content[index] == '-'))
+            tag_name += content[index++].toLower();
+
+        while (index < content.length() && content[index] != '>') {
+            QString attribute_name;
+            QString attribute_value;
+
+            if (content[index].isSpace() || content[index] == '/') {
+                ++index;
+                continue;
+            }
+
+            while (index < content.length() && !content[index].isSpace() && content[index] != '=' && content[index] != '>')
+                attribute_name += content[index++].toLower();
+
+            while (index < content.length() && content[index].isSpace())
+                ++index;
+
+            if (index < content.length() && content[index] == '=') {
+                ++index;
+
+                while (index < content.length() && content[index].isSpace())
+                    ++index;
+
+                if (index < content.length() && (content[index] == '"' || content[index] == '\'')) {
+                    const QChar quote = content[index++];
+                    const int value_end = content.indexOf(quote, index);
+
+                    if (value_end == -1)
+                        return;
+
+                    attribute_value = content.mid(index, value_end - index);
+                    index = value_end + 1;
+                }
+                else {
+                    while (index < content.length() && !content[index].isSpace() && content[index] != '>')
+                        attribute_value += content[index++];
+                }
+            }
+
+            if (!attribute_name.isEmpty())
+                attributes.insert(attribute_name, attribute_value);
+        }
+
+        if (tag_name.isEmpty())
+            continue;
+
+        if (attributes.contains("style"))
+            scanStyleSheet(attributes.value("style"), base_path);
+
+        if (tag_name == "link") {
+            const QString type = attributes.value("type").toLower();
+            const QString path = resolvePath(attributes.value("href"), base_path);
+
+            if (path.isEmpty())
+                continue;
+
+            if (type == "text/rcss") {
+                QString style_sheet_content;
+
+                if (styleSheets.contains(path))
+                    continue;
+
+                addFile(styleSheets, path);
+
+                if (readFile(path, style_sheet_content))
+                    scanStyleSheet(style_sheet_content, QFileInfo(path).absolutePath());
+            }
+            else if (type == "text/template") {
+                QString template_content;
+
+                if (templates.contains(path))
+                    continue;
+
+                addFile(templates, path);
+
+                if (readFile(path, template_content))
+                    scanMarkup(template_content, QFileInfo(path).absolutePath());
+            }
+        }
+        else if (tag_name == "img") {
+            const QString path = resolvePath(attributes.value("src"), base_path);
+
+            if (!path.isEmpty() && !textures.contains(path))
+                addFile(textures, path);
+        }
+        else if (tag_name == "style" && index < content.length()) {
+            const int style_end = content.indexOf("</style", index, Qt::CaseInsensitive);
+
+            if (style_end == -1)
+                return;
+
+            scanStyleSheet(content.mid(index + 1, style_end - index - 1), base_path);
+            index = style_end;
+        }
+    }
+}
+
+void DocumentDependencies::scanStyleSheet(const QString &content, const QString &base_path)
+{
+    static const QRegExp texture_expression("([^\\s:;,\"'(){}]+\\.(png|tga|jpg|jpeg|dds|bmp))\\b", Qt::CaseInsensitive);
+    static const QRegExp font_expression("font-family\\s*:\\s*([^;}]+)", Qt::CaseInsensitive);
+    QRegExp expression;
+    int index;
+
+    expression = texture_expression;
+
+    for (index = expression.indexIn(content); index != -1; index = expression.indexIn(content, index + expression.matchedLength())) {
+        const QString path = resolvePath(expression.cap(1), base_path);
+
+        if (!textures.contains(path))
+            addFile(textures, path);
+    }
+
+    expression = font_expression;
+
+    for (index = expression.indexIn(content); index != -1; index = expression.indexIn(content, index + expression.matchedLength())) {
+        QString font_name = expression.cap(1).trimmed();
+
+        font_name.remove('"');
+        font_name.remove('\'');
+
+        if (!font_name.isEmpty() && !fonts.contains(font_name))
+            fonts << font_name;
+    }
+}
+
+void DocumentDependencies::addFile(QStringList &list, const QString &path)
+{
+    list << path;
+    fileNameSet.insert(QFileInfo(path).fileName().toLower());
+}
+
+bool DocumentDependencies::readFile(const QString &path, QString &content)
+{
+    QFile file(path);
+
+    if (!file.open(QFile::ReadOnly | QFile::Text))
+        return false;
+
+    QTextStream stream(&file);
+    content = stream.readAll();
+
+    return true;
+}
+
+// Same lookup as RocketFileInterface: relative to the including file first, then the project files.
+
+QString DocumentDependencies::resolvePath(const QString &path, const QString &base_path)
+{
+    QString trimmed_path = path.trimmed();
+    QFileInfo file_info;
+
+    if (trimmed_path.isEmpty())
+        return QString();
+
+    file_info = QFileInfo(QDir(base_path), trimmed_path);
+
+    if (file_info.exists())
+        return file_info.absoluteFilePath();
+
+    return Rockete::getInstance().getPathForFileName(QFileInfo(trimmed_path).fileName());
+}
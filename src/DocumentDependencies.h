@@ -0,0 +1,35 @@
+#ifndef DOCUMENTDEPENDENCIES_H
+#define DOCUMENTDEPENDENCIES_H
+
+#include <QString>
+#include <QStringList>
+#include <QSet>
+
+// Files and resources a RML document pulls in, gathered from the text when the document is loaded.
+
+class DocumentDependencies
+{
+public:
+    void clear();
+    void scanDocument(const QString &document_content, const QString &document_path);
+    const QStringList &getStyleSheets() const { return styleSheets; }
+    const QStringList &getTemplates() const { return templates; }
+    const QStringList &getTextures() const { return textures; }
+    const QStringList &getFonts() const { return fonts; }
+    bool dependsOn(const QString &file_name) const;
+
+private:
+    void scanMarkup(const QString &content, const QString &base_path);
+    void scanStyleSheet(const QString &content, const QString &base_path);
+    void addFile(QStringList &list, const QString &path);
+    static bool readFile(const QString &path, QString &content);
+    static QString resolvePath(const QString &path, const QString &base_path);
+
+    QStringList styleSheets;
+    QStringList templates;
+    QStringList textures;
+    QStringList fonts;
+    QSet<QString> fileNameSet;
+};
+
+#endif
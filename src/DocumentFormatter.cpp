@@ -0,0 +1,156 @@
+#include "DocumentFormatter.h"
+
+#include <QDomDocument>
+#include <QHash>
+#include <QPair>
+#include <QVector>
+
+// Beyond this many inserted and removed lines, the middle of the text is replaced as a whole.
+static const int maximumEditCount = 4000;
+
+static void addHunk(DocumentFormatter::LineHunkList &hunks, const int first_line, const int line_count, const QStringList &lines)
+{
+    DocumentFormatter::LineHunk hunk;
+
+    hunk.firstLine = first_line;
+    hunk.lineCount = line_count;
+    hunk.lines = lines;
+    hunks << hunk;
+}
+
+static int getLineId(QHash<QString, int> &line_ids, const QString &line)
+{
+    QHash<QString, int>::const_iterator it = line_ids.constFind(line);
+
+    if (it != line_ids.constEnd())
+        return it.value();
+
+    const int id = line_ids.size();
+    line_ids.insert(line, id);
+    return id;
+}
+
+// Public:
+
+DocumentFormatter::DocumentFormatter(const QString &formatted_text, const int indentation_size, const int text_revision)
+    : text(formatted_text), indentation(indentation_size), revision(text_revision)
+{
+    setAutoDelete(false);
+}
+
+void DocumentFormatter::run()
+{
+    QDomDocument dom_document;
+    QString error;
+    int error_line;
+    int error_column;
+
+    if (!dom_document.setContent(text, &error, &error_line, &error_column)) {
+        errorMessage = QString("%1 at line %2, column %3").arg(error).arg(error_line).arg(error_column);
+        emit finished();
+        return;
+    }
+
+    hunks = diffLines(text.split('\n'), dom_document.toString(indentation).split('\n'));
+    emit finished();
+}
+
+// Common leading and trailing lines are skipped, then the rest is compared with Myers' algorithm.
+// Only the part of each step's diagonal array that the backtracking can read is kept.
+
+DocumentFormatter::LineHunkList DocumentFormatter::diffLines(const QStringList &old_lines, const QStringList &new_lines)
+{
+    LineHunkList result;
+    int prefix = 0;
+    int suffix = 0;
+
+    while (prefix < old_lines.size() && prefix < new_lines.size() && old_lines[prefix] == new_lines[prefix])
+        ++prefix;
+
+    while (suffix < old_lines.size() - prefix && suffix < new_lines.size() - prefix
+        && old_lines[old_lines.size() - 1 - suffix] == new_lines[new_lines.size() - 1 - suffix])
+        ++suffix;
+
+    const int old_count = old_lines.size() - prefix - suffix;
+    const int new_count = new_lines.size() - prefix - suffix;
+
+    if (old_count == 0 && new_count == 0)
+        return result;
+
+    QHash<QString, int> line_ids;
+    QVector<int> a(old_count);
+    QVector<int> b(new_count);
+
+    for (int i = 0; i < old_count; ++i)
+        a[i] = getLineId(line_ids, old_lines[prefix + i]);
+
+    for (int i = 0; i < new_count; ++i)
+        b[i] = getLineId(line_ids, new_lines[prefix + i]);
+
+    const int maximum = old_count + new_count;
+    QVector<int> v(2 * maximum + 3, 0);
+    QVector< QVector<int> > trace;
+    int edit_count = -1;
+
+    for (int d = 0; d <= maximum && d <= maximumEditCount && edit_count == -1; ++d) {
+        trace << v.mid(maximum + 1 - (d + 1), 2 * d + 3);
+
+        for (int k = -d; k <= d; k += 2) {
+            int x = (k == -d || (k != d && v[maximum + 1 + k - 1] < v[maximum + 1 + k + 1])) ? v[maximum + 1 + k + 1] : v[maximum + 1 + k - 1] + 1;
+            int y = x - k;
+
+            while (x < old_count && y < new_count && a[x] == b[y]) {
+                ++x;
+                ++y;
+            }
+
+            v[maximum + 1 + k] = x;
+
+            if (x >= old_count && y >= new_count) {
+                edit_count = d;
+                break;
+            }
+        }
+    }
+
+    if (edit_count == -1) {
+        addHunk(result, prefix, old_count, new_lines.mid(prefix, new_count));
+        return result;
+    }
+
+    QVector< QPair<int, int> > matches;
+    int x = old_count;
+    int y = new_count;
+
+    for (int d = edit_count; d >= 0; --d) {
+        const QVector<int> &step = trace[d];
+        const int k = x - y;
+        const int previous_k = (k == -d || (k != d && step[k - 1 + d + 1] < step[k + 1 + d + 1])) ? k + 1 : k - 1;
+        const int previous_x = d == 0 ? 0 : step[previous_k + d + 1];
+        const int previous_y = d == 0 ? 0 : previous_x - previous_k;
+
+        while (x > previous_x && y > previous_y) {
+            --x;
+            --y;
+            matches.prepend(qMakePair(x, y));
+        }
+
+        x = previous_x;
+        y = previous_y;
+    }
+
+    matches << qMakePair(old_count, new_count);
+
+    int next_x = 0;
+    int next_y = 0;
+
+    for (int i = 0; i < matches.size(); ++i) {
+        if (matches[i].first > next_x || matches[i].second > next_y)
+            addHunk(result, prefix + next_x, matches[i].first - next_x, new_lines.mid(prefix + next_y, matches[i].second - next_y));
+
+        next_x = matches[i].first + 1;
+        next_y = matches[i].second + 1;
+    }
+
+    return result;
+}
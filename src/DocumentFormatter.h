@@ -0,0 +1,48 @@
+#ifndef DOCUMENTFORMATTER_H
+#define DOCUMENTFORMATTER_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QString>
+#include <QStringList>
+#include <QList>
+
+// Reformats a snapshot of a RML text on a QThreadPool thread, then diffs the result against the
+// snapshot line by line, so that only the changed lines have to be replaced in the editor. Like
+// DocumentValidator, the object lives in the thread that created it.
+
+class DocumentFormatter : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    // Replaces lineCount lines from firstLine, in the original text, by lines.
+    struct LineHunk
+    {
+        int firstLine;
+        int lineCount;
+        QStringList lines;
+    };
+
+    typedef QList<LineHunk> LineHunkList;
+
+    DocumentFormatter(const QString &text, const int indentation, const int revision);
+    virtual void run();
+    const LineHunkList &getHunks() const { return hunks; }
+    const QString &getErrorMessage() const { return errorMessage; }
+    int getRevision() const { return revision; }
+
+    static LineHunkList diffLines(const QStringList &old_lines, const QStringList &new_lines);
+
+signals:
+    void finished();
+
+private:
+    QString text;
+    int indentation;
+    int revision;
+    LineHunkList hunks;
+    QString errorMessage;
+};
+
+#endif
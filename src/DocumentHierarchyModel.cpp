@@ -0,0 +1,437 @@
+#include <QtGui>
+
+#include "DocumentHierarchyModel.h"
+#ifndef QT_NO_DEBUG
+#include "modeltest/modeltest.h"
+#endif
+
+// How far ahead the reload diff looks for a matching sibling before treating a row as replaced.
+static const int kSynchronizationLookAhead = 8;
+
+DocumentHierarchyModel::DocumentHierarchyModel(QObject *parent)
+: QAbstractItemModel(parent), rootNode(NULL), rootElement(NULL), highlightedNode(NULL)
+{
+#ifndef QT_NO_DEBUG
+    new ModelTest(this);
+#endif
+}
+
+DocumentHierarchyModel::~DocumentHierarchyModel()
+{
+    if (rootNode)
+        deleteNode(rootNode);
+}
+
+QVariant DocumentHierarchyModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    const Node *node = static_cast<Node*>(index.internalPointer());
+
+    if (role == Qt::DisplayRole) {
+        if (index.column() == 0)
+            return QVariant(node->tagName);
+
+        if (index.column() == 1)
+            return QVariant(node->identifier);
+
+        return QVariant(node->className);
+    }
+
+    if (role == Qt::ForegroundRole) {
+        if (index.column() == 0 && node == highlightedNode)
+            return QVariant(QColor::fromRgb(0,255,0));
+
+        if (index.column() == 1)
+            return QVariant(QColor::fromRgb(0,0,255));
+
+        if (index.column() == 2)
+            return QVariant(QColor::fromRgb(255,0,0));
+    }
+
+    return QVariant();
+}
+
+Qt::ItemFlags DocumentHierarchyModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return 0;
+
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+}
+
+QVariant DocumentHierarchyModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        if (section == 0)
+            return QVariant("Tag");
+
+        if (section == 1)
+            return QVariant("Id");
+
+        if (section == 2)
+            return QVariant("Class");
+    }
+
+    return QVariant();
+}
+
+QModelIndex DocumentHierarchyModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (!hasIndex(row, column, parent))
+        return QModelIndex();
+
+    if (!parent.isValid())
+        return createIndex(row, column, rootNode);
+
+    const Node *parent_node = static_cast<Node*>(parent.internalPointer());
+
+    return createIndex(row, column, parent_node->children[row]);
+}
+
+QModelIndex DocumentHierarchyModel::parent(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return QModelIndex();
+
+    const Node *node = static_cast<Node*>(index.internalPointer());
+
+    if (!node->parent)
+        return QModelIndex();
+
+    return indexForNode(node->parent);
+}
+
+int DocumentHierarchyModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+        return 0;
+
+    if (!parent.isValid())
+        return rootNode ? 1 : 0;
+
+    return static_cast<Node*>(parent.internalPointer())->children.size();
+}
+
+int DocumentHierarchyModel::columnCount(const QModelIndex &/*parent*/) const
+{
+    return 3;
+}
+
+bool DocumentHierarchyModel::hasChildren(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+        return false;
+
+    if (!parent.isValid())
+        return rootNode != NULL;
+
+    const Node *node = static_cast<Node*>(parent.internalPointer());
+
+    return node->itIsFetched ? !node->children.isEmpty() : node->childCount > 0;
+}
+
+bool DocumentHierarchyModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (!parent.isValid())
+        return false;
+
+    return !static_cast<Node*>(parent.internalPointer())->itIsFetched;
+}
+
+void DocumentHierarchyModel::fetchMore(const QModelIndex &parent)
+{
+    if (!parent.isValid())
+        return;
+
+    Node *node = static_cast<Node*>(parent.internalPointer());
+
+    if (node->itIsFetched)
+        return;
+
+    node->itIsFetched = true;
+    insertChildren(node, 0, getChildElements(node->element));
+}
+
+// Keeps the existing nodes when the same document is reloaded, so that selection and
+// expansion survive; only the rows that actually differ are inserted or removed.
+
+void DocumentHierarchyModel::setupData(Element *root_element)
+{
+    rootElement = root_element;
+    nodeMap.clear();
+
+    if (!root_element) {
+        if (rootNode) {
+            beginRemoveRows(QModelIndex(), 0, 0);
+            deleteNode(rootNode);
+            rootNode = NULL;
+            endRemoveRows();
+        }
+        return;
+    }
+
+    if (!rootNode) {
+        beginInsertRows(QModelIndex(), 0, 0);
+        rootNode = createNode(NULL, root_element, 0);
+        endInsertRows();
+        return;
+    }
+
+    updateNode(rootNode, root_element);
+}
+
+Element *DocumentHierarchyModel::getElement(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return NULL;
+
+    return static_cast<Node*>(index.internalPointer())->element;
+}
+
+QModelIndex DocumentHierarchyModel::getIndex(Element *element)
+{
+    QList<Element*> path;
+    Element *current = element;
+    Node *node;
+
+    if (!rootNode || !element)
+        return QModelIndex();
+
+    while (current && !nodeMap.contains(current)) {
+        path.prepend(current);
+        current = current->GetParentNode();
+    }
+
+    if (!current)
+        return QModelIndex();
+
+    node = nodeMap.value(current);
+
+    foreach (Element *path_element, path) {
+        if (!node->itIsFetched)
+            fetchMore(indexForNode(node));
+
+        node = nodeMap.value(path_element);
+
+        if (!node)
+            return QModelIndex();
+    }
+
+    return indexForNode(node);
+}
+
+void DocumentHierarchyModel::setHighlightedIndex(const QModelIndex &index)
+{
+    Node *previous_node = highlightedNode;
+
+    highlightedNode = index.isValid() ? static_cast<Node*>(index.internalPointer()) : NULL;
+
+    if (previous_node && previous_node != highlightedNode)
+        emit dataChanged(indexForNode(previous_node), indexForNode(previous_node));
+
+    if (highlightedNode)
+        emit dataChanged(indexForNode(highlightedNode), indexForNode(highlightedNode));
+}
+
+void DocumentHierarchyModel::restoreExpansion(QTreeView *tree)
+{
+    if (rootNode)
+        restoreExpansion(tree, rootNode);
+}
+
+// Public slots:
+
+void DocumentHierarchyModel::itemExpanded(const QModelIndex &index)
+{
+    if (index.isValid() && index.model() == this)
+        static_cast<Node*>(index.internalPointer())->itIsExpanded = true;
+}
+
+void DocumentHierarchyModel::itemCollapsed(const QModelIndex &index)
+{
+    if (index.isValid() && index.model() == this)
+        static_cast<Node*>(index.internalPointer())->itIsExpanded = false;
+}
+
+// Private:
+
+DocumentHierarchyModel::Node *DocumentHierarchyModel::createNode(Node *parent, Element *element, const int row)
+{
+    Node *node = new Node;
+
+    node->parent = parent;
+    node->element = element;
+    node->row = row;
+    node->tagName = element->GetTagName().CString();
+    node->identifier = element->GetId().CString();
+    node->className = element->GetClassNames().CString();
+    node->childCount = getChildElements(element).size();
+
+    nodeMap.insert(element, node);
+
+    return node;
+}
+
+void DocumentHierarchyModel::deleteNode(Node *node)
+{
+    foreach (Node *child, node->children) {
+        deleteNode(child);
+    }
+
+    if (nodeMap.value(node->element) == node)
+        nodeMap.remove(node->element);
+
+    if (highlightedNode == node)
+        highlightedNode = NULL;
+
+    delete node;
+}
+
+void DocumentHierarchyModel::updateNode(Node *node, Element *element)
+{
+    const QList<Element*> elements = getChildElements(element);
+    const QString tag_name = element->GetTagName().CString();
+    const QString identifier = element->GetId().CString();
+    const QString class_name = element->GetClassNames().CString();
+
+    node->element = element;
+    nodeMap.insert(element, node);
+
+    if (node->tagName != tag_name || node->identifier != identifier || node->className != class_name || node->childCount != elements.size()) {
+        node->tagName = tag_name;
+        node->identifier = identifier;
+        node->className = class_name;
+        node->childCount = elements.size();
+
+        emit dataChanged(indexForNode(node, 0), indexForNode(node, 2));
+    }
+
+    if (node->itIsFetched)
+        synchronizeChildren(node, elements);
+}
+
+void DocumentHierarchyModel::synchronizeChildren(Node *node, const QList<Element*> &elements)
+{
+    int row = 0;
+    int element_index = 0;
+
+    while (element_index < elements.size()) {
+        if (row >= node->children.size()) {
+            insertChildren(node, row, elements.mid(element_index));
+            return;
+        }
+
+        Node *child = node->children[row];
+        Element *element = elements[element_index];
+
+        if (!isSameElement(child, element)) {
+            int removed_count = -1;
+            int inserted_count = -1;
+
+            for (int i = 1; i <= kSynchronizationLookAhead && row + i < node->children.size(); ++i) {
+                if (isSameElement(node->children[row + i], element)) {
+                    removed_count = i;
+                    break;
+                }
+            }
+
+            for (int i = 1; i <= kSynchronizationLookAhead && element_index + i < elements.size(); ++i) {
+                if (isSameElement(child, elements[element_index + i])) {
+                    inserted_count = i;
+                    break;
+                }
+            }
+
+            if (removed_count != -1 && (inserted_count == -1 || removed_count <= inserted_count)) {
+                removeChildren(node, row, row + removed_count - 1);
+                continue;
+            }
+
+            if (inserted_count != -1) {
+                insertChildren(node, row, elements.mid(element_index, inserted_count));
+                row += inserted_count;
+                element_index += inserted_count;
+                continue;
+            }
+
+            // No match nearby: the row is reused for the new element.
+        }
+
+        updateNode(child, element);
+        ++row;
+        ++element_index;
+    }
+
+    if (row < node->children.size())
+        removeChildren(node, row, node->children.size() - 1);
+}
+
+void DocumentHierarchyModel::insertChildren(Node *node, const int row, const QList<Element*> &elements)
+{
+    if (elements.isEmpty())
+        return;
+
+    beginInsertRows(indexForNode(node), row, row + elements.size() - 1);
+
+    for (int i = 0; i < elements.size(); ++i) {
+        node->children.insert(row + i, createNode(node, elements[i], row + i));
+    }
+
+    for (int i = row + elements.size(); i < node->children.size(); ++i) {
+        node->children[i]->row = i;
+    }
+
+    endInsertRows();
+}
+
+void DocumentHierarchyModel::removeChildren(Node *node, const int first, const int last)
+{
+    beginRemoveRows(indexForNode(node), first, last);
+
+    for (int i = last; i >= first; --i) {
+        deleteNode(node->children.takeAt(i));
+    }
+
+    for (int i = first; i < node->children.size(); ++i) {
+        node->children[i]->row = i;
+    }
+
+    endRemoveRows();
+}
+
+void DocumentHierarchyModel::restoreExpansion(QTreeView *tree, Node *node)
+{
+    if (!node->itIsExpanded)
+        return;
+
+    tree->setExpanded(indexForNode(node), true);
+
+    foreach (Node *child, node->children) {
+        restoreExpansion(tree, child);
+    }
+}
+
+QModelIndex DocumentHierarchyModel::indexForNode(Node *node, const int column) const
+{
+    return createIndex(node->row, column, node);
+}
+
+QList<Element*> DocumentHierarchyModel::getChildElements(Element *element)
+{
+    QList<Element*> elements;
+
+    for (int i = 0; i < element->GetNumChildren(); i++)
+    {
+        if(element->GetChild(i)->GetTagName().CString()[0] != '#')
+            elements.append(element->GetChild(i));
+    }
+
+    return elements;
+}
+
+bool DocumentHierarchyModel::isSameElement(const Node *node, Element *element)
+{
+    return node->tagName == element->GetTagName().CString() && node->identifier == element->GetId().CString();
+}
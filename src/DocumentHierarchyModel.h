@@ -0,0 +1,72 @@
+#ifndef DOCUMENTHIERARCHYMODEL_H
+#define DOCUMENTHIERARCHYMODEL_H
+
+#include <QAbstractItemModel>
+#include <QModelIndex>
+#include <QVariant>
+#include <QHash>
+#include <QList>
+#include <QTreeView>
+#include "RocketHelper.h"
+
+class DocumentHierarchyModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    DocumentHierarchyModel(QObject *parent = 0);
+    virtual ~DocumentHierarchyModel();
+    QVariant data(const QModelIndex &index, int role) const;
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+    QModelIndex parent(const QModelIndex &index) const;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const;
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+    void setupData(Element *root_element);
+    Element *getRootElement() const { return rootElement; }
+    Element *getElement(const QModelIndex &index) const;
+    QModelIndex getIndex(Element *element);
+    void setHighlightedIndex(const QModelIndex &index);
+    void restoreExpansion(QTreeView *tree);
+
+public slots:
+    void itemExpanded(const QModelIndex &index);
+    void itemCollapsed(const QModelIndex &index);
+
+private:
+    struct Node
+    {
+        Node() : parent(NULL), element(NULL), row(0), childCount(0), itIsFetched(false), itIsExpanded(false) {};
+        Node *parent;
+        Element *element;
+        QString tagName;
+        QString identifier;
+        QString className;
+        QList<Node*> children;
+        int row;
+        int childCount;
+        bool itIsFetched;
+        bool itIsExpanded;
+    };
+    Node *createNode(Node *parent, Element *element, const int row);
+    void deleteNode(Node *node);
+    void updateNode(Node *node, Element *element);
+    void synchronizeChildren(Node *node, const QList<Element*> &elements);
+    void insertChildren(Node *node, const int row, const QList<Element*> &elements);
+    void removeChildren(Node *node, const int first, const int last);
+    void restoreExpansion(QTreeView *tree, Node *node);
+    QModelIndex indexForNode(Node *node, const int column = 0) const;
+    static QList<Element*> getChildElements(Element *element);
+    static bool isSameElement(const Node *node, Element *element);
+
+    Node *rootNode;
+    Element *rootElement;
+    Node *highlightedNode;
+    QHash<Element*, Node*> nodeMap;
+};
+
+#endif
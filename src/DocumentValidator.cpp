@@ -0,0 +1,343 @@
+#include "DocumentValidator.h"
+
+#include <QStringRef>
+#include <QVector>
+
+// Walks a text once, keeping track of the line and column of the current character.
+
+class TextScanner
+{
+public:
+    TextScanner(const QString &scanned_text, const int first_line, const int first_column)
+        : text(scanned_text), position(0), line(first_line), column(first_column)
+    {
+    }
+
+    bool atEnd() const { return position >= text.length(); }
+    QChar current() const { return atEnd() ? QChar() : text.at(position); }
+    QChar peek(const int offset) const { return position + offset < text.length() ? text.at(position + offset) : QChar(); }
+
+    bool startsWith(const char *str, const Qt::CaseSensitivity case_sensitivity = Qt::CaseSensitive) const
+    {
+        return text.midRef(position).startsWith(QLatin1String(str), case_sensitivity);
+    }
+
+    void advance(int count = 1)
+    {
+        while (count-- > 0 && !atEnd()) {
+            if (text.at(position) == '\n') {
+                ++line;
+                column = 0;
+            }
+            else
+                ++column;
+
+            ++position;
+        }
+    }
+
+    // Moves just after the terminator, or to the end of the text when it is missing.
+
+    bool skipPast(const char *terminator, const Qt::CaseSensitivity case_sensitivity = Qt::CaseSensitive)
+    {
+        const QLatin1String latin_terminator(terminator);
+        const int index = text.indexOf(latin_terminator, position, case_sensitivity);
+
+        if (index == -1) {
+            advance(text.length() - position);
+            return false;
+        }
+
+        advance(index + latin_terminator.size() - position);
+        return true;
+    }
+
+    const QString &text;
+    int position;
+    int line;
+    int column;
+};
+
+struct OpenedTag
+{
+    QString name;
+    int line;
+    int column;
+};
+
+static void addDiagnostic(DocumentValidator::DiagnosticList &diagnostics, const int line, const int column, const QString &message)
+{
+    DocumentValidator::Diagnostic diagnostic;
+
+    diagnostic.line = line;
+    diagnostic.column = column;
+    diagnostic.message = message;
+    diagnostics << diagnostic;
+}
+
+static bool isNameCharacter(const QChar &c)
+{
+    return c.isLetterOrDigit() || c == '_' || c == '-' || c == ':' || c == '.';
+}
+
+// Public:
+
+DocumentValidator::DocumentValidator(const QString &validated_text, const Mode validation_mode, const int text_revision)
+    : text(validated_text), mode(validation_mode), revision(text_revision)
+{
+    setAutoDelete(false);
+}
+
+void DocumentValidator::run()
+{
+    diagnostics = mode == StyleSheet ? validateStyleSheet(text) : validateMarkup(text);
+    emit finished();
+}
+
+// Well-formedness only: tags must be terminated and nested, quotes and comments closed, and '&'
+// must start an entity. Errors are recovered from so that every problem is listed at once.
+
+DocumentValidator::DiagnosticList DocumentValidator::validateMarkup(const QString &text)
+{
+    DiagnosticList diagnostics;
+    TextScanner scanner(text, 0, 0);
+    QVector<OpenedTag> opened_tags;
+
+    while (!scanner.atEnd()) {
+        const QChar c = scanner.current();
+
+        if (c == '&') {
+            int length = 1;
+
+            if (scanner.peek(length) == '#') {
+                ++length;
+
+                if (scanner.peek(length) == 'x' || scanner.peek(length) == 'X')
+                    ++length;
+            }
+
+            while (scanner.peek(length).isLetterOrDigit())
+                ++length;
+
+            if (length == 1 || scanner.peek(length) != ';')
+                addDiagnostic(diagnostics, scanner.line, scanner.column, "'&' does not start an entity, use &amp;");
+
+            scanner.advance();
+            continue;
+        }
+
+        if (c != '<') {
+            scanner.advance();
+            continue;
+        }
+
+        const int tag_line = scanner.line;
+        const int tag_column = scanner.column;
+
+        if (scanner.startsWith("<!--")) {
+            if (!scanner.skipPast("-->"))
+                addDiagnostic(diagnostics, tag_line, tag_column, "Comment is not closed");
+
+            continue;
+        }
+
+        if (scanner.startsWith("<![CDATA[")) {
+            if (!scanner.skipPast("]]>"))
+                addDiagnostic(diagnostics, tag_line, tag_column, "CDATA section is not closed");
+
+            continue;
+        }
+
+        if (scanner.startsWith("<?") || scanner.startsWith("<!")) {
+            if (!scanner.skipPast(">"))
+                addDiagnostic(diagnostics, tag_line, tag_column, "Declaration is not closed");
+
+            continue;
+        }
+
+        QString tag_name;
+        bool it_is_closing_tag = false;
+        bool it_is_self_closing = false;
+        bool it_is_terminated = false;
+
+        scanner.advance();
+
+        if (scanner.current() == '/') {
+            it_is_closing_tag = true;
+            scanner.advance();
+        }
+
+        while (isNameCharacter(scanner.current())) {
+            tag_name += scanner.current();
+            scanner.advance();
+        }
+
+        if (tag_name.isEmpty()) {
+            addDiagnostic(diagnostics, tag_line, tag_column, "'<' is not followed by a tag name, use &lt;");
+            continue;
+        }
+
+        while (!scanner.atEnd()) {
+            const QChar tag_character = scanner.current();
+
+            if (tag_character == '>') {
+                scanner.advance();
+                it_is_terminated = true;
+                break;
+            }
+
+            if (tag_character == '/' && scanner.peek(1) == '>') {
+                scanner.advance(2);
+                it_is_self_closing = true;
+                it_is_terminated = true;
+                break;
+            }
+
+            if (tag_character == '<') {
+                addDiagnostic(diagnostics, scanner.line, scanner.column, "'<' inside <" + tag_name + ">, is a '>' missing?");
+                break;
+            }
+
+            if (tag_character == '"' || tag_character == '\'') {
+                const int quote_line = scanner.line;
+                const int quote_column = scanner.column;
+                const char quote[2] = { tag_character.toLatin1(), 0 };
+
+                scanner.advance();
+
+                if (!scanner.skipPast(quote)) {
+                    addDiagnostic(diagnostics, quote_line, quote_column, "Attribute value is not closed");
+                    return diagnostics;
+                }
+
+                continue;
+            }
+
+            scanner.advance();
+        }
+
+        if (!it_is_terminated && scanner.atEnd()) {
+            addDiagnostic(diagnostics, tag_line, tag_column, "<" + tag_name + "> is not terminated");
+            break;
+        }
+
+        if (it_is_closing_tag) {
+            int index = opened_tags.size() - 1;
+
+            while (index >= 0 && opened_tags[index].name != tag_name)
+                --index;
+
+            if (index < 0) {
+                addDiagnostic(diagnostics, tag_line, tag_column, "</" + tag_name + "> has no matching opening tag");
+                continue;
+            }
+
+            while (opened_tags.size() - 1 > index) {
+                const OpenedTag &unclosed_tag = opened_tags.last();
+
+                addDiagnostic(diagnostics, unclosed_tag.line, unclosed_tag.column, "<" + unclosed_tag.name + "> is not closed before </" + tag_name + ">");
+                opened_tags.removeLast();
+            }
+
+            opened_tags.removeLast();
+            continue;
+        }
+
+        if (it_is_self_closing)
+            continue;
+
+        OpenedTag opened_tag;
+
+        opened_tag.name = tag_name;
+        opened_tag.line = tag_line;
+        opened_tag.column = tag_column;
+        opened_tags << opened_tag;
+
+        if (tag_name.compare("style", Qt::CaseInsensitive) == 0 || tag_name.compare("script", Qt::CaseInsensitive) == 0) {
+            const QString end_tag = "</" + tag_name;
+            const int content_end = text.indexOf(end_tag, scanner.position, Qt::CaseInsensitive);
+            const int content_length = (content_end == -1 ? text.length() : content_end) - scanner.position;
+
+            if (tag_name.compare("style", Qt::CaseInsensitive) == 0)
+                diagnostics << validateStyleSheet(text.mid(scanner.position, content_length), scanner.line, scanner.column);
+
+            scanner.advance(content_length);
+        }
+    }
+
+    foreach (const OpenedTag &opened_tag, opened_tags)
+        addDiagnostic(diagnostics, opened_tag.line, opened_tag.column, "<" + opened_tag.name + "> is not closed");
+
+    return diagnostics;
+}
+
+// Brace and quote balance; RCSS has no nested blocks, so a '{' inside a rule means a '}' is missing.
+
+DocumentValidator::DiagnosticList DocumentValidator::validateStyleSheet(const QString &text, const int first_line, const int first_column)
+{
+    DiagnosticList diagnostics;
+    TextScanner scanner(text, first_line, first_column);
+    QVector<OpenedTag> opened_braces;
+
+    while (!scanner.atEnd()) {
+        const QChar c = scanner.current();
+
+        if (c == '/' && scanner.peek(1) == '*') {
+            const int comment_line = scanner.line;
+            const int comment_column = scanner.column;
+
+            scanner.advance(2);
+
+            if (!scanner.skipPast("*/"))
+                addDiagnostic(diagnostics, comment_line, comment_column, "Comment is not closed");
+
+            continue;
+        }
+
+        if (c == '"' || c == '\'') {
+            const int quote_line = scanner.line;
+            const int quote_column = scanner.column;
+
+            scanner.advance();
+
+            while (!scanner.atEnd() && scanner.current() != c && scanner.current() != '\n') {
+                scanner.advance(scanner.current() == '\\' ? 2 : 1);
+            }
+
+            if (scanner.current() != c)
+                addDiagnostic(diagnostics, quote_line, quote_column, "String is not closed");
+
+            scanner.advance();
+            continue;
+        }
+
+        if (c == '{') {
+            OpenedTag opened_brace;
+
+            if (!opened_braces.isEmpty()) {
+                addDiagnostic(diagnostics, scanner.line, scanner.column, "'{' inside a rule, is a '}' missing?");
+                opened_braces.removeLast();
+            }
+
+            opened_brace.line = scanner.line;
+            opened_brace.column = scanner.column;
+            opened_braces << opened_brace;
+        }
+        else if (c == '}') {
+            if (opened_braces.isEmpty())
+                addDiagnostic(diagnostics, scanner.line, scanner.column, "'}' without a matching '{'");
+            else
+                opened_braces.removeLast();
+        }
+        else if (c == '<' && !opened_braces.isEmpty()) {
+            addDiagnostic(diagnostics, scanner.line, scanner.column, "Markup found inside a rule");
+        }
+
+        scanner.advance();
+    }
+
+    foreach (const OpenedTag &opened_brace, opened_braces)
+        addDiagnostic(diagnostics, opened_brace.line, opened_brace.column, "'{' is not closed");
+
+    return diagnostics;
+}
@@ -0,0 +1,46 @@
+#ifndef DOCUMENTVALIDATOR_H
+#define DOCUMENTVALIDATOR_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QString>
+#include <QList>
+
+// Checks a snapshot of a RML or RCSS text on a QThreadPool thread. The object itself lives in
+// the thread that created it, so finished() is delivered there and the reader can deleteLater() it.
+
+class DocumentValidator : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    enum Mode { Markup, StyleSheet };
+
+    struct Diagnostic
+    {
+        int line;
+        int column;
+        QString message;
+    };
+
+    typedef QList<Diagnostic> DiagnosticList;
+
+    DocumentValidator(const QString &text, const Mode mode, const int revision);
+    virtual void run();
+    const DiagnosticList &getDiagnostics() const { return diagnostics; }
+    int getRevision() const { return revision; }
+
+    static DiagnosticList validateMarkup(const QString &text);
+    static DiagnosticList validateStyleSheet(const QString &text, const int first_line = 0, const int first_column = 0);
+
+signals:
+    void finished();
+
+private:
+    QString text;
+    Mode mode;
+    int revision;
+    DiagnosticList diagnostics;
+};
+
+#endif
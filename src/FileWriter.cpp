@@ -0,0 +1,128 @@
+#include "FileWriter.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSaveFile>
+
+class WritingTask : public QRunnable
+{
+public:
+    WritingTask(FileWriter *file_writer, const QString &written_path, const QByteArray &written_data)
+        : writer(file_writer), path(written_path), data(written_data)
+    {
+    }
+
+    virtual void run()
+    {
+        writer->writeFile(path, data);
+    }
+
+private:
+    FileWriter *writer;
+    QString path;
+    QByteArray data;
+};
+
+static QString getKey(const QString &file_path)
+{
+    return QDir::cleanPath(QFileInfo(file_path).absoluteFilePath());
+}
+
+// Public:
+
+FileWriter::FileWriter()
+{
+    writingPool.setMaxThreadCount(1);
+}
+
+FileWriter::~FileWriter()
+{
+    writingPool.waitForDone();
+}
+
+// The data is a snapshot: the caller can go on editing while it is written.
+
+void FileWriter::write(const QString &file_path, const QByteArray &data)
+{
+    setWrittenHash(file_path, data);
+    writingPool.start(new WritingTask(this, file_path, data));
+}
+
+// Writes on the calling thread, after what is queued, for callers that cannot wait for
+// fileWritten(), such as a tab about to be closed. Only a successful write is signaled; the
+// caller reports the failures.
+
+bool FileWriter::writeNow(const QString &file_path, const QByteArray &data, QString &error_message)
+{
+    writingPool.waitForDone();
+    setWrittenHash(file_path, data);
+
+    if (!commitFile(file_path, data, error_message))
+        return false;
+
+    emit fileWritten(file_path, true, QString());
+    return true;
+}
+
+// For the readers of a file that may still be in the queue.
+
+void FileWriter::waitForDone()
+{
+    writingPool.waitForDone();
+}
+
+bool FileWriter::isOwnWrite(const QString &file_path)
+{
+    const QString key = getKey(file_path);
+    QFile file(file_path);
+    QByteArray written_hash;
+
+    mutex.lock();
+    written_hash = writtenHashes.value(key);
+    mutex.unlock();
+
+    if (written_hash.isEmpty() || !file.open(QIODevice::ReadOnly))
+        return false;
+
+    return QCryptographicHash::hash(file.readAll(), QCryptographicHash::Md5) == written_hash;
+}
+
+void FileWriter::writeFile(const QString &file_path, const QByteArray &data)
+{
+    QString error_message;
+    const bool success = commitFile(file_path, data, error_message);
+
+    emit fileWritten(file_path, success, error_message);
+}
+
+// Private:
+
+void FileWriter::setWrittenHash(const QString &file_path, const QByteArray &data)
+{
+    mutex.lock();
+    writtenHashes[getKey(file_path)] = QCryptographicHash::hash(data, QCryptographicHash::Md5);
+    mutex.unlock();
+}
+
+bool FileWriter::commitFile(const QString &file_path, const QByteArray &data, QString &error_message)
+{
+    QSaveFile file(file_path);
+
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        error_message = file.errorString();
+
+        file.cancelWriting();
+
+        mutex.lock();
+        writtenHashes.remove(getKey(file_path));
+        mutex.unlock();
+
+        return false;
+    }
+
+    return true;
+}
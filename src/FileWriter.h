@@ -0,0 +1,49 @@
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+
+// Writes files on a pool thread, one at a time and in the order they were requested. Each file
+// is written through a QSaveFile, so it is synced and then renamed over the old one: a failed
+// write leaves the previous content in place. The hash of what was written is kept, so that the
+// file watcher can tell our own writes from changes made outside.
+
+class FileWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    FileWriter();
+    virtual ~FileWriter();
+
+    static FileWriter & getInstance() {
+        static FileWriter instance;
+        return instance;
+    }
+
+    void write(const QString &file_path, const QByteArray &data);
+    bool writeNow(const QString &file_path, const QByteArray &data, QString &error_message);
+    void waitForDone();
+    bool isOwnWrite(const QString &file_path);
+
+    // Called from the pool thread.
+    void writeFile(const QString &file_path, const QByteArray &data);
+
+signals:
+    void fileWritten(const QString &file_path, bool success, const QString &error_message);
+
+private:
+    void setWrittenHash(const QString &file_path, const QByteArray &data);
+    bool commitFile(const QString &file_path, const QByteArray &data, QString &error_message);
+
+    QMutex mutex;
+    QHash<QString, QByteArray> writtenHashes;
+    QThreadPool writingPool;
+};
+
+#endif
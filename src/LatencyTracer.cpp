@@ -0,0 +1,146 @@
+#include "LatencyTracer.h"
+
+#include <algorithm>
+#include <QFile>
+#include <QTextStream>
+
+// A trace whose paint comes later than this is dropped: the editor was hidden or blocked, and
+// the time says nothing of the editing itself.
+static const qint64 maximumTraceDuration = 1000000000;
+
+static qint64 getPercentile(const QVector<qint64> &sorted_samples, const int percent)
+{
+    return sorted_samples[qMin(sorted_samples.size() - 1, sorted_samples.size() * percent / 100)];
+}
+
+// Public:
+
+LatencyTracer::LatencyTracer() : traceBucket(Under10KB), itIsTracing(false)
+{
+}
+
+// A trace still running when the next key arrives is dropped as well.
+
+void LatencyTracer::beginTrace(const int document_size)
+{
+    if (document_size < 10 * 1024)
+        traceBucket = Under10KB;
+    else if (document_size < 100 * 1024)
+        traceBucket = Under100KB;
+    else if (document_size < 1024 * 1024)
+        traceBucket = Under1MB;
+    else
+        traceBucket = Over1MB;
+
+    for (int phase = 0; phase < PhaseCount; ++phase)
+        phaseTimes[phase] = 0;
+
+    itIsTracing = true;
+    traceTimer.start();
+}
+
+void LatencyTracer::endTrace()
+{
+    if (!itIsTracing)
+        return;
+
+    itIsTracing = false;
+    phaseTimes[Total] = traceTimer.nsecsElapsed();
+
+    if (phaseTimes[Total] > maximumTraceDuration)
+        return;
+
+    for (int phase = 0; phase < PhaseCount; ++phase) {
+        SampleRing &ring = rings[traceBucket][phase];
+        const qint64 microseconds = phaseTimes[phase] / 1000;
+
+        if (ring.samples.size() < maximumSampleCount)
+            ring.samples.append(microseconds);
+        else
+            ring.samples[ring.next] = microseconds;
+
+        ring.next = (ring.next + 1) % maximumSampleCount;
+    }
+
+    emit traceEnded();
+}
+
+void LatencyTracer::addPhaseTime(const Phase phase, const qint64 nanoseconds)
+{
+    if (itIsTracing)
+        phaseTimes[phase] += nanoseconds;
+}
+
+LatencyTracer::Percentiles LatencyTracer::getPercentiles(const SizeBucket bucket, const Phase phase) const
+{
+    Percentiles percentiles;
+    QVector<qint64> sorted_samples = rings[bucket][phase].samples;
+
+    percentiles.count = sorted_samples.size();
+    percentiles.p50 = percentiles.p95 = percentiles.p99 = 0;
+
+    if (sorted_samples.isEmpty())
+        return percentiles;
+
+    std::sort(sorted_samples.begin(), sorted_samples.end());
+    percentiles.p50 = getPercentile(sorted_samples, 50);
+    percentiles.p95 = getPercentile(sorted_samples, 95);
+    percentiles.p99 = getPercentile(sorted_samples, 99);
+
+    return percentiles;
+}
+
+void LatencyTracer::reset()
+{
+    for (int bucket = 0; bucket < SizeBucketCount; ++bucket) {
+        for (int phase = 0; phase < PhaseCount; ++phase)
+            rings[bucket][phase] = SampleRing();
+    }
+
+    itIsTracing = false;
+    emit traceEnded();
+}
+
+// One line per size and phase holding samples; times are in microseconds.
+
+bool LatencyTracer::exportCsv(const QString &file_path) const
+{
+    QFile file(file_path);
+
+    if (!file.open(QFile::WriteOnly | QFile::Text | QFile::Truncate))
+        return false;
+
+    QTextStream stream(&file);
+
+    stream << "size,phase,count,p50_us,p95_us,p99_us\n";
+
+    for (int bucket = 0; bucket < SizeBucketCount; ++bucket) {
+        for (int phase = 0; phase < PhaseCount; ++phase) {
+            const Percentiles percentiles = getPercentiles((SizeBucket)bucket, (Phase)phase);
+
+            if (percentiles.count == 0)
+                continue;
+
+            stream << getSizeBucketName((SizeBucket)bucket) << "," << getPhaseName((Phase)phase) << "," << percentiles.count << ","
+                << percentiles.p50 << "," << percentiles.p95 << "," << percentiles.p99 << "\n";
+        }
+    }
+
+    stream.flush();
+
+    return file.error() == QFile::NoError;
+}
+
+QString LatencyTracer::getPhaseName(const Phase phase)
+{
+    static const char *names[PhaseCount] = { "key handling", "highlighting", "structure update", "tag matching", "text changed", "painting", "total" };
+
+    return names[phase];
+}
+
+QString LatencyTracer::getSizeBucketName(const SizeBucket bucket)
+{
+    static const char *names[SizeBucketCount] = { "< 10 KB", "< 100 KB", "< 1 MB", ">= 1 MB" };
+
+    return names[bucket];
+}
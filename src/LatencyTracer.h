@@ -0,0 +1,94 @@
+#ifndef LATENCYTRACER_H
+#define LATENCYTRACER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+
+// Measures how long a keystroke takes to show up in the editor. A trace starts when the editor
+// receives a key and ends with the paint of its viewport that the key's change requested; keys
+// that change nothing are not traced. The time spent in each phase it triggers is added up
+// meanwhile. Phases nest: key handling includes the highlighting and structure updates caused
+// by the edit. The last samples of each phase are kept per document size, so that percentiles
+// reflect the current behaviour. Only the GUI thread is traced.
+
+class LatencyTracer : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Phase { KeyHandling, Highlighting, StructureUpdate, TagMatching, TextChanged, Painting, Total, PhaseCount };
+    enum SizeBucket { Under10KB, Under100KB, Under1MB, Over1MB, SizeBucketCount };
+
+    struct Percentiles
+    {
+        int count;
+        qint64 p50;
+        qint64 p95;
+        qint64 p99;
+    };
+
+    // Adds the time spent in its scope to the current trace, if any.
+    class Scope
+    {
+    public:
+        explicit Scope(const Phase traced_phase) : phase(traced_phase), itIsTiming(LatencyTracer::getInstance().isTracing())
+        {
+            if (itIsTiming)
+                timer.start();
+        }
+
+        ~Scope()
+        {
+            if (itIsTiming)
+                LatencyTracer::getInstance().addPhaseTime(phase, timer.nsecsElapsed());
+        }
+
+    private:
+        Phase phase;
+        bool itIsTiming;
+        QElapsedTimer timer;
+    };
+
+    LatencyTracer();
+
+    static LatencyTracer & getInstance() {
+        static LatencyTracer instance;
+        return instance;
+    }
+
+    void beginTrace(const int document_size);
+    void endTrace();
+    void cancelTrace() {itIsTracing = false;}
+    bool isTracing() const {return itIsTracing;}
+    void addPhaseTime(const Phase phase, const qint64 nanoseconds);
+    Percentiles getPercentiles(const SizeBucket bucket, const Phase phase) const;
+    void reset();
+    bool exportCsv(const QString &file_path) const;
+
+    static QString getPhaseName(const Phase phase);
+    static QString getSizeBucketName(const SizeBucket bucket);
+
+signals:
+    void traceEnded();
+
+private:
+    static const int maximumSampleCount = 1000;
+
+    // Latest samples, in microseconds; once full, the oldest one is overwritten.
+    struct SampleRing
+    {
+        SampleRing() : next(0) {}
+        QVector<qint64> samples;
+        int next;
+    };
+
+    SampleRing rings[SizeBucketCount][PhaseCount];
+    qint64 phaseTimes[PhaseCount];
+    QElapsedTimer traceTimer;
+    SizeBucket traceBucket;
+    bool itIsTracing;
+};
+
+#endif
@@ -1,119 +1,202 @@
 #include "LuaHighlighter.h"
 #include "CodeEditor.h"
+#include "LatencyTracer.h"
 
-LuaHighlighter::LuaHighlighter(QTextDocument *document)
-: QSyntaxHighlighter(document)
+static const int levelShift = 3;
+static const int stateMask = (1 << levelShift) - 1;
+
+// Perfect hash of the Lua keywords: (length * 7 + first * 6 + last) % 38 gives a distinct slot
+// to each of them, so an identifier is a keyword after at most one comparison.
+
+static const int keywordTableSize = 38;
+static const char *keywordTable[keywordTableSize] = {
+    "return", NULL, NULL, "do", NULL, "end", "repeat", NULL, "break", "until",
+    NULL, NULL, NULL, "else", "while", NULL, NULL, NULL, "function", "and",
+    NULL, NULL, NULL, NULL, "if", "for", "false", "true", "elseif", "nil",
+    NULL, "local", "in", NULL, "or", "goto", "then", "not"
+};
+
+static bool isIdentifierStart(const QChar &c)
 {
-    QTextCharFormat keywordFormat;
-    QTextCharFormat xmlElementFormat;
-    QTextCharFormat xmlAttributeFormat;
-    QTextCharFormat singleLineCommentFormat;
-
-    keywordFormat.setForeground(Qt::darkBlue);
-    keywordFormat.setFontWeight(QFont::Bold);
-
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\band\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\bbreak\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\bdo\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\belse\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\belseif\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\bend\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\bfalse\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\bfor\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\bfunction\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\bif\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\bin\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\blocal\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\bnil\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\bnot\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\bor\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\brepeat\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\breturn\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\bthen\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\btrue\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\buntil\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\bwhile\\b"), keywordFormat));
-
-    valueFormat.setForeground(Qt::darkRed);
-    valueStartExpression = QRegExp("\"");
-    valueEndExpression = QRegExp("\"(?=[\\s,()\\n\\r])");
-
-    singleLineCommentFormat.setForeground(Qt::darkGreen);
-
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("--[^\n]*"), singleLineCommentFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("placeholder_rule_for_search_highlight"), keywordFormat));
+    return c.isLetter() || c == '_';
 }
 
-void LuaHighlighter::setHighlightedString(const QString &str)
+static bool isIdentifierCharacter(const QChar &c)
+{
+    return c.isLetterOrDigit() || c == '_';
+}
+
+LuaHighlighter::LuaHighlighter(QTextDocument *document)
+: SyntaxHighlighter(document), itHasUserFormat(false)
 {
-    QTextCharFormat keywordFormat;
+    formats[Keyword].setForeground(Qt::darkBlue);
+    formats[Keyword].setFontWeight(QFont::Bold);
 
-    keywordFormat.setBackground(Qt::green);
-    
-    highlightingRules.removeLast();
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp(str), keywordFormat));
-    rehighlight();
+    formats[Number].setForeground(Qt::darkMagenta);
+
+    formats[String].setForeground(Qt::darkRed);
+
+    formats[CommentText].setForeground(Qt::darkGreen);
 }
 
+// One pass over the block. Long comments and long strings carry over to the next blocks with
+// the level of their bracket; a quoted string only does when the line ends with a backslash.
+
 void LuaHighlighter::highlightBlock(const QString &text)
 {
-    int index;
-    int length;
-    int startIndex;
-    int endIndex;
-    int commentLength;
-    QTextCharFormat user_format;
-    QTextCharFormat new_format;
-
-    if(currentBlockUserData())
-    {
-        user_format = ((CodeEditor::BlockData *)currentBlockUserData())->format;
-    }
-    
-    for(int i=0; i<highlightingRules.length();++i)
-    {
-        const QRegExp & expression = highlightingRules[i].first;
-        const QTextCharFormat & format = highlightingRules[i].second;
-
-        setCurrentBlockState(0);
-        startIndex = 0;
-
-        if(previousBlockState() != 1)
-        {
-            startIndex = valueStartExpression.indexIn(text);
+    LatencyTracer::Scope scope(LatencyTracer::Highlighting);
+
+    if (skipDeferredBlock())
+        return;
+
+    const int length = text.length();
+    int state = previousBlockState() == -1 ? Code : previousBlockState() & stateMask;
+    int level = previousBlockState() == -1 ? 0 : previousBlockState() >> levelShift;
+    int i = 0;
+
+    itHasUserFormat = currentBlockUserData() != NULL;
+
+    if (itHasUserFormat)
+        userFormat = ((CodeEditor::BlockData *)currentBlockUserData())->format;
+
+    if (state > SingleQuoteString)
+        state = Code;
+
+    while (i < length) {
+        const int start = i;
+
+        if (state == LongComment || state == LongString) {
+            const QString closing_bracket = "]" + QString(level, '=') + "]";
+            const int bracket_end = text.indexOf(closing_bracket, i);
+
+            i = bracket_end == -1 ? length : bracket_end + closing_bracket.length();
+            highlight(start, i - start, state == LongComment ? CommentText : String);
+
+            if (bracket_end != -1)
+                state = Code;
+
+            continue;
         }
 
-        while(startIndex >= 0)
-        {
-            endIndex = valueEndExpression.indexIn(text, startIndex);
+        if (state == DoubleQuoteString || state == SingleQuoteString) {
+            const QChar quote = state == DoubleQuoteString ? '"' : '\'';
+
+            while (i < length && text.at(i) != quote)
+                i += text.at(i) == '\\' ? 2 : 1;
 
-            if(endIndex == -1)
-            {
-                setCurrentBlockState(1);
-                commentLength = text.length() - startIndex;
+            if (i < length) {
+                ++i;
+                state = Code;
             }
-            else
-            {
-                commentLength = endIndex - startIndex + valueEndExpression.matchedLength();
+            else if (!text.endsWith('\\')) {
+                state = Code;
             }
-            new_format = valueFormat;
-            if(currentBlockUserData())
-                new_format.merge(user_format);
-            setFormat(startIndex, commentLength, new_format);
 
-            startIndex = valueStartExpression.indexIn(text, startIndex + commentLength);
+            i = qMin(i, length);
+            highlight(start, i - start, String);
+            continue;
         }
 
-        index = expression.indexIn(text);
+        const QChar c = text.at(i);
 
-        while(index >= 0)
-        {
-            length = expression.matchedLength();
-            new_format = format;
-            if(currentBlockUserData())
-                new_format.merge(user_format);
-            setFormat(index, length, new_format);
-            index = expression.indexIn(text, index + length);
+        if (c == '-' && i + 1 < length && text.at(i + 1) == '-') {
+            const int comment_level = getLongBracketLevel(text, i + 2);
+
+            if (comment_level >= 0) {
+                state = LongComment;
+                level = comment_level;
+                i += 2 + comment_level + 2;
+                highlight(start, i - start, CommentText);
+            }
+            else {
+                highlight(start, length - start, CommentText);
+                i = length;
+            }
+        }
+        else if (c == '[' && getLongBracketLevel(text, i) >= 0) {
+            level = getLongBracketLevel(text, i);
+            state = LongString;
+            i += level + 2;
+            highlight(start, i - start, String);
+        }
+        else if (c == '"' || c == '\'') {
+            state = c == '"' ? DoubleQuoteString : SingleQuoteString;
+            highlight(start, 1, String);
+            ++i;
+        }
+        else if (c.isDigit() || (c == '.' && i + 1 < length && text.at(i + 1).isDigit())) {
+            const bool it_is_hexadecimal = c == '0' && i + 1 < length && (text.at(i + 1) == 'x' || text.at(i + 1) == 'X');
+            const QChar exponent = it_is_hexadecimal ? 'p' : 'e';
+
+            i += it_is_hexadecimal ? 2 : 1;
+
+            while (i < length) {
+                const QChar d = text.at(i);
+
+                if (d.toLower() == exponent && i + 1 < length && (text.at(i + 1) == '+' || text.at(i + 1) == '-'))
+                    i += 2;
+                else if (isIdentifierCharacter(d) || d == '.')
+                    ++i;
+                else
+                    break;
+            }
+
+            highlight(start, i - start, Number);
+        }
+        else if (isIdentifierStart(c)) {
+            while (i < length && isIdentifierCharacter(text.at(i)))
+                ++i;
+
+            if (isKeyword(text, start, i - start))
+                highlight(start, i - start, Keyword);
+        }
+        else {
+            ++i;
         }
     }
-}
\ No newline at end of file
+
+    setCurrentBlockState(state == LongComment || state == LongString ? state | (level << levelShift) : state);
+}
+
+// Private:
+
+void LuaHighlighter::highlight(int start, int length, Kind kind)
+{
+    QTextCharFormat format;
+
+    if (length <= 0 || kind == Plain)
+        return;
+
+    format = formats[kind];
+
+    if (itHasUserFormat)
+        format.merge(userFormat);
+
+    setFormat(start, length, format);
+}
+
+bool LuaHighlighter::isKeyword(const QString &text, const int start, const int length)
+{
+    if (length < 2 || length > 8)
+        return false;
+
+    const int slot = (length * 7 + text.at(start).unicode() * 6 + text.at(start + length - 1).unicode()) % keywordTableSize;
+    const char *keyword = keywordTable[slot];
+
+    return keyword && text.midRef(start, length) == QLatin1String(keyword);
+}
+
+// Level of the long bracket "[==[" opening at start, or -1 when there is none.
+
+int LuaHighlighter::getLongBracketLevel(const QString &text, const int start)
+{
+    int i = start + 1;
+
+    if (start >= text.length() || text.at(start) != '[')
+        return -1;
+
+    while (i < text.length() && text.at(i) == '=')
+        ++i;
+
+    return i < text.length() && text.at(i) == '[' ? i - start - 1 : -1;
+}
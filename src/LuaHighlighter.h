@@ -1,29 +1,48 @@
 #ifndef LUAHIGHLIGHTER_H
 #define LUAHIGHLIGHTER_H
 
-#include <QtGui/QSyntaxHighlighter>
-#include <QList>
-#include <QPair>
-#include <QRegExp>
+#include "SyntaxHighlighter.h"
+#include <QTextCharFormat>
 
-class LuaHighlighter : public QSyntaxHighlighter
+class LuaHighlighter : public SyntaxHighlighter
 {
     Q_OBJECT
 
 public:
     LuaHighlighter(QTextDocument *document);
-    void setHighlightedString(const QString &str);
 
 
 protected:
     void highlightBlock(const QString &text);
 
 private:
-    typedef QPair<QRegExp,QTextCharFormat> RulePair;
-    QList<RulePair> highlightingRules;
-    QTextCharFormat valueFormat;
-    QRegExp valueStartExpression;
-    QRegExp valueEndExpression;
+    // The block state holds one of these, and the level of the long bracket in the upper bits.
+    enum State
+    {
+        Code,
+        LongComment,
+        LongString,
+        DoubleQuoteString,
+        SingleQuoteString
+    };
+
+    enum Kind
+    {
+        Plain,
+        Keyword,
+        Number,
+        String,
+        CommentText,
+        KindCount
+    };
+
+    void highlight(int start, int length, Kind kind);
+    static bool isKeyword(const QString &text, const int start, const int length);
+    static int getLongBracketLevel(const QString &text, const int start);
+
+    QTextCharFormat formats[KindCount];
+    QTextCharFormat userFormat;
+    bool itHasUserFormat;
 };
 
 #endif
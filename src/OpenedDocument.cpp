@@ -3,15 +3,25 @@
 #include "RocketSystem.h"
 #include "CodeEditor.h"
 #include "RocketHelper.h"
+#include "Rockete.h"
+#include <QFile>
+#include <QSet>
+#include <QTextBlock>
+#include <QTextStream>
 
-OpenedDocument::OpenedDocument() : selectedElement(NULL)
+OpenedDocument::OpenedDocument() : selectedElement(NULL), hierarchyModel(NULL)
 {
 }
-OpenedDocument::OpenedDocument(QFileInfo file_info) : selectedElement(NULL)
+OpenedDocument::OpenedDocument(QFileInfo file_info) : selectedElement(NULL), hierarchyModel(NULL)
 {
     fileInfo = file_info;
 }
 
+OpenedDocument::~OpenedDocument()
+{
+    clearStyleSheets();
+}
+
 void OpenedDocument::initialize()
 {
     OpenedFile::initialize();
@@ -68,18 +78,128 @@ void OpenedDocument::regenerateBodyContent()
     replaceInnerRMLFromTagName("body", QString(rocket_string_content.CString()));
 }
 
-void OpenedDocument::highlightString(const QString &str)
+// Rewrites only the style attribute of the element's start tag, as a single undoable edit; an
+// empty style removes the attribute. The start tag found must carry the element's name, id and
+// classes. Returns false when the element cannot be mapped back to the text; callers then fall
+// back to regenerateBodyContent().
+
+bool OpenedDocument::updateElementStyleText(Element *element)
 {
-    if(str.isEmpty())
+    QString tag_text;
+    QString tag_name;
+    QString new_style;
+    int tag_position;
+    int index;
+    QString id_value;
+    QString class_value;
+    int style_start = -1;
+    int value_start = -1;
+    int value_end = -1;
+    QChar quote = '"';
+
+    tag_position = findStartTagPosition(element);
+
+    if(tag_position == -1 || !getStartTagText(tag_position, tag_text))
+        return false;
+
+    for(index = 1; index < tag_text.length() && !tag_text[index].isSpace() && tag_text[index] != '>' && tag_text[index] != '/'; index++)
+        tag_name += tag_text[index];
+
+    if(tag_name.compare(element->GetTagName().CString(), Qt::CaseInsensitive) != 0)
+        return false;
+
+    while(index < tag_text.length())
     {
-        ((XMLHighlighter *)highlighter)->setHighlightedString("placeholder_for_highlighted_string");
+        const int attribute_start = index;
+        QString attribute_name;
+
+        while(index < tag_text.length() && (tag_text[index].isSpace() || tag_text[index] == '/'))
+            index++;
+
+        while(index < tag_text.length() && !tag_text[index].isSpace() && tag_text[index] != '=' && tag_text[index] != '>' && tag_text[index] != '/')
+            attribute_name += tag_text[index++];
+
+        while(index < tag_text.length() && tag_text[index].isSpace())
+            index++;
+
+        if(index >= tag_text.length() || tag_text[index] == '>' || attribute_name.isEmpty())
+            break;
+
+        if(tag_text[index] != '=')
+            continue;
+
+        index++;
+
+        while(index < tag_text.length() && tag_text[index].isSpace())
+            index++;
+
+        if(index >= tag_text.length() || (tag_text[index] != '"' && tag_text[index] != '\''))
+            return false;
+
+        const QChar value_quote = tag_text[index];
+        const int start = ++index;
+
+        while(index < tag_text.length() && tag_text[index] != value_quote)
+            index++;
+
+        attribute_name = attribute_name.toLower();
+
+        if(attribute_name == "style")
+        {
+            style_start = attribute_start;
+            value_start = start;
+            value_end = index;
+            quote = value_quote;
+        }
+        else if(attribute_name == "id")
+        {
+            id_value = tag_text.mid(start, index - start);
+        }
+        else if(attribute_name == "class")
+        {
+            class_value = tag_text.mid(start, index - start);
+        }
+
+        index++;
     }
-    else if(highlightedString!=str)
+
+    if(!isStartTagOf(element, id_value, class_value))
+        return false;
+
+    new_style = element->GetAttribute<Rocket::Core::String>("style", "").CString();
+    new_style.remove(".0000", Qt::CaseInsensitive);
+
+    if(new_style.contains(quote))
+        new_style.replace(quote, quote == '"' ? '\'' : '"');
+
+    if(new_style.trimmed().isEmpty() && value_start == -1)
+        return true;
+
+    QTextCursor replacingCursor(document());
+
+    replacingCursor.beginEditBlock();
+
+    if(new_style.trimmed().isEmpty())
+    {
+        replacingCursor.setPosition(tag_position + style_start);
+        replacingCursor.setPosition(tag_position + qMin(value_end + 1, tag_text.length()), QTextCursor::KeepAnchor);
+        replacingCursor.removeSelectedText();
+    }
+    else if(value_start != -1)
     {
-        ((XMLHighlighter *)highlighter)->setHighlightedString(str);
+        replacingCursor.setPosition(tag_position + value_start);
+        replacingCursor.setPosition(tag_position + value_end, QTextCursor::KeepAnchor);
+        replacingCursor.insertText(new_style);
     }
+    else
+    {
+        replacingCursor.setPosition(tag_position + 1 + tag_name.length());
+        replacingCursor.insertText(" style=\"" + new_style + "\"");
+    }
+
+    replacingCursor.endEditBlock();
 
-    highlightedString = str;
+    return true;
 }
 
 void OpenedDocument::addDocumentTextAtCursor(const QString &new_content)
@@ -92,63 +212,275 @@ void OpenedDocument::addDocumentTextAtCursor(const QString &new_content)
 
 QStringList OpenedDocument::getRCSSFileList()
 {
-    QStringList return_list;
+    return dependencies.getStyleSheets();
+}
+
+// Called whenever rocketDocument is (re)loaded; the cached list then serves navigation
+// and reload decisions without walking the element properties. The linked style sheets are
+// parsed along, from their tab when they are opened.
+
+void OpenedDocument::updateDependencies()
+{
+    dependencies.scanDocument(toPlainText(), fileInfo.filePath());
+
+    clearStyleSheets();
+
+    foreach (const QString &path, dependencies.getStyleSheets()) {
+        LinkedStyleSheet linked_style_sheet;
+        QFile file(path);
+
+        linked_style_sheet.filePath = path;
+        linked_style_sheet.revision = -1;
+        linked_style_sheet.styleSheet = new StyleSheet;
+
+        if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            QTextStream in(&file);
+
+            in.setCodec("UTF-8");
+            linked_style_sheet.styleSheet->parse(in.readAll());
+        }
+
+        styleSheetList << linked_style_sheet;
+    }
+}
+
+// Files are told apart by name, as libRocket reports the source of a property as written in the
+// document. The style sheet is parsed again when its tab was edited since.
+
+const StyleSheet *OpenedDocument::getStyleSheet(const QString &file_name)
+{
+    const QString searched_name = QFileInfo(file_name).fileName();
+
+    for (int i = 0; i < styleSheetList.size(); ++i) {
+        LinkedStyleSheet &linked_style_sheet = styleSheetList[i];
+
+        if (QFileInfo(linked_style_sheet.filePath).fileName() != searched_name)
+            continue;
+
+        OpenedFile *opened_file = Rockete::getInstance().getOpenedFile(linked_style_sheet.filePath.toUtf8().data());
+
+        if (opened_file && !opened_file->isLoading() && opened_file->document()->revision() != linked_style_sheet.revision) {
+            linked_style_sheet.styleSheet->parse(opened_file->toPlainText());
+            linked_style_sheet.revision = opened_file->document()->revision();
+        }
 
-    return_list = getRCSSFileList(rocketDocument);
+        return linked_style_sheet.styleSheet;
+    }
 
-    return_list.removeDuplicates();
-    return return_list;
+    return NULL;
 }
 
-QStringList OpenedDocument::getRCSSFileList(Element *element)
+void OpenedDocument::clearStyleSheets()
 {
-    NamedPropertyMap property_map;
-    int property_index = 0;
-    Rocket::Core::String property_name;
-    Rocket::Core::PseudoClassList property_pseudo_classes;
-    const Rocket::Core::Property* property;
+    foreach (const LinkedStyleSheet &linked_style_sheet, styleSheetList)
+        delete linked_style_sheet.styleSheet;
+
+    styleSheetList.clear();
+}
 
-    QStringList return_list;
+// libRocket moves the content of these elements out of the DOM, such as the options of a select
+// or the tabs and panels of a tabset, so the elements that follow are no longer in text order.
 
-    while (element->IterateProperties(property_index, property_pseudo_classes, property_name, property))
+static bool isRestructuringElement(Element *element)
+{
+    static const char * const tag_names[] = { "select", "dataselect", "tabset", "datagrid" };
+
+    for (unsigned int i = 0; i < sizeof(tag_names) / sizeof(tag_names[0]); i++)
     {
-        if(QString(property->source.CString()).contains(".rcss"))
-            return_list.append(property->source.CString());
+        if(element->GetTagName() == tag_names[i])
+            return true;
     }
 
-    for (int i = 0; i < element->GetNumChildren(); i++)
+    return false;
+}
+
+enum ElementIndexResult { ElementNotFound, ElementFound, ElementUnmappable };
+
+static ElementIndexResult findElementIndex(Element *parent, Element *element, int &element_index)
+{
+    for (int i = 0; i < parent->GetNumChildren(); i++)
     {
-        return_list.append(getRCSSFileList(element->GetChild(i)));
+        Element *child = parent->GetChild(i);
+
+        if(child->GetTagName().CString()[0] == '#')
+            continue;
+
+        if(child == element)
+            return ElementFound;
+
+        if(isRestructuringElement(child))
+            return ElementUnmappable;
+
+        element_index++;
+
+        const ElementIndexResult result = findElementIndex(child, element, element_index);
+
+        if(result != ElementNotFound)
+            return result;
     }
 
-    return_list.removeDuplicates();
-    return return_list;
+    return ElementNotFound;
 }
 
-void OpenedDocument::populateHierarchyTreeView(QTreeWidget *tree)
+static QSet<QString> getClassNameSet(const QString &class_names)
 {
-    tree->clear();
-    tree->addTopLevelItem(getChildrenTree(NULL, rocketDocument));
+    return QSet<QString>::fromList(class_names.split(QRegExp("\\s+"), QString::SkipEmptyParts));
 }
 
-QTreeWidgetItem *OpenedDocument::getChildrenTree(QTreeWidgetItem *parent, Element *element)
+// The start tag found by rank is only trusted when it names the element's id and classes.
+
+bool OpenedDocument::isStartTagOf(Element *element, const QString &id_value, const QString &class_value)
 {
-    QStringList list;
-    list << element->GetTagName().CString();
-    list << element->GetId().CString();
-    list << element->GetClassNames().CString();
-    QTreeWidgetItem *item = new QTreeWidgetItem(parent, list);
-    item->setTextColor(1, QColor::fromRgb(0,0,255));
-    item->setTextColor(2, QColor::fromRgb(255,0,0));
-    item->setData(0, Qt::UserRole, qVariantFromValue<void*>(element));
-    QList<QTreeWidgetItem *> items;
+    return id_value == element->GetId().CString()
+        && getClassNameSet(class_value) == getClassNameSet(element->GetClassNames().CString());
+}
+
+// Elements below the body (or below the template "content" element) appear in the
+// text in the same order as their start tags, so the element's rank among the
+// preceding elements gives the start tag to look for. Elements of the template around
+// the content are not in the text, and no rank is trusted past an element that moves
+// its children.
+
+int OpenedDocument::findStartTagPosition(Element *element)
+{
+    enum { InText, InTag, InQuote, InComment };
+    Element *content_element;
+    QTextCursor body_cursor;
+    QTextBlock block;
+    QChar quote;
+    int element_index = 0;
+    int tag_count = -1;
+    int offset;
+    int state = InTag; // still inside the body start tag
+
+    content_element = rocketDocument->GetElementById("content");
+
+    if(findElementIndex(content_element ? content_element : rocketDocument, element, element_index) != ElementFound)
+        return -1;
+
+    body_cursor = document()->find("<body");
+
+    if(body_cursor.isNull())
+        return -1;
+
+    block = body_cursor.block();
+    offset = body_cursor.selectionEnd() - block.position();
 
-    for (int i = 0; i < element->GetNumChildren(); i++)
+    while(block.isValid())
     {
-        if(element->GetChild(i)->GetTagName().CString()[0] != '#')
-            items.append(getChildrenTree(item, element->GetChild(i)));
+        const QString text = block.text();
+
+        for(int i = offset; i < text.length(); i++)
+        {
+            const QChar c = text[i];
+
+            switch(state)
+            {
+            case InText:
+                if(c == '<')
+                {
+                    if(text.midRef(i, 4) == QLatin1String("<!--"))
+                    {
+                        state = InComment;
+                        i += 3;
+                    }
+                    else
+                    {
+                        if(i + 1 < text.length() && text[i + 1].isLetter() && ++tag_count == element_index)
+                            return block.position() + i;
+
+                        state = InTag;
+                    }
+                }
+                break;
+            case InTag:
+                if(c == '"' || c == '\'')
+                {
+                    quote = c;
+                    state = InQuote;
+                }
+                else if(c == '>')
+                {
+                    state = InText;
+                }
+                break;
+            case InQuote:
+                if(c == quote)
+                    state = InTag;
+                break;
+            case InComment:
+                if(c == '>' && i >= 2 && text[i - 1] == '-' && text[i - 2] == '-')
+                    state = InText;
+                break;
+            }
+        }
+
+        block = block.next();
+        offset = 0;
+    }
+
+    return -1;
+}
+
+bool OpenedDocument::getStartTagText(const int tag_position, QString &tag_text)
+{
+    QTextBlock block = document()->findBlock(tag_position);
+    int offset = tag_position - block.position();
+    QChar quote;
+
+    tag_text.clear();
+
+    while(block.isValid())
+    {
+        const QString text = block.text();
+
+        for(int i = offset; i < text.length(); i++)
+        {
+            const QChar c = text[i];
+
+            tag_text += c;
+
+            if(!quote.isNull())
+            {
+                if(c == quote)
+                    quote = QChar();
+            }
+            else if(c == '"' || c == '\'')
+            {
+                quote = c;
+            }
+            else if(c == '>')
+            {
+                return true;
+            }
+        }
+
+        tag_text += '\n';
+        block = block.next();
+        offset = 0;
     }
 
-    item->addChildren(items);
-    return item;
+    return false;
+}
+
+void OpenedDocument::populateHierarchyTreeView(QTreeView *tree, const bool it_must_update)
+{
+    if (!hierarchyModel || it_must_update || hierarchyModel->getRootElement() != rocketDocument)
+        updateHierarchyModel();
+
+    if (tree->model() != hierarchyModel)
+    {
+        tree->setModel(hierarchyModel);
+        connect(tree, SIGNAL(expanded(const QModelIndex &)), hierarchyModel, SLOT(itemExpanded(const QModelIndex &)), Qt::UniqueConnection);
+        connect(tree, SIGNAL(collapsed(const QModelIndex &)), hierarchyModel, SLOT(itemCollapsed(const QModelIndex &)), Qt::UniqueConnection);
+        hierarchyModel->restoreExpansion(tree);
+    }
+}
+
+void OpenedDocument::updateHierarchyModel()
+{
+    if (!hierarchyModel)
+        hierarchyModel = new DocumentHierarchyModel(this);
+
+    hierarchyModel->setupData(rocketDocument);
 }
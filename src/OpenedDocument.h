@@ -5,9 +5,10 @@
 #include "OpenedFile.h"
 #include "StyleSheet.h"
 #include "XMLHighlighter.h"
+#include "DocumentHierarchyModel.h"
+#include "DocumentDependencies.h"
 #include <QList>
-#include <QTreeWidget>
-#include <QTreeWidgetItem>
+#include <QTreeView>
 
 class OpenedDocument : public OpenedFile
 {
@@ -15,28 +16,47 @@ class OpenedDocument : public OpenedFile
 public:
     OpenedDocument();
     OpenedDocument(QFileInfo file_info);
+    virtual ~OpenedDocument();
 
     virtual void initialize();
     void replaceInnerRMLFromTagName(const QString &tag_name, const QString &new_content);
     void regenerateBodyContent();
-    virtual void highlightString(const QString &str);
+    bool updateElementStyleText(Element *element);
     void addDocumentTextAtCursor(const QString &new_content);
     void addStyleSheetTextAtEnd(const QString &new_content, const QString &file_name);
     QStringList getRCSSFileList();
-    void populateHierarchyTreeView(QTreeWidget *tree);
+    void updateDependencies();
+    const DocumentDependencies &getDependencies() const { return dependencies; }
+    const StyleSheet *getStyleSheet(const QString &file_name);
+    void populateHierarchyTreeView(QTreeView *tree, const bool it_must_update = false);
+    void updateHierarchyModel();
+    DocumentHierarchyModel *getHierarchyModel() { return hierarchyModel; }
 
     RMLDocument *rocketDocument;
     Element *selectedElement;
-    QList<StyleSheet*> styleSheetList;
-    QString highlightedString;
+
+protected:
+    // The libRocket document is built from the text as soon as the file is opened.
+    virtual bool canLoadProgressively() const {return false;}
+    virtual Language getLanguage() const {return MarkupLanguage;}
 
 private:
-    QStringList getRCSSFileList(Element *element);
-    QTreeWidgetItem *getChildrenTree(QTreeWidgetItem *parent, Element *element);
+    // Revision of the tab the style sheet was parsed from, -1 when it was read from disk.
+    struct LinkedStyleSheet
+    {
+        QString filePath;
+        int revision;
+        StyleSheet *styleSheet;
+    };
+
+    void clearStyleSheets();
+    int findStartTagPosition(Element *element);
+    static bool isStartTagOf(Element *element, const QString &id_value, const QString &class_value);
+    bool getStartTagText(const int tag_position, QString &tag_text);
 
-    typedef std::pair< Rocket::Core::String, const Rocket::Core::Property* > NamedProperty;
-    typedef std::vector< NamedProperty > NamedPropertyList;
-    typedef std::map< Rocket::Core::PseudoClassList, NamedPropertyList > NamedPropertyMap;
+    DocumentHierarchyModel *hierarchyModel;
+    DocumentDependencies dependencies;
+    QList<LinkedStyleSheet> styleSheetList;
 };
 
 #endif
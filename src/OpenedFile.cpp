@@ -1,17 +1,73 @@
 #include "OpenedFile.h"
 
 #include <QFile>
+#include <QMessageBox>
+#include <QRegExp>
+#include <QScrollBar>
 #include <QString>
 #include <QStringList>
-#include <QMessageBox>
+#include <QTextBlock>
 #include <QTextStream>
+#include <QThreadPool>
 #include "Rockete.h"
 #include "Settings.h"
+#include "ProjectSearchIndex.h"
+#include "CompletionService.h"
+#include "FileWriter.h"
+
+static int countIndentation(const QString &text)
+{
+    int count = 0;
+
+    while (count < text.length() && text[count] == ' ')
+        count++;
+
+    return count;
+}
+
+// Finds "property_name:" at or after from, not as the end of a longer name; the value ends at
+// the next ';' or '}', trailing spaces excluded.
+
+static bool findDeclarationSpan(const QString &text, const QString &property_name, const int from, int &name_start, int &value_start, int &value_end)
+{
+    QRegExp expression("(^|[^\\w-])(" + QRegExp::escape(property_name) + ")\\s*:\\s*");
+    const int index = expression.indexIn(text, from, QRegExp::CaretAtOffset);
+
+    if (index == -1)
+        return false;
+
+    name_start = expression.pos(2);
+    value_start = index + expression.matchedLength();
+    value_end = value_start;
+
+    while (value_end < text.length() && text[value_end] != ';' && text[value_end] != '}')
+        value_end++;
+
+    while (value_end > value_start && text[value_end - 1] == ' ')
+        value_end--;
+
+    return true;
+}
 
 OpenedFile::OpenedFile()
-    : highlighter(NULL)
+    : highlighter(NULL), validatedRevision(-1), itIsValidating(false), itNeedsValidation(false), itIsFormatting(false), itIsLargeFile(false),
+    highlightedFirstBlock(0), highlightedLastBlock(-1)
 {
     previousStartingIndex = -1;
+
+    validationTimer.setSingleShot(true);
+    validationTimer.setInterval(1000);
+    connect(&validationTimer, SIGNAL(timeout()), this, SLOT(validate()));
+    connect(document(), SIGNAL(contentsChanged()), &validationTimer, SLOT(start()));
+
+    visibleHighlightingTimer.setSingleShot(true);
+    visibleHighlightingTimer.setInterval(50);
+    connect(&visibleHighlightingTimer, SIGNAL(timeout()), this, SLOT(updateVisibleHighlighting()));
+
+    scheduledSaveTimer.setSingleShot(true);
+    scheduledSaveTimer.setInterval(1500);
+    connect(&scheduledSaveTimer, SIGNAL(timeout()), this, SLOT(saveScheduled()));
+    connect(&FileWriter::getInstance(), SIGNAL(fileWritten(const QString &, bool, const QString &)), this, SLOT(fileWritten(const QString &, bool, const QString &)));
 }
 
 OpenedFile::~OpenedFile()
@@ -33,6 +89,12 @@ void OpenedFile::fillTextEdit()
     QFile file(fileInfo.filePath());
     QString content;
 
+    if(fileInfo.size() > largeFileThreshold)
+    {
+        startLargeFileLoading();
+        return;
+    }
+
     file.open(QIODevice::ReadOnly);
 
     if(fileInfo.filePath().endsWith(".rml"))
@@ -48,38 +110,32 @@ void OpenedFile::fillTextEdit()
 
     content.replace("\t", "    ");
     setTextEditContent(content);
+    validatedRevision = -1;
 
     file.close();
 }
 
-QString OpenedFile::getLine(const int line_number)
+void OpenedFile::finishLoading()
 {
-    QStringList lines;
+    while(loadingFile.isOpen())
+        appendNextChunk();
+}
 
-    lines = toPlainText().split("\n");
+QString OpenedFile::getLine(const int line_number)
+{
+    const QTextBlock block = document()->findBlockByNumber(line_number);
 
-    Q_ASSERT(line_number < lines.size());
+    Q_ASSERT(block.isValid());
 
-    return lines[line_number];
+    return block.text();
 }
 
 int OpenedFile::findLineNumber(const QString &str, const int start_line_number)
 {
-    QTextCursor parsingCursor = textCursor();
-    
-    parsingCursor.setPosition(0);
-    
-    while(parsingCursor.blockNumber() != start_line_number)
+    for(QTextBlock block = document()->findBlockByNumber(qMax(start_line_number, 0)); block.isValid(); block = block.next())
     {
-        parsingCursor.movePosition(QTextCursor::Down);
-    }
-
-    while(!parsingCursor.atEnd())
-    {
-        if(parsingCursor.block().text().contains(str))
-            return parsingCursor.blockNumber();
-
-        parsingCursor.movePosition(QTextCursor::Down);
+        if(block.text().contains(str))
+            return block.blockNumber();
     }
 
     return -1;
@@ -87,159 +143,380 @@ int OpenedFile::findLineNumber(const QString &str, const int start_line_number)
 
 void OpenedFile::replaceLine(const int line_number, const QString &new_line)
 {
-    QString old_text;
+    const QTextBlock block = document()->findBlockByNumber(line_number);
     QString new_text = new_line;
-    QTextCursor parsingCursor = textCursor();
-    int space_count = 0;
 
-    parsingCursor.setPosition(0);
+    if(!block.isValid())
+        return;
+
+    QTextCursor parsingCursor(block);
+
+    new_text.prepend(QString(countIndentation(block.text()), ' '));
+    new_text.remove(".0000");
+
+    parsingCursor.movePosition(QTextCursor::EndOfBlock, QTextCursor::KeepAnchor);
+    parsingCursor.insertText(new_text);
+
+    setTextCursor(parsingCursor);
+}
 
-    while(parsingCursor.blockNumber() != line_number)
+int OpenedFile::insertLineBeforeBracket(const int start_line, const QString &new_line)
+{
+    QTextBlock block = document()->findBlockByNumber(start_line);
+    QString new_text = new_line;
+
+    while(block.isValid() && !block.text().contains('}'))
+        block = block.next();
+
+    if(!block.isValid())
+        return -1;
+
+    QTextCursor parsingCursor(block);
+
+    new_text.remove(".0000", Qt::CaseInsensitive);
+    parsingCursor.insertText(new_text + "\n");
+    parsingCursor.movePosition(QTextCursor::PreviousBlock);
+    setTextCursor(parsingCursor);
+
+    return parsingCursor.blockNumber();
+}
+
+void OpenedFile::removeLine(const int line_number)
+{
+    const QTextBlock block = document()->findBlockByNumber(line_number);
+
+    if(!block.isValid())
+        return;
+
+    QTextCursor parsingCursor(block);
+
+    if(block.next().isValid())
     {
-        parsingCursor.movePosition(QTextCursor::Down);
+        parsingCursor.setPosition(block.next().position(), QTextCursor::KeepAnchor);
+    }
+    else if(block.previous().isValid())
+    {
+        parsingCursor.setPosition(block.previous().position() + block.previous().length() - 1);
+        parsingCursor.setPosition(block.position() + block.length() - 1, QTextCursor::KeepAnchor);
+    }
+    else
+    {
+        parsingCursor.movePosition(QTextCursor::EndOfBlock, QTextCursor::KeepAnchor);
     }
 
-    parsingCursor.movePosition(QTextCursor::StartOfLine);
-    parsingCursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
+    parsingCursor.removeSelectedText();
+}
 
-    old_text = parsingCursor.selectedText();
+// RCSS editing: rules are located from a line number, then only the blocks of that rule are read.
 
-    while(old_text.startsWith(" "))
+int OpenedFile::findRule(const QString &selector, const int start_line_number)
+{
+    const QString searched_selector = selector.simplified();
+    QString selector_text;
+
+    for(QTextBlock block = document()->findBlockByNumber(qMax(start_line_number, 0)); block.isValid(); block = block.next())
     {
-        old_text.remove(0,1);
-        space_count++;
+        const QString text = block.text();
+        int segment_start = 0;
+
+        for(int i = 0; i < text.length(); ++i)
+        {
+            if(text[i] == '}' || text[i] == ';')
+            {
+                selector_text.clear();
+                segment_start = i + 1;
+            }
+            else if(text[i] == '{')
+            {
+                selector_text += " " + text.mid(segment_start, i - segment_start);
+
+                foreach(const QString &rule_selector, selector_text.split(','))
+                {
+                    if(rule_selector.simplified() == searched_selector)
+                        return block.blockNumber();
+                }
+
+                selector_text.clear();
+                segment_start = i + 1;
+            }
+        }
+
+        selector_text += " " + text.mid(segment_start);
     }
 
-    while(space_count>0)
+    return -1;
+}
+
+int OpenedFile::findDeclaration(const int rule_line_number, const QString &property_name)
+{
+    int body_start;
+    int name_start;
+    int value_start;
+    int value_end;
+
+    for(QTextBlock block = findRuleBody(rule_line_number, body_start); block.isValid(); block = block.next(), body_start = 0)
     {
-        new_text.prepend(" ");
-        space_count--;
+        const QString text = block.text();
+        const int body_end = text.indexOf('}', body_start);
+
+        if(findDeclarationSpan(text, property_name, body_start, name_start, value_start, value_end) && (body_end == -1 || name_start < body_end))
+            return block.blockNumber();
+
+        if(body_end != -1)
+            break;
     }
+
+    return -1;
+}
+
+bool OpenedFile::getDeclarationValueSpan(const int line_number, const QString &property_name, int &value_start, int &value_length)
+{
+    const QTextBlock block = document()->findBlockByNumber(line_number);
+    int name_start;
+    int value_end;
+
+    if(!block.isValid() || !findDeclarationSpan(block.text(), property_name, 0, name_start, value_start, value_end))
+        return false;
+
+    value_length = value_end - value_start;
+
+    return true;
+}
+
+bool OpenedFile::replaceDeclarationValue(const int line_number, const QString &property_name, const QString &new_value)
+{
+    const QTextBlock block = document()->findBlockByNumber(line_number);
+    QString new_text = new_value;
+    int value_start;
+    int value_length;
+
+    if(!getDeclarationValueSpan(line_number, property_name, value_start, value_length))
+        return false;
+
+    QTextCursor editingCursor(block);
+
     new_text.remove(".0000");
-    parsingCursor.insertText(new_text);
-    parsingCursor.clearSelection();
+    editingCursor.setPosition(block.position() + value_start);
+    editingCursor.setPosition(block.position() + value_start + value_length, QTextCursor::KeepAnchor);
+    editingCursor.insertText(new_text);
+    setTextCursor(editingCursor);
 
-    setTextCursor(parsingCursor);
+    return true;
 }
 
-int OpenedFile::insertLineBeforeBracket(const int start_line, const QString &new_line)
+// The declaration goes on its own line before a '}' standing alone, indented like the line above
+// it; in a rule written on one line, it is added before the '}' on that line.
+
+int OpenedFile::insertDeclaration(const int rule_line_number, const QString &property_name, const QString &value)
 {
-    QTextCursor parsingCursor = textCursor();
-    QString new_text = new_line;
+    int body_start;
+    QString declaration = property_name + ": " + value + ";";
+    QTextBlock block = findRuleBody(rule_line_number, body_start);
+    int body_end = -1;
+    int closing_block_number;
 
-    parsingCursor.setPosition(0);
+    declaration.remove(".0000");
 
-    while(parsingCursor.blockNumber() != start_line)
+    for(; block.isValid(); block = block.next(), body_start = 0)
     {
-        parsingCursor.movePosition(QTextCursor::Down);
-    }
+        body_end = block.text().indexOf('}', body_start);
 
-    while(!parsingCursor.atEnd())
-    {
-        if(parsingCursor.block().text().contains('}'))
+        if(body_end != -1)
             break;
+    }
+
+    if(!block.isValid())
+        return -1;
 
-        parsingCursor.movePosition(QTextCursor::Down);
+    const QString text = block.text();
+    QTextCursor editingCursor(block);
+
+    closing_block_number = block.blockNumber();
+
+    if(!text.left(body_end).trimmed().isEmpty())
+    {
+        editingCursor.setPosition(block.position() + body_end);
+        editingCursor.insertText(text[body_end - 1] == ' ' ? declaration + " " : " " + declaration + " ");
     }
+    else
+    {
+        const QTextBlock previous_block = block.previous();
+        const int indentation = previous_block.isValid() && !previous_block.text().contains('{') ? countIndentation(previous_block.text()) : countIndentation(text) + 4;
 
-    parsingCursor.movePosition(QTextCursor::StartOfLine);
+        editingCursor.insertText(QString(indentation, ' ') + declaration + "\n");
+        editingCursor.movePosition(QTextCursor::PreviousBlock);
+    }
 
-    new_text.remove(".0000", Qt::CaseInsensitive);
-    parsingCursor.insertText(new_text);
-    parsingCursor.insertText("\n");
-    parsingCursor.movePosition(QTextCursor::Up);
-    setTextCursor(parsingCursor);
-    return parsingCursor.blockNumber();
+    setTextCursor(editingCursor);
 
+    return closing_block_number;
 }
 
-void OpenedFile::removeLine(const int line_number)
+bool OpenedFile::removeDeclaration(const int line_number, const QString &property_name)
 {
-    printf("WARNING: OpenedFile::removeLine(const int line_number) never tested!!!!\n");
+    const QTextBlock block = document()->findBlockByNumber(line_number);
+    int name_start;
+    int value_start;
+    int value_end;
+
+    if(!block.isValid() || !findDeclarationSpan(block.text(), property_name, 0, name_start, value_start, value_end))
+        return false;
 
-    QTextCursor parsingCursor = textCursor();
+    const QString text = block.text();
+    int declaration_end = value_end;
 
-    parsingCursor.setPosition(0);
+    if(declaration_end < text.length() && text[declaration_end] == ';')
+        ++declaration_end;
 
-    while(parsingCursor.blockNumber() != line_number)
+    while(declaration_end < text.length() && text[declaration_end] == ' ')
+        ++declaration_end;
+
+    if((text.left(name_start) + text.mid(declaration_end)).trimmed().isEmpty())
     {
-        parsingCursor.movePosition(QTextCursor::Down);
+        removeLine(line_number);
+        return true;
     }
 
-    parsingCursor.movePosition(QTextCursor::StartOfLine);
-    parsingCursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
+    QTextCursor editingCursor(block);
+
+    editingCursor.setPosition(block.position() + name_start);
+    editingCursor.setPosition(block.position() + declaration_end, QTextCursor::KeepAnchor);
+    editingCursor.removeSelectedText();
+    setTextCursor(editingCursor);
 
-    parsingCursor.deleteChar();
+    return true;
 }
 
-void OpenedFile::save()
+// For spans found by parsing the text, such as those of a StyleSheet.
+
+void OpenedFile::replaceText(const int start, const int length, const QString &new_text)
 {
-    QFile file(fileInfo.filePath());
-    QString error_message;
-    Rockete::getInstance().getFileWatcher()->removePath(fileInfo.filePath());
+    QTextCursor editingCursor(document());
+    QString text = new_text;
+
+    text.remove(".0000");
+    editingCursor.setPosition(start);
+    editingCursor.setPosition(start + length, QTextCursor::KeepAnchor);
+    editingCursor.insertText(text);
+    setTextCursor(editingCursor);
+}
 
-    if(fileInfo.suffix() == "rml" || fileInfo.suffix() == "rcss")
+// Returns the block where the declarations of the rule start, with body_start just after its '{'.
+// A line that is already inside a rule is returned as is.
+
+QTextBlock OpenedFile::findRuleBody(const int rule_line_number, int &body_start)
+{
+    const QTextBlock rule_block = document()->findBlockByNumber(qMax(rule_line_number, 0));
+
+    body_start = 0;
+
+    for(QTextBlock block = rule_block; block.isValid(); block = block.next())
     {
-        if(!checkXmlCorrectness(error_message))
-        {
-            QMessageBox msgBox;
-            msgBox.setText(fileInfo.fileName() + " is not valid: " + error_message );
-            msgBox.exec();
-        }
-    }
+        const QString text = block.text();
+        const int brace = text.indexOf('{');
+        const int separator = text.indexOf(';');
+        const int closing = text.indexOf('}');
 
-    if(file.open(QFile::WriteOnly|QFile::Truncate|QIODevice::Text)) {
-        if(fileInfo.filePath().endsWith(".rml"))
-        {
-            QTextStream out(&file);
-            out.setCodec("UTF-8");
-            out.setGenerateByteOrderMark(true);
-            out << toPlainText();
-            out.flush();
-        }
-        else
+        if(brace != -1 && (separator == -1 || brace < separator) && (closing == -1 || brace < closing))
         {
-            file.write(toPlainText().toUtf8().data());
+            body_start = brace + 1;
+            return block;
         }
-        file.close();
-        document()->setModified( false );
+
+        if(separator != -1 || closing != -1)
+            break;
     }
 
-    if(fileInfo.suffix() == "snippet")
+    return rule_block;
+}
+
+// RML files are written with a byte order mark, and every file with the platform line endings.
+
+QByteArray OpenedFile::getFileContent()
+{
+    QByteArray content = toPlainText().toUtf8();
+
+#if defined(Q_OS_WIN)
+    content.replace("\n", "\r\n");
+#endif
+
+    if(fileInfo.filePath().endsWith(".rml"))
+        content.prepend("\xEF\xBB\xBF");
+
+    return content;
+}
+
+// The text is snapshot and handed to the FileWriter; what depends on the file on disk is
+// updated once it reports the write in fileWritten().
+
+void OpenedFile::save()
+{
+    finishLoading();
+    FileWriter::getInstance().write(fileInfo.filePath(), getFileContent());
+    document()->setModified( false );
+
+    validate();
+}
+
+// For edits made from the tools rather than typed: the file is only marked modified, and a
+// burst of such edits ends in a single write once it settles.
+
+void OpenedFile::scheduleSave()
+{
+    Rockete::getInstance().updateTabText(this);
+    scheduledSaveTimer.start();
+}
+
+// Called before the file is read back from disk.
+
+void OpenedFile::flushScheduledSave()
+{
+    if (!scheduledSaveTimer.isActive())
+        return;
+
+    scheduledSaveTimer.stop();
+    save();
+    Rockete::getInstance().updateTabText(this);
+}
+
+// Written at once, for a tab about to be closed: returns false, with the tab still modified and
+// the error reported, when the file could not be written.
+
+bool OpenedFile::saveNow()
+{
+    QString error_message;
+
+    finishLoading();
+    scheduledSaveTimer.stop();
+
+    if (!FileWriter::getInstance().writeNow(fileInfo.filePath(), getFileContent(), error_message))
     {
-        Rockete::getInstance().getSnippetsManager()->initialize();
+        document()->setModified(true);
+        Rockete::getInstance().updateTabText(this);
+        reportSaveFailure(fileInfo.filePath(), error_message);
+        return false;
     }
 
-    Rockete::getInstance().getFileWatcher()->addPath(fileInfo.filePath());
+    document()->setModified(false);
+    return true;
 }
 
-void OpenedFile::saveAs(const QString &file_path)
+// The copy is written at once, so that it can be opened as soon as this returns.
+
+bool OpenedFile::saveAs(const QString &file_path)
 {
-    QFile file(file_path);
     QString error_message;
 
-    if (!checkXmlCorrectness(error_message))
+    finishLoading();
+
+    if (!FileWriter::getInstance().writeNow(file_path, getFileContent(), error_message))
     {
-        QMessageBox msgBox;
-        msgBox.setText("the document is not valid: " + error_message );
-        msgBox.exec();
+        reportSaveFailure(file_path, error_message);
+        return false;
     }
 
-    if (file.open(QFile::WriteOnly|QFile::Truncate)) {
-        if(fileInfo.filePath().endsWith(".rml"))
-        {
-            QTextStream out(&file);
-            out.setCodec("UTF-8");
-            out.setGenerateByteOrderMark(true);
-            out << toPlainText();
-            out.flush();
-        }
-        else
-        {
-            file.write(toPlainText().toUtf8().data());
-        }
-        file.close();
-    }
+    validate();
+    return true;
 }
 
 void OpenedFile::setTextEditContent(const QString &content, bool undo_friendly)
@@ -259,3 +536,321 @@ void OpenedFile::setTextEditContent(const QString &content, bool undo_friendly)
         setPlainText(content);
     }
 }
+
+// Public slots:
+
+// The text is checked on a pool thread from a snapshot, so neither typing nor saving waits for it;
+// results for a text that changed in the meantime are dropped, the pending timer checks it again.
+
+void OpenedFile::validate()
+{
+    DocumentValidator *validator;
+
+    if ((fileInfo.suffix() != "rml" && fileInfo.suffix() != "rcss") || itIsLargeFile)
+        return;
+
+    validationTimer.stop();
+
+    if (itIsValidating)
+    {
+        itNeedsValidation = true;
+        return;
+    }
+
+    if (document()->revision() == validatedRevision)
+        return;
+
+    itIsValidating = true;
+    itNeedsValidation = false;
+
+    validator = new DocumentValidator(toPlainText(), fileInfo.suffix() == "rcss" ? DocumentValidator::StyleSheet : DocumentValidator::Markup, document()->revision());
+    connect(validator, SIGNAL(finished()), this, SLOT(validationFinished()));
+    connect(validator, SIGNAL(finished()), validator, SLOT(deleteLater()));
+    QThreadPool::globalInstance()->start(validator);
+}
+
+// The markup is reformatted on a pool thread from a snapshot; only the lines that differ from the
+// snapshot are then replaced, so the undo step, the view and the highlighting follow the change.
+
+void OpenedFile::format()
+{
+    DocumentFormatter *formatter;
+
+    if (fileInfo.suffix() != "rml" || itIsFormatting)
+        return;
+
+    finishLoading();
+    itIsFormatting = true;
+
+    formatter = new DocumentFormatter(toPlainText(), Settings::getTabSize(), document()->revision());
+    connect(formatter, SIGNAL(finished()), this, SLOT(formattingFinished()));
+    connect(formatter, SIGNAL(finished()), formatter, SLOT(deleteLater()));
+    QThreadPool::globalInstance()->start(formatter);
+}
+
+// Private slots:
+
+void OpenedFile::validationFinished()
+{
+    DocumentValidator *validator = qobject_cast<DocumentValidator *>(sender());
+    QHash<int, QString> diagnostic_lines;
+
+    itIsValidating = false;
+
+    if (validator->getRevision() != document()->revision() || itNeedsValidation)
+    {
+        if (itNeedsValidation)
+            validate();
+
+        return;
+    }
+
+    validatedRevision = validator->getRevision();
+    diagnostics = validator->getDiagnostics();
+
+    foreach (const DocumentValidator::Diagnostic &diagnostic, diagnostics)
+    {
+        QString &line_text = diagnostic_lines[diagnostic.line];
+
+        if (!line_text.isEmpty())
+            line_text += "\n";
+
+        line_text += diagnostic.message;
+    }
+
+    setDiagnosticLines(diagnostic_lines);
+    Rockete::getInstance().fillDiagnosticsList(this);
+}
+
+void OpenedFile::formattingFinished()
+{
+    DocumentFormatter *formatter = qobject_cast<DocumentFormatter *>(sender());
+
+    itIsFormatting = false;
+
+    if (!formatter->getErrorMessage().isEmpty())
+    {
+        QMessageBox::warning(this, "Rockete: format failed", fileInfo.fileName() + " is not well-formed and was left as it is:\n" + formatter->getErrorMessage());
+        return;
+    }
+
+    // Edited while formatting: the hunks no longer match the text.
+    if (formatter->getRevision() != document()->revision())
+        return;
+
+    applyLineHunks(formatter->getHunks());
+}
+
+void OpenedFile::saveScheduled()
+{
+    if (!document()->isModified())
+        return;
+
+    save();
+    Rockete::getInstance().fileSaved(this);
+}
+
+void OpenedFile::fileWritten(const QString &file_path, bool success, const QString &error_message)
+{
+    if (file_path != fileInfo.filePath())
+        return;
+
+    if (!success)
+    {
+        document()->setModified(true);
+        Rockete::getInstance().updateTabText(this);
+        reportSaveFailure(file_path, error_message);
+        return;
+    }
+
+    if(fileInfo.suffix() == "snippet")
+    {
+        Rockete::getInstance().getSnippetsManager()->initialize();
+    }
+
+    // The file was replaced, which drops it from the watcher.
+    if (!Rockete::getInstance().getFileWatcher()->files().contains(fileInfo.filePath()))
+        Rockete::getInstance().getFileWatcher()->addPath(fileInfo.filePath());
+
+    ProjectSearchIndex::getInstance().updateFile(fileInfo.filePath());
+    CompletionService::getInstance().updateFile(fileInfo.filePath());
+}
+
+void OpenedFile::loadNextChunk()
+{
+    if (!loadingFile.isOpen())
+        return;
+
+    if (!appendNextChunk())
+        QTimer::singleShot(0, this, SLOT(loadNextChunk()));
+}
+
+// Only the blocks around the view are highlighted; the range is widened by a margin so that
+// small scrolls find their blocks ready. Blocks leaving the range keep their formats.
+
+void OpenedFile::updateVisibleHighlighting()
+{
+    const int margin = 50;
+
+    if (!highlighter || !highlighter->isLimited() || isLoading())
+        return;
+
+    const int first_block_number = qMax(0, firstVisibleBlock().blockNumber() - margin);
+    const int last_block_number = cursorForPosition(QPoint(0, viewport()->height() - 1)).blockNumber() + margin;
+    int block_number = first_block_number;
+
+    if (first_block_number == highlightedFirstBlock && last_block_number == highlightedLastBlock)
+        return;
+
+    highlighter->setHighlightedBlockRange(first_block_number, last_block_number);
+
+    for (QTextBlock block = document()->findBlockByNumber(first_block_number); block.isValid() && block_number <= last_block_number; block = block.next(), ++block_number)
+    {
+        if (block_number < highlightedFirstBlock || block_number > highlightedLastBlock)
+            highlighter->rehighlightBlock(block);
+    }
+
+    highlightedFirstBlock = first_block_number;
+    highlightedLastBlock = last_block_number;
+}
+
+// Private:
+
+// Hunks are applied from the last one so that the line numbers of the others stay valid. Each
+// hunk replaces whole lines; the one reaching the end of the text has no trailing newline.
+
+void OpenedFile::applyLineHunks(const DocumentFormatter::LineHunkList &hunks)
+{
+    const int scroll_value = verticalScrollBar()->value();
+    QTextCursor cursor(document());
+
+    if (hunks.isEmpty())
+        return;
+
+    cursor.beginEditBlock();
+
+    for (int i = hunks.size() - 1; i >= 0; --i)
+    {
+        const DocumentFormatter::LineHunk &hunk = hunks[i];
+        const int block_count = document()->blockCount();
+        const int next_line = hunk.firstLine + hunk.lineCount;
+        QString new_text = hunk.lines.join("\n");
+        int start;
+        int end;
+
+        if (next_line < block_count)
+        {
+            start = document()->findBlockByNumber(hunk.firstLine).position();
+            end = document()->findBlockByNumber(next_line).position();
+
+            if (!hunk.lines.isEmpty())
+                new_text += "\n";
+        }
+        else if (hunk.firstLine >= block_count)
+        {
+            start = end = document()->characterCount() - 1;
+            new_text.prepend("\n");
+        }
+        else
+        {
+            end = document()->characterCount() - 1;
+
+            if (hunk.lines.isEmpty() && hunk.firstLine > 0)
+            {
+                const QTextBlock previous_block = document()->findBlockByNumber(hunk.firstLine - 1);
+                start = previous_block.position() + previous_block.length() - 1;
+            }
+            else
+                start = document()->findBlockByNumber(hunk.firstLine).position();
+        }
+
+        cursor.setPosition(start);
+        cursor.setPosition(end, QTextCursor::KeepAnchor);
+        cursor.insertText(new_text);
+    }
+
+    cursor.endEditBlock();
+    verticalScrollBar()->setValue(scroll_value);
+}
+
+// Files above largeFileThreshold are read in chunks from the event loop, without undo history
+// and with highlighting deferred, so that opening a huge generated file does not freeze the UI.
+
+void OpenedFile::startLargeFileLoading()
+{
+    itIsLargeFile = true;
+    setLargeFileMode(true);
+
+    if (highlighter)
+        highlighter->setHighlightedBlockRange(0, -1);
+
+    clear();
+    document()->setUndoRedoEnabled(false);
+    setReadOnly(true);
+
+    loadingFile.setFileName(fileInfo.filePath());
+
+    if (!loadingFile.open(QIODevice::ReadOnly))
+    {
+        document()->setUndoRedoEnabled(true);
+        setReadOnly(false);
+        return;
+    }
+
+    loadingStream.setDevice(&loadingFile);
+    loadingStream.setCodec("UTF-8");
+
+    connect(this, SIGNAL(updateRequest(QRect,int)), &visibleHighlightingTimer, SLOT(start()));
+
+    if (canLoadProgressively())
+        loadNextChunk();
+    else
+        finishLoading();
+}
+
+// Returns true once the whole file is in the document.
+
+bool OpenedFile::appendNextChunk()
+{
+    const int chunk_size = 1024 * 1024;
+    QTextCursor appendingCursor(document());
+    QString chunk = loadingStream.read(chunk_size);
+
+    chunk.replace("\t", "    ");
+    appendingCursor.movePosition(QTextCursor::End);
+    appendingCursor.insertText(chunk);
+    document()->setModified(false);
+
+    if (!loadingStream.atEnd())
+    {
+        setHeaderText(QString("Large file mode: loading %1 (%2%)...").arg(fileInfo.fileName()).arg(loadingFile.pos() * 100 / qMax(loadingFile.size(), (qint64)1)));
+        return false;
+    }
+
+    loadingStream.setDevice(NULL);
+    loadingFile.close();
+    document()->setUndoRedoEnabled(true);
+    setReadOnly(false);
+    validatedRevision = -1;
+    updateLargeFileHeader();
+    visibleHighlightingTimer.start();
+
+    return true;
+}
+
+// The memory estimate counts the UTF-16 text plus a rough per-line cost for the block and its layout.
+
+void OpenedFile::updateLargeFileHeader()
+{
+    const double megabyte = 1024.0 * 1024.0;
+    const qint64 memory_use = qint64(document()->characterCount()) * sizeof(QChar) + qint64(document()->blockCount()) * 128;
+
+    setHeaderText(QString("Large file mode: %1 MB on disk, about %2 MB in memory. Only the visible lines are highlighted; tag matching, completion and validation are off.")
+        .arg(fileInfo.size() / megabyte, 0, 'f', 1)
+        .arg(memory_use / megabyte, 0, 'f', 1));
+}
+
+void OpenedFile::reportSaveFailure(const QString &file_path, const QString &error_message)
+{
+    QMessageBox::warning(this, "Rockete: save failed", QFileInfo(file_path).fileName() + " could not be saved, the file on disk is unchanged:\n" + error_message);
+}
@@ -2,9 +2,14 @@
 #define OPENEDFILE_H
 
 #include "CodeEditor.h"
+#include <QFile>
 #include <QFileInfo>
 #include <QTextDocument>
-#include <QSyntaxHighlighter>
+#include <QTextStream>
+#include <QTimer>
+#include "SyntaxHighlighter.h"
+#include "DocumentValidator.h"
+#include "DocumentFormatter.h"
 
 class OpenedFile : public CodeEditor
 {
@@ -19,23 +24,70 @@ public:
     void replaceLine(const int line_number, const QString &new_line);
     int insertLineBeforeBracket(const int start_line, const QString &new_line);
     void removeLine(const int line_number);
+    int findRule(const QString &selector, const int start_line_number = 0);
+    int findDeclaration(const int rule_line_number, const QString &property_name);
+    bool getDeclarationValueSpan(const int line_number, const QString &property_name, int &value_start, int &value_length);
+    bool replaceDeclarationValue(const int line_number, const QString &property_name, const QString &new_value);
+    int insertDeclaration(const int rule_line_number, const QString &property_name, const QString &value);
+    bool removeDeclaration(const int line_number, const QString &property_name);
+    void replaceText(const int start, const int length, const QString &new_text);
     void save();
-    void saveAs(const QString &file_path);
+    bool saveNow();
+    void scheduleSave();
+    void flushScheduledSave();
+    bool saveAs(const QString &file_path);
     void setTextEditContent(const QString &content, bool undo_friendly = false);
-    virtual void highlightString(const QString &/*str*/){}
     virtual void rehighlight(){if(highlighter)highlighter->rehighlight();}
+    const DocumentValidator::DiagnosticList &getDiagnostics() const {return diagnostics;}
+    bool isLargeFile() const {return itIsLargeFile;}
+    bool isLoading() const {return loadingFile.isOpen();}
+    void finishLoading();
+
+    static const qint64 largeFileThreshold = 2 * 1024 * 1024;
 
     QFileInfo fileInfo;
 
-public slots:
-    virtual void HighlightClosingTag(){CodeEditor::HighlightClosingTag(); rehighlight();};
+public slots:
+    void validate();
+    void format();
 
 protected:
-    QSyntaxHighlighter *highlighter;
+    virtual void rehighlightBlock(const QTextBlock &block){if(highlighter)highlighter->rehighlightBlock(block);}
+    virtual bool canLoadProgressively() const {return true;}
+    SyntaxHighlighter *highlighter;
+
+private slots:
+    void validationFinished();
+    void formattingFinished();
+    void loadNextChunk();
+    void updateVisibleHighlighting();
+    void fileWritten(const QString &file_path, bool success, const QString &error_message);
+    void saveScheduled();
 
 private:
+    QTextBlock findRuleBody(const int rule_line_number, int &body_start);
+    QByteArray getFileContent();
+    void reportSaveFailure(const QString &file_path, const QString &error_message);
+    void applyLineHunks(const DocumentFormatter::LineHunkList &hunks);
+    void startLargeFileLoading();
+    bool appendNextChunk();
+    void updateLargeFileHeader();
+
     QString previousSearch;
     int previousStartingIndex;
+    QTimer validationTimer;
+    DocumentValidator::DiagnosticList diagnostics;
+    int validatedRevision;
+    bool itIsValidating;
+    bool itNeedsValidation;
+    bool itIsFormatting;
+    bool itIsLargeFile;
+    QFile loadingFile;
+    QTextStream loadingStream;
+    QTimer visibleHighlightingTimer;
+    QTimer scheduledSaveTimer;
+    int highlightedFirstBlock;
+    int highlightedLastBlock;
 };
 
 #endif
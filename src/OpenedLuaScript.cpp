@@ -17,16 +17,3 @@ void OpenedLuaScript::initialize()
 
     fillTextEdit();
 }
-
-void OpenedLuaScript::highlightString(const QString &str)
-{
-    if(str.isEmpty())
-    {
-        ((LuaHighlighter *)highlighter)->setHighlightedString("placeholder_for_highlighted_string");
-    }
-    else
-    {
-        ((LuaHighlighter *)highlighter)->setHighlightedString(str);
-    }
-
-}
\ No newline at end of file
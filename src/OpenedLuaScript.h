@@ -11,7 +11,6 @@ class OpenedLuaScript : public OpenedFile
 public:
     OpenedLuaScript();
     virtual void initialize();
-    virtual void highlightString(const QString &str);
 };
 
 #endif
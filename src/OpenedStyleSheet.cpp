@@ -18,18 +18,6 @@ void OpenedStyleSheet::initialize()
     fillTextEdit();
 }
 
-void OpenedStyleSheet::highlightString(const QString &str)
-{
-    if(str.isEmpty())
-    {
-        ((CssHighlighter *)highlighter)->setHighlightedString("placeholder_for_highlighted_string");
-    }
-    else
-    {
-        ((CssHighlighter *)highlighter)->setHighlightedString(str);
-    }
-}
-
 void OpenedStyleSheet::addStyleSheetTextAtEnd(const QString &new_content)
 {
     QTextCursor replacingCursor = textCursor();
@@ -11,8 +11,10 @@ class OpenedStyleSheet : public OpenedFile
 public:
     OpenedStyleSheet();
     virtual void initialize();
-    virtual void highlightString(const QString &str);
     void addStyleSheetTextAtEnd(const QString &new_content);
+
+protected:
+    virtual Language getLanguage() const {return StyleSheetLanguage;}
 };
 
 #endif
@@ -6,6 +6,7 @@
 #include <QXmlStreamWriter>
 #include <QMessageBox>
 #include "LocalizationManagerInterface.h"
+#include "StringTableLocalizationManager.h"
 
 #ifdef Q_OS_MAC
 # include <CoreFoundation/CoreFoundation.h>
@@ -180,6 +181,7 @@ bool ProjectManager::Initialize(const QString &filename)
         wordListsPath = "word_lists/";
     }
 
+    localizationFile.clear();
     node_list = domDocument.elementsByTagName("LocalizationFile");
 
     if(!node_list.isEmpty())
@@ -187,10 +189,28 @@ bool ProjectManager::Initialize(const QString &filename)
         QDomNode node = node_list.at(0);
         if(node.firstChild().isText())
         {
-            if(LocalizationManagerInterface::hasInstance())
-            {
-                LocalizationManagerInterface::getInstance().initialize(node.firstChild().toText().data());
-            }
+            localizationFile = node.firstChild().toText().data();
+        }
+    }
+
+    // A localization plugin takes precedence; otherwise string tables are handled by the built-in provider.
+    StringTableLocalizationManager::uninstall();
+
+    if(!localizationFile.isEmpty())
+    {
+        if(LocalizationManagerInterface::hasInstance())
+        {
+            LocalizationManagerInterface::getInstance().initialize(localizationFile);
+        }
+        else if(StringTableLocalizationManager::canLoad(localizationFile))
+        {
+            QFileInfo localization_file_info(localizationFile);
+
+            if(localization_file_info.isRelative())
+                localization_file_info = QFileInfo(file_info.path() + "/" + localizationFile);
+
+            StringTableLocalizationManager::install();
+            LocalizationManagerInterface::getInstance().initialize(localization_file_info.absoluteFilePath());
         }
     }
 
@@ -316,6 +336,12 @@ void ProjectManager::Serialize(const QString &filename)
         xmlWriter.writeStartElement("WordList");
         xmlWriter.writeCharacters(wordListsPath);
         xmlWriter.writeEndElement();
+        if(!localizationFile.isEmpty())
+        {
+            xmlWriter.writeStartElement("LocalizationFile");
+            xmlWriter.writeCharacters(localizationFile);
+            xmlWriter.writeEndElement();
+        }
         xmlWriter.writeStartElement("LocalizationOpeningTag");
         xmlWriter.writeCharacters(localizationOpeningTag);
         xmlWriter.writeEndElement();
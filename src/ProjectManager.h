@@ -37,6 +37,7 @@ public:
     const QString &getSnippetsFolderPath(){return snippetsFolderPath;}
     const QString &getLocalizationOpeningTag(){return localizationOpeningTag;}
     const QString &getLocalizationClosingTag(){return localizationClosingTag;}
+    const QString &getLocalizationFile(){return localizationFile;}
     void setCuttingInfo(const QString &key, const CssCuttingInfo &info);
     CssCuttingInfo getCuttingInfo(const QString &key);
 private:
@@ -48,6 +49,7 @@ private:
     QString snippetsFolderPath;
     QString localizationOpeningTag;
     QString localizationClosingTag;
+    QString localizationFile;
     QMap<QString, CssCuttingInfo> cutting;
 };
 #endif
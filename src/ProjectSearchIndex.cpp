@@ -0,0 +1,709 @@
+#include "ProjectSearchIndex.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRegExp>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QTextStream>
+#include <algorithm>
+#include <iterator>
+
+static const quint32 indexMagic = 0x52545249; // "RTRI"
+static const quint32 indexVersion = 1;
+static const int maximumResultCount = 5000;
+
+class IndexingTask : public QRunnable
+{
+public:
+    enum Kind { LoadAndRescan, Rescan, Files };
+
+    IndexingTask(ProjectSearchIndex *search_index, const Kind task_kind, const QStringList &path_list, const bool it_is_recursive = true)
+        : index(search_index), kind(task_kind), paths(path_list), itIsRecursive(it_is_recursive)
+    {
+    }
+
+    virtual void run()
+    {
+        if (kind == Files) {
+            index->indexFiles(paths);
+            return;
+        }
+
+        index->rescan(paths, itIsRecursive);
+    }
+
+private:
+    ProjectSearchIndex *index;
+    Kind kind;
+    QStringList paths;
+    bool itIsRecursive;
+};
+
+class SearchTask : public QRunnable
+{
+public:
+    SearchTask(ProjectSearchIndex *search_index, const int search_query, const QString &search_pattern, const bool it_is_case_sensitive, const bool it_is_regular_expression)
+        : index(search_index), query(search_query), pattern(search_pattern), itIsCaseSensitive(it_is_case_sensitive), itIsRegularExpression(it_is_regular_expression)
+    {
+    }
+
+    virtual void run()
+    {
+        index->runSearch(query, pattern, itIsCaseSensitive, itIsRegularExpression);
+    }
+
+private:
+    ProjectSearchIndex *index;
+    int query;
+    QString pattern;
+    bool itIsCaseSensitive;
+    bool itIsRegularExpression;
+};
+
+// Public:
+
+ProjectSearchIndex::ProjectSearchIndex()
+    : currentQuery(0), itIsStopping(0)
+{
+    indexingPool.setMaxThreadCount(1);
+    searchPool.setMaxThreadCount(1);
+    connect(&watcher, SIGNAL(directoryChanged(const QString &)), this, SLOT(directoryChanged(const QString &)));
+    connect(&watcher, SIGNAL(fileChanged(const QString &)), this, SLOT(fileChanged(const QString &)));
+    connect(this, SIGNAL(indexingFinished(int)), this, SLOT(watchIndexedFiles()), Qt::QueuedConnection);
+}
+
+ProjectSearchIndex::~ProjectSearchIndex()
+{
+    shutdown();
+}
+
+void ProjectSearchIndex::setProject(const QStringList &directory_list, const QString &project_file_path)
+{
+    QStringList watched_directories;
+
+    cancelSearch();
+    itIsStopping.store(1);
+    indexingPool.waitForDone();
+    searchPool.waitForDone();
+    itIsStopping.store(0);
+
+    if (!watcher.directories().isEmpty())
+        watcher.removePaths(watcher.directories());
+
+    if (!watcher.files().isEmpty())
+        watcher.removePaths(watcher.files());
+
+    mutex.lock();
+    files.clear();
+    fileIds.clear();
+    postings.clear();
+    directories.clear();
+
+    foreach (const QString &directory, directory_list) {
+        const QString path = QDir::cleanPath(QFileInfo(directory).absoluteFilePath());
+
+        if (!directory.isEmpty() && QFileInfo(path).isDir() && !directories.contains(path))
+            directories << path;
+    }
+
+    indexFilePath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/"
+        + QCryptographicHash::hash(project_file_path.toUtf8(), QCryptographicHash::Md5).toHex() + ".trigrams";
+    mutex.unlock();
+
+    foreach (const QString &directory, directories) {
+        QDirIterator iterator(directory, QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks, QDirIterator::Subdirectories);
+
+        watched_directories << directory;
+
+        while (iterator.hasNext())
+            watched_directories << iterator.next();
+    }
+
+    if (!watched_directories.isEmpty())
+        watcher.addPaths(watched_directories);
+
+    indexingPool.start(new IndexingTask(this, IndexingTask::LoadAndRescan, directories));
+}
+
+void ProjectSearchIndex::updateFile(const QString &file_path)
+{
+    const QString path = QDir::cleanPath(QFileInfo(file_path).absoluteFilePath());
+
+    if (!isIndexedFile(path) || itIsStopping.load())
+        return;
+
+    foreach (const QString &directory, directories) {
+        if (path.startsWith(directory + "/")) {
+            indexingPool.start(new IndexingTask(this, IndexingTask::Files, QStringList(path)));
+            return;
+        }
+    }
+}
+
+int ProjectSearchIndex::search(const QString &pattern, const bool case_sensitive, const bool regular_expression)
+{
+    const int query = currentQuery.fetchAndAddOrdered(1) + 1;
+
+    searchPool.start(new SearchTask(this, query, pattern, case_sensitive, regular_expression));
+
+    return query;
+}
+
+void ProjectSearchIndex::cancelSearch()
+{
+    currentQuery.fetchAndAddOrdered(1);
+}
+
+// The instance outlives the application object, so the pools and the watcher are stopped
+// while it still exists.
+
+void ProjectSearchIndex::shutdown()
+{
+    itIsStopping.store(1);
+    cancelSearch();
+    searchPool.waitForDone();
+    indexingPool.waitForDone();
+
+    if (!watcher.directories().isEmpty())
+        watcher.removePaths(watcher.directories());
+
+    if (!watcher.files().isEmpty())
+        watcher.removePaths(watcher.files());
+}
+
+int ProjectSearchIndex::getFileCount()
+{
+    QMutexLocker locker(&mutex);
+
+    return fileIds.size();
+}
+
+// Only files whose size or modification date differ from the indexed ones are read again.
+
+void ProjectSearchIndex::rescan(const QStringList &directory_list, const bool recursive)
+{
+    QSet<QString> found_paths;
+    bool it_has_changed = false;
+
+    mutex.lock();
+    const bool it_must_load = files.isEmpty();
+    mutex.unlock();
+
+    if (it_must_load)
+        loadIndex();
+
+    foreach (const QString &directory, directory_list) {
+        QDirIterator iterator(directory, QDir::Files | QDir::NoSymLinks, recursive ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags);
+
+        while (iterator.hasNext()) {
+            iterator.next();
+
+            const QFileInfo file_info = iterator.fileInfo();
+            const QString path = QDir::cleanPath(file_info.absoluteFilePath());
+            const qint64 last_modified = file_info.lastModified().toMSecsSinceEpoch();
+
+            if (itIsStopping.load())
+                return;
+
+            if (!isIndexedFile(path) || file_info.isHidden())
+                continue;
+
+            found_paths.insert(path);
+
+            mutex.lock();
+            const int file_id = fileIds.value(path, -1);
+            const bool it_is_up_to_date = file_id != -1 && files[file_id].size == file_info.size() && files[file_id].lastModified == last_modified;
+            mutex.unlock();
+
+            if (it_is_up_to_date)
+                continue;
+
+            indexFile(path, file_info.size(), last_modified);
+            it_has_changed = true;
+        }
+    }
+
+    mutex.lock();
+
+    for (int file_id = 0; file_id < files.size(); ++file_id) {
+        const QString &path = files[file_id].path;
+
+        if (files[file_id].itIsRemoved || found_paths.contains(path))
+            continue;
+
+        foreach (const QString &directory, directory_list) {
+            const QString prefix = directory + "/";
+
+            if (path.startsWith(prefix) && (recursive || path.indexOf('/', prefix.length()) == -1)) {
+                removeFile(file_id);
+                it_has_changed = true;
+                break;
+            }
+        }
+    }
+
+    mutex.unlock();
+
+    if (it_has_changed || it_must_load)
+        saveIndex();
+
+    emit indexingFinished(getFileCount());
+}
+
+void ProjectSearchIndex::indexFiles(const QStringList &file_list)
+{
+    foreach (const QString &path, file_list) {
+        const QFileInfo file_info(path);
+
+        if (file_info.exists()) {
+            indexFile(path, file_info.size(), file_info.lastModified().toMSecsSinceEpoch());
+        }
+        else {
+            QMutexLocker locker(&mutex);
+            const int file_id = fileIds.value(path, -1);
+
+            if (file_id != -1)
+                removeFile(file_id);
+        }
+    }
+
+    saveIndex();
+    emit indexingFinished(getFileCount());
+}
+
+// Candidates are the files holding all the trigrams of the literal parts of the pattern; each
+// one is then read and searched line by line, and abandoned as soon as a newer query starts.
+
+void ProjectSearchIndex::runSearch(const int query, const QString &pattern, const bool case_sensitive, const bool regular_expression)
+{
+    QRegExp expression(pattern, case_sensitive ? Qt::CaseSensitive : Qt::CaseInsensitive, regular_expression ? QRegExp::RegExp2 : QRegExp::FixedString);
+    QStringList candidate_paths;
+    int match_count = 0;
+    int file_count = 0;
+
+    if (pattern.isEmpty() || !expression.isValid()) {
+        emit searchFinished(query, 0, 0);
+        return;
+    }
+
+    mutex.lock();
+
+    {
+        QVector<int> candidates;
+        bool it_is_filtered = false;
+
+        foreach (const QString &literal, getRequiredLiterals(pattern, regular_expression)) {
+            QVector<quint32> trigrams;
+
+            getTrigrams(literal.toLower(), trigrams);
+
+            foreach (const quint32 trigram, trigrams) {
+                const QVector<int> posting = postings.value(trigram);
+
+                if (!it_is_filtered) {
+                    candidates = posting;
+                    it_is_filtered = true;
+                }
+                else {
+                    QVector<int> intersection;
+
+                    std::set_intersection(candidates.begin(), candidates.end(), posting.begin(), posting.end(), std::back_inserter(intersection));
+                    candidates = intersection;
+                }
+
+                if (candidates.isEmpty())
+                    break;
+            }
+        }
+
+        if (it_is_filtered) {
+            foreach (const int file_id, candidates)
+                candidate_paths << files[file_id].path;
+        }
+        else {
+            foreach (const IndexedFile &file, files) {
+                if (!file.itIsRemoved)
+                    candidate_paths << file.path;
+            }
+        }
+    }
+
+    mutex.unlock();
+
+    foreach (const QString &path, candidate_paths) {
+        QString content;
+        int line_start = 0;
+        bool it_has_match = false;
+
+        if (currentQuery.load() != query)
+            return;
+
+        if (!readFile(path, content))
+            continue;
+
+        for (int line = 0; line_start <= content.length() && match_count < maximumResultCount; ++line) {
+            int line_end = content.indexOf('\n', line_start);
+
+            if (line_end == -1)
+                line_end = content.length();
+
+            const QString line_text = content.mid(line_start, line_end - line_start);
+
+            for (int index = expression.indexIn(line_text); index != -1 && match_count < maximumResultCount; index = expression.indexIn(line_text, index + qMax(expression.matchedLength(), 1))) {
+                if (expression.matchedLength() <= 0)
+                    continue;
+
+                emit resultFound(query, path, line, index, line_text.trimmed());
+                ++match_count;
+                it_has_match = true;
+            }
+
+            line_start = line_end + 1;
+        }
+
+        if (it_has_match)
+            ++file_count;
+    }
+
+    if (currentQuery.load() == query)
+        emit searchFinished(query, match_count, file_count);
+}
+
+// Private slots:
+
+// A new subdirectory may already hold files and subdirectories of its own, so it is watched and
+// rescanned as a whole.
+
+void ProjectSearchIndex::directoryChanged(const QString &path)
+{
+    QDirIterator iterator(path, QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks);
+    const QSet<QString> watched_directories = QSet<QString>::fromList(watcher.directories());
+    QStringList new_directories;
+
+    while (iterator.hasNext()) {
+        const QString directory = QDir::cleanPath(iterator.next());
+
+        if (watched_directories.contains(directory))
+            continue;
+
+        QDirIterator sub_iterator(directory, QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks, QDirIterator::Subdirectories);
+
+        watcher.addPath(directory);
+
+        while (sub_iterator.hasNext())
+            watcher.addPath(sub_iterator.next());
+
+        new_directories << directory;
+    }
+
+    indexingPool.start(new IndexingTask(this, IndexingTask::Rescan, QStringList(QDir::cleanPath(path)), false));
+
+    if (!new_directories.isEmpty())
+        indexingPool.start(new IndexingTask(this, IndexingTask::Rescan, new_directories));
+}
+
+// Directory notifications do not report files edited in place, so each indexed file is watched
+// too. A file replaced by a rename is no longer watched and is added back.
+
+void ProjectSearchIndex::fileChanged(const QString &path)
+{
+    if (QFileInfo(path).exists() && !watcher.files().contains(path))
+        watcher.addPath(path);
+
+    updateFile(path);
+}
+
+void ProjectSearchIndex::watchIndexedFiles()
+{
+    const QSet<QString> watched_files = QSet<QString>::fromList(watcher.files());
+    QStringList new_files;
+
+    if (itIsStopping.load())
+        return;
+
+    mutex.lock();
+
+    foreach (const IndexedFile &indexed_file, files) {
+        if (!indexed_file.itIsRemoved && !watched_files.contains(indexed_file.path))
+            new_files << indexed_file.path;
+    }
+
+    mutex.unlock();
+
+    if (!new_files.isEmpty())
+        watcher.addPaths(new_files);
+}
+
+// Private:
+
+void ProjectSearchIndex::loadIndex()
+{
+    QFile file;
+    QDataStream stream;
+    quint32 magic;
+    quint32 version;
+    qint32 file_count;
+
+    mutex.lock();
+    file.setFileName(indexFilePath);
+    mutex.unlock();
+
+    if (!file.open(QFile::ReadOnly))
+        return;
+
+    stream.setDevice(&file);
+    stream >> magic >> version >> file_count;
+
+    if (magic != indexMagic || version != indexVersion || file_count < 0)
+        return;
+
+    QMutexLocker locker(&mutex);
+
+    for (int file_index = 0; file_index < file_count && stream.status() == QDataStream::Ok; ++file_index) {
+        IndexedFile indexed_file;
+        bool it_is_in_project = false;
+
+        stream >> indexed_file.path >> indexed_file.size >> indexed_file.lastModified >> indexed_file.trigrams;
+        indexed_file.itIsRemoved = false;
+
+        foreach (const QString &directory, directories)
+            it_is_in_project = it_is_in_project || indexed_file.path.startsWith(directory + "/");
+
+        if (stream.status() != QDataStream::Ok || !it_is_in_project || fileIds.contains(indexed_file.path))
+            continue;
+
+        fileIds.insert(indexed_file.path, files.size());
+        files << indexed_file;
+
+        foreach (const quint32 trigram, indexed_file.trigrams)
+            addPosting(trigram, files.size() - 1);
+    }
+}
+
+void ProjectSearchIndex::saveIndex()
+{
+    QMutexLocker locker(&mutex);
+    QSaveFile file(indexFilePath);
+    QDataStream stream;
+
+    QDir().mkpath(QFileInfo(indexFilePath).absolutePath());
+
+    if (!file.open(QFile::WriteOnly))
+        return;
+
+    stream.setDevice(&file);
+    stream << indexMagic << indexVersion << qint32(fileIds.size());
+
+    foreach (const IndexedFile &indexed_file, files) {
+        if (!indexed_file.itIsRemoved)
+            stream << indexed_file.path << indexed_file.size << indexed_file.lastModified << indexed_file.trigrams;
+    }
+
+    file.commit();
+}
+
+void ProjectSearchIndex::indexFile(const QString &file_path, const qint64 size, const qint64 last_modified)
+{
+    QString content;
+    QVector<quint32> trigrams;
+    int file_id;
+
+    if (!readFile(file_path, content))
+        return;
+
+    getTrigrams(content.toLower(), trigrams);
+
+    QMutexLocker locker(&mutex);
+
+    file_id = fileIds.value(file_path, -1);
+
+    if (file_id == -1) {
+        IndexedFile indexed_file;
+
+        indexed_file.path = file_path;
+        file_id = files.size();
+        files << indexed_file;
+        fileIds.insert(file_path, file_id);
+    }
+    else {
+        foreach (const quint32 trigram, files[file_id].trigrams)
+            removePosting(trigram, file_id);
+    }
+
+    files[file_id].size = size;
+    files[file_id].lastModified = last_modified;
+    files[file_id].trigrams = trigrams;
+    files[file_id].itIsRemoved = false;
+
+    foreach (const quint32 trigram, trigrams)
+        addPosting(trigram, file_id);
+}
+
+// The mutex must be held.
+
+void ProjectSearchIndex::removeFile(const int file_id)
+{
+    foreach (const quint32 trigram, files[file_id].trigrams)
+        removePosting(trigram, file_id);
+
+    fileIds.remove(files[file_id].path);
+    files[file_id].trigrams.clear();
+    files[file_id].itIsRemoved = true;
+}
+
+void ProjectSearchIndex::addPosting(const quint32 trigram, const int file_id)
+{
+    QVector<int> &posting = postings[trigram];
+
+    if (posting.isEmpty() || posting.last() < file_id) {
+        posting << file_id;
+        return;
+    }
+
+    QVector<int>::iterator position = std::lower_bound(posting.begin(), posting.end(), file_id);
+
+    if (*position != file_id)
+        posting.insert(position, file_id);
+}
+
+void ProjectSearchIndex::removePosting(const quint32 trigram, const int file_id)
+{
+    QHash<quint32, QVector<int> >::iterator posting = postings.find(trigram);
+
+    if (posting == postings.end())
+        return;
+
+    QVector<int>::iterator position = std::lower_bound(posting->begin(), posting->end(), file_id);
+
+    if (position != posting->end() && *position == file_id)
+        posting->erase(position);
+
+    if (posting->isEmpty())
+        postings.erase(posting);
+}
+
+bool ProjectSearchIndex::isIndexedFile(const QString &file_path)
+{
+    return file_path.endsWith(".rml", Qt::CaseInsensitive) || file_path.endsWith(".rcss", Qt::CaseInsensitive)
+        || file_path.endsWith(".lua", Qt::CaseInsensitive) || file_path.endsWith(".snippet", Qt::CaseInsensitive);
+}
+
+bool ProjectSearchIndex::readFile(const QString &file_path, QString &content)
+{
+    QFile file(file_path);
+
+    if (!file.open(QFile::ReadOnly | QFile::Text))
+        return false;
+
+    QTextStream stream(&file);
+    stream.setCodec("UTF-8");
+    content = stream.readAll();
+
+    return true;
+}
+
+// Each trigram is folded into 30 bits, 10 per character: characters outside that range may
+// share a key, which only adds candidates that the verification then rejects.
+
+void ProjectSearchIndex::getTrigrams(const QString &text, QVector<quint32> &trigrams)
+{
+    QSet<quint32> trigram_set;
+    const ushort *data = text.utf16();
+
+    for (int index = 0; index + 2 < text.length(); ++index)
+        trigram_set.insert(((data[index] & 0x3FF) << 20) | ((data[index + 1] & 0x3FF) << 10) | (data[index + 2] & 0x3FF));
+
+    trigrams.clear();
+    trigrams.reserve(trigram_set.size());
+
+    foreach (const quint32 trigram, trigram_set)
+        trigrams << trigram;
+
+    std::sort(trigrams.begin(), trigrams.end());
+}
+
+// Literal runs a regular expression cannot match without: top-level text that is neither
+// quantified away nor part of a class or group. Alternatives make every run optional.
+
+QStringList ProjectSearchIndex::getRequiredLiterals(const QString &pattern, const bool regular_expression)
+{
+    QStringList literals;
+    QString literal;
+    int depth = 0;
+
+    if (!regular_expression)
+        return QStringList(pattern);
+
+    if (pattern.contains('|'))
+        return literals;
+
+    for (int index = 0; index < pattern.length(); ++index) {
+        const QChar c = pattern.at(index);
+
+        if (c == '\\' && index + 1 < pattern.length()) {
+            const QChar escaped = pattern.at(++index);
+
+            if (escaped.isLetterOrDigit()) {
+                if (literal.length() >= 3)
+                    literals << literal;
+
+                literal.clear();
+            }
+            else if (depth == 0) {
+                literal += escaped;
+            }
+
+            continue;
+        }
+
+        if (c == '*' || c == '?' || c == '{') {
+            literal.chop(1);
+
+            if (c == '{')
+                index = qMax(index, pattern.indexOf('}', index));
+        }
+        else if (c == '[') {
+            int class_end = index + 1;
+
+            if (class_end < pattern.length() && pattern.at(class_end) == '^')
+                ++class_end;
+
+            if (class_end < pattern.length() && pattern.at(class_end) == ']')
+                ++class_end;
+
+            while (class_end < pattern.length() && pattern.at(class_end) != ']')
+                class_end += pattern.at(class_end) == '\\' ? 2 : 1;
+
+            index = class_end;
+        }
+        else if (c == '(') {
+            ++depth;
+        }
+        else if (c == ')') {
+            --depth;
+        }
+        else if (depth == 0 && c != '.' && c != '^' && c != '$' && c != '+') {
+            literal += c;
+            continue;
+        }
+
+        if (literal.length() >= 3)
+            literals << literal;
+
+        literal.clear();
+    }
+
+    if (literal.length() >= 3)
+        literals << literal;
+
+    return literals;
+}
@@ -0,0 +1,86 @@
+#ifndef PROJECTSEARCHINDEX_H
+#define PROJECTSEARCHINDEX_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+
+// Trigram index over the text files of the project, kept on disk between sessions. Indexing
+// and queries run on pool threads; a query only reads the files holding every trigram of its
+// literal parts, and reports each match through resultFound() as soon as it is verified.
+
+class ProjectSearchIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    ProjectSearchIndex();
+    virtual ~ProjectSearchIndex();
+
+    static ProjectSearchIndex & getInstance() {
+        static ProjectSearchIndex instance;
+        return instance;
+    }
+
+    void setProject(const QStringList &directory_list, const QString &project_file_path);
+    void updateFile(const QString &file_path);
+    int search(const QString &pattern, const bool case_sensitive, const bool regular_expression);
+    void cancelSearch();
+    void shutdown();
+    int getFileCount();
+
+    // Called from the pool threads.
+    void rescan(const QStringList &directory_list, const bool recursive);
+    void indexFiles(const QStringList &file_list);
+    void runSearch(const int query, const QString &pattern, const bool case_sensitive, const bool regular_expression);
+
+signals:
+    void indexingFinished(int file_count);
+    void resultFound(int query, const QString &file_path, int line, int column, const QString &line_text);
+    void searchFinished(int query, int match_count, int file_count);
+
+private slots:
+    void directoryChanged(const QString &path);
+    void fileChanged(const QString &path);
+    void watchIndexedFiles();
+
+private:
+    struct IndexedFile
+    {
+        QString path;
+        qint64 size;
+        qint64 lastModified;
+        QVector<quint32> trigrams;
+        bool itIsRemoved;
+    };
+
+    void loadIndex();
+    void saveIndex();
+    void indexFile(const QString &file_path, const qint64 size, const qint64 last_modified);
+    void removeFile(const int file_id);
+    void addPosting(const quint32 trigram, const int file_id);
+    void removePosting(const quint32 trigram, const int file_id);
+    static bool isIndexedFile(const QString &file_path);
+    static bool readFile(const QString &file_path, QString &content);
+    static void getTrigrams(const QString &text, QVector<quint32> &trigrams);
+    static QStringList getRequiredLiterals(const QString &pattern, const bool regular_expression);
+
+    QMutex mutex;
+    QVector<IndexedFile> files;
+    QHash<QString, int> fileIds;
+    QHash<quint32, QVector<int> > postings;
+    QStringList directories;
+    QString indexFilePath;
+    QFileSystemWatcher watcher;
+    QThreadPool indexingPool;
+    QThreadPool searchPool;
+    QAtomicInt currentQuery;
+    QAtomicInt itIsStopping;
+};
+
+#endif
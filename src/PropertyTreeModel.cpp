@@ -11,8 +11,17 @@
 
 #define PROPERTY_SET_ID (quintptr)-1
 
+// Snapshots are dropped all at once beyond this count.
+static const int maximumSnapshotCount = 256;
+
+// Property rows point to their set, so their indices stay valid as sets are inserted or removed.
+static PropertyTreeModel::PropertySet *getPropertySet(const QModelIndex &index)
+{
+    return static_cast<PropertyTreeModel::PropertySet *>(index.internalPointer());
+}
+
 PropertyTreeModel::PropertyTreeModel(QObject *parent)
-: QAbstractItemModel(parent)
+: QAbstractItemModel(parent), document(NULL), currentElement(NULL), snapshotGeneration(-1), currentPropertySet(NULL), buildingElement(NULL)
 {
 #ifndef QT_NO_DEBUG
     new ModelTest(this);
@@ -22,6 +31,7 @@ PropertyTreeModel::PropertyTreeModel(QObject *parent)
 PropertyTreeModel::~PropertyTreeModel()
 {
     clearData();
+    clearSnapshots();
 }
 
 QVariant PropertyTreeModel::data(const QModelIndex &index, int role) const
@@ -43,9 +53,9 @@ QVariant PropertyTreeModel::data(const QModelIndex &index, int role) const
     }
     else {
         if (index.column() == 0)
-            return QVariant(propertySetList[index.internalId()]->propertyList[index.row()]->name);
+            return QVariant(getPropertySet(index)->propertyList[index.row()]->name);
         else
-            return QVariant(propertySetList[index.internalId()]->propertyList[index.row()]->value);
+            return QVariant(getPropertySet(index)->propertyList[index.row()]->value);
     }
 
     return QVariant("Impossible");
@@ -57,10 +67,11 @@ bool PropertyTreeModel::setData(const QModelIndex &index, const QVariant &value,
         return false;
 
     if (index.column() == 1) {
-        const PropertySet * property_set = propertySetList[index.internalId()];
+        const PropertySet * property_set = getPropertySet(index);
         Property * property =  property_set->propertyList[index.row()];
 
         ActionManager::getInstance().applyNew(new ActionSetProperty(document, currentElement, property, value.toString()));
+        property->value = value.toString();
 
         emit dataChanged(index,index);
 
@@ -102,7 +113,7 @@ QModelIndex PropertyTreeModel::index(int row, int column, const QModelIndex &par
     if(!parent.isValid())
         return createIndex(row,column,PROPERTY_SET_ID);
 
-    return createIndex(row,column,parent.row());
+    return createIndex(row,column,propertySetList[parent.row()]);
 }
 
 QModelIndex PropertyTreeModel::parent(const QModelIndex &index) const
@@ -110,7 +121,7 @@ QModelIndex PropertyTreeModel::parent(const QModelIndex &index) const
     if (!index.isValid() || index.internalId() == PROPERTY_SET_ID)
         return QModelIndex();
 
-    return createIndex(index.internalId(), 0, PROPERTY_SET_ID);
+    return createIndex(propertySetList.indexOf(getPropertySet(index)), 0, PROPERTY_SET_ID);
 }
 
 int PropertyTreeModel::rowCount(const QModelIndex &parent) const
@@ -132,30 +143,178 @@ int PropertyTreeModel::columnCount(const QModelIndex &/*parent*/) const
     return 2;
 }
 
+// The properties of an element are computed once per style generation and kept; the rows
+// shown are then updated to match them, only the differing ones being removed, inserted or
+// changed. Selecting the same element again emits nothing.
+
 void PropertyTreeModel::setupData(OpenedDocument *_document, Element * _element)
 {
-    clearData();
+    QHash<const Element*, QList<PropertySet*> >::iterator snapshot;
+
     document = _document;
     currentElement = _element;
-    if (currentElement) {
+
+    if (snapshotGeneration != RocketHelper::getStyleGeneration()) {
+        clearSnapshots();
+        snapshotGeneration = RocketHelper::getStyleGeneration();
+    }
+
+    if (!currentElement) {
+        updatePropertySets(QList<PropertySet*>());
+        return;
+    }
+
+    snapshot = snapshots.find(currentElement);
+
+    if (snapshot == snapshots.end()) {
+        if (snapshots.size() >= maximumSnapshotCount)
+            clearSnapshots();
+
+        builtPropertySetList.clear();
         currentPropertySet = NULL;
         buildElementProperties(_element, _element);
+        snapshot = snapshots.insert(currentElement, builtPropertySetList);
+        builtPropertySetList.clear();
     }
+
+    updatePropertySets(snapshot.value());
 }
 
 // Private:
 
 void PropertyTreeModel::clearData()
 {
-    for (int i=0; i<propertySetList.size(); ++i) {
-        for (int j=0; j<propertySetList[i]->propertyList.size(); ++j) {
-            delete propertySetList[i]->propertyList[j];
+    foreach (PropertySet *property_set, propertySetList)
+        deletePropertySet(property_set);
+
+    propertySetList.clear();
+}
+
+void PropertyTreeModel::clearSnapshots()
+{
+    foreach (const QList<PropertySet*> &property_sets, snapshots) {
+        foreach (PropertySet *property_set, property_sets)
+            deletePropertySet(property_set);
+    }
+
+    snapshots.clear();
+}
+
+// Sets shared by the start and the end of both lists are kept, their properties updated; the
+// ones in between are replaced. Shown sets are copies, the snapshot staying untouched.
+
+void PropertyTreeModel::updatePropertySets(const QList<PropertySet*> &new_property_sets)
+{
+    const int old_count = propertySetList.size();
+    const int new_count = new_property_sets.size();
+    int prefix = 0;
+    int suffix = 0;
+
+    while (prefix < old_count && prefix < new_count && isSamePropertySet(propertySetList[prefix], new_property_sets[prefix]))
+        prefix++;
+
+    while (suffix < old_count - prefix && suffix < new_count - prefix
+        && isSamePropertySet(propertySetList[old_count - 1 - suffix], new_property_sets[new_count - 1 - suffix]))
+        suffix++;
+
+    for (int i = 0; i < prefix; ++i)
+        updateProperties(i, new_property_sets[i]);
+
+    for (int i = 0; i < suffix; ++i)
+        updateProperties(old_count - 1 - i, new_property_sets[new_count - 1 - i]);
+
+    if (old_count - prefix - suffix > 0) {
+        beginRemoveRows(QModelIndex(), prefix, old_count - suffix - 1);
+
+        for (int i = prefix; i < old_count - suffix; ++i)
+            deletePropertySet(propertySetList.takeAt(prefix));
+
+        endRemoveRows();
+    }
+
+    if (new_count - prefix - suffix > 0) {
+        beginInsertRows(QModelIndex(), prefix, new_count - suffix - 1);
+
+        for (int i = prefix; i < new_count - suffix; ++i)
+            propertySetList.insert(i, copyPropertySet(new_property_sets[i]));
+
+        endInsertRows();
+    }
+}
+
+void PropertyTreeModel::updateProperties(const int set_row, const PropertySet *new_property_set)
+{
+    PropertySet *property_set = propertySetList[set_row];
+    const QModelIndex parent_index = index(set_row, 0);
+    const int old_count = property_set->propertyList.size();
+    const int new_count = new_property_set->propertyList.size();
+    int prefix = 0;
+    int suffix = 0;
+
+    while (prefix < old_count && prefix < new_count && property_set->propertyList[prefix]->name == new_property_set->propertyList[prefix]->name)
+        prefix++;
+
+    while (suffix < old_count - prefix && suffix < new_count - prefix
+        && property_set->propertyList[old_count - 1 - suffix]->name == new_property_set->propertyList[new_count - 1 - suffix]->name)
+        suffix++;
+
+    for (int i = 0; i < prefix + suffix; ++i) {
+        const int old_row = i < prefix ? i : old_count - prefix - suffix + i;
+        const Property *new_property = new_property_set->propertyList[i < prefix ? i : new_count - prefix - suffix + i];
+
+        if (property_set->propertyList[old_row]->value != new_property->value) {
+            property_set->propertyList[old_row]->value = new_property->value;
+            emit dataChanged(index(old_row, 1, parent_index), index(old_row, 1, parent_index));
         }
+    }
 
-        delete propertySetList[i];
+    if (old_count - prefix - suffix > 0) {
+        beginRemoveRows(parent_index, prefix, old_count - suffix - 1);
+
+        for (int i = prefix; i < old_count - suffix; ++i)
+            delete property_set->propertyList.takeAt(prefix);
+
+        endRemoveRows();
     }
 
-    propertySetList.clear();
+    if (new_count - prefix - suffix > 0) {
+        beginInsertRows(parent_index, prefix, new_count - suffix - 1);
+
+        for (int i = prefix; i < new_count - suffix; ++i)
+            property_set->propertyList.insert(i, new Property(*new_property_set->propertyList[i]));
+
+        endInsertRows();
+    }
+}
+
+bool PropertyTreeModel::isSamePropertySet(const PropertySet *first, const PropertySet *second)
+{
+    return first->displayedName == second->displayedName
+        && first->sourceFile == second->sourceFile
+        && first->sourceLineNumber == second->sourceLineNumber
+        && first->ruleIndex == second->ruleIndex
+        && first->baseElement == second->baseElement
+        && first->itIsInherited == second->itIsInherited
+        && first->itIsInlined == second->itIsInlined
+        && first->pseudoClassList == second->pseudoClassList;
+}
+
+PropertyTreeModel::PropertySet *PropertyTreeModel::copyPropertySet(const PropertySet *property_set)
+{
+    PropertySet *copy = new PropertySet(*property_set);
+
+    for (int i = 0; i < copy->propertyList.size(); ++i)
+        copy->propertyList[i] = new Property(*property_set->propertyList[i]);
+
+    return copy;
+}
+
+void PropertyTreeModel::deletePropertySet(PropertySet *property_set)
+{
+    foreach (Property *property, property_set->propertyList)
+        delete property;
+
+    delete property_set;
 }
 
 void PropertyTreeModel::buildElementProperties(Rocket::Core::Element* element, Rocket::Core::Element* primary_element)
@@ -167,6 +326,8 @@ void PropertyTreeModel::buildElementProperties(Rocket::Core::Element* element, R
     const Rocket::Core::Property* property;
     itWillBeInherited = false;
     futurePseudoClassList.clear();
+    buildingElement = element;
+    matchedRules.clear();
 
     while (element->IterateProperties(property_index, property_pseudo_classes, property_name, property)) {
         // Check that this property isn't overridden or just not inherited.
@@ -241,7 +402,7 @@ void PropertyTreeModel::buildProperties(const NamedPropertyList& properties)
             last_source_line = properties[i].second->source_line_number;
 
             currentPropertySet = new PropertySet();
-            propertySetList.push_back(currentPropertySet);
+            builtPropertySetList.push_back(currentPropertySet);
 
             if (itWillBeInherited) {
                 currentPropertySet->itIsInherited = true;
@@ -259,6 +420,7 @@ void PropertyTreeModel::buildProperties(const NamedPropertyList& properties)
             }
             else {
                 OpenedFile *opened_file;
+                const StyleSheet *style_sheet;
 
                 opened_file = Rockete::getInstance().getOpenedFile(last_source.CString(),true);
 
@@ -268,7 +430,15 @@ void PropertyTreeModel::buildProperties(const NamedPropertyList& properties)
                 if (currentPropertySet->sourceFile.endsWith(".rml")) // Compute offset in RML file.
                     currentPropertySet->sourceLineNumber += opened_file->findLineNumber("<style>");
 
-                if (opened_file) {
+                style_sheet = document->getStyleSheet(currentPropertySet->sourceFile);
+
+                if (style_sheet)
+                    currentPropertySet->ruleIndex = findRule(style_sheet, last_source_line);
+
+                if (currentPropertySet->ruleIndex != -1) {
+                    currentPropertySet->displayedName = style_sheet->getText(style_sheet->getRule(currentPropertySet->ruleIndex).selectorSpan).toString().simplified();
+                }
+                else if (opened_file) {
                     QString line_content = opened_file->getLine(currentPropertySet->sourceLineNumber);
 
                     line_content = line_content.trimmed();
@@ -296,6 +466,7 @@ void PropertyTreeModel::buildProperty(const Rocket::Core::String& name, const Ro
     new_property->value = property->ToString().CString();
     new_property->sourceLineNumber = currentPropertySet->sourceLineNumber;
     new_property->sourceFile = currentPropertySet->sourceFile;
+    new_property->ruleIndex = currentPropertySet->ruleIndex;
 
     if(currentPropertySet->sourceLineNumber != -1) {
         Q_ASSERT(currentPropertySet->sourceFile == property->source.CString());
@@ -303,3 +474,28 @@ void PropertyTreeModel::buildProperty(const Rocket::Core::String& name, const Ro
 
     currentPropertySet->propertyList.push_back(new_property);
 }
+
+// libRocket only reports the line of the rule a property comes from. The rules of the style
+// sheet that match the element are found once through its selector index, and the one opening
+// on that line is taken; the last, as it wins, when several do. Matching ignores pseudo-classes
+// and attribute selectors and takes every combinator for a descendant one, so it can differ
+// from libRocket's either way; when nothing is found the line alone decides.
+
+int PropertyTreeModel::findRule(const StyleSheet *style_sheet, const int line_number)
+{
+    QHash<const StyleSheet*, QVector<int> >::iterator matched_rules = matchedRules.find(style_sheet);
+
+    if (matched_rules == matchedRules.end()) {
+        matched_rules = matchedRules.insert(style_sheet, QVector<int>());
+        style_sheet->findMatchingProperties(matched_rules.value(), buildingElement);
+    }
+
+    for (int i = matched_rules.value().size() - 1; i >= 0; --i) {
+        const int rule_index = matched_rules.value()[i];
+
+        if (style_sheet->getLineNumber(style_sheet->getRule(rule_index).bodyStart) == line_number)
+            return rule_index;
+    }
+
+    return style_sheet->findRule(line_number);
+}
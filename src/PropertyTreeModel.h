@@ -5,6 +5,8 @@
 #include <QModelIndex>
 #include <QVariant>
 #include <QStringList>
+#include <QHash>
+#include <QVector>
 #include "RocketHelper.h"
 #include "OpenedDocument.h"
 
@@ -13,21 +15,25 @@ class PropertyTreeModel : public QAbstractItemModel
     Q_OBJECT
 
 public:
+    // ruleIndex is the rule of the source in the document's parsed style sheets, -1 when the
+    // source is not a linked style sheet.
     struct Property
     {
         QString name;
         QString value;
         QString sourceFile;
         int sourceLineNumber;
+        int ruleIndex;
     };
     struct PropertySet
     {
-        PropertySet() : itIsInherited(false), itIsInlined(false) {};
+        PropertySet() : ruleIndex(-1), itIsInherited(false), itIsInlined(false) {};
         QString displayedName;
         QString sourceFile;
         QString baseElement;
         QList<QString> pseudoClassList;
         int sourceLineNumber;
+        int ruleIndex;
         bool itIsInherited;
         bool itIsInlined;
         QList<Property*> propertyList;
@@ -49,13 +55,25 @@ private:
     typedef std::vector< NamedProperty > NamedPropertyList;
     typedef std::map< Rocket::Core::PseudoClassList, NamedPropertyList > NamedPropertyMap;
     void clearData();
+    void clearSnapshots();
+    void updatePropertySets(const QList<PropertySet*> &new_property_sets);
+    void updateProperties(const int set_row, const PropertySet *new_property_set);
+    static bool isSamePropertySet(const PropertySet *first, const PropertySet *second);
+    static PropertySet *copyPropertySet(const PropertySet *property_set);
+    static void deletePropertySet(PropertySet *property_set);
     void buildElementProperties(Rocket::Core::Element *element, Rocket::Core::Element *primary_element);
     void buildProperties(const NamedPropertyList &properties);
     void buildProperty(const Rocket::Core::String &name, const Rocket::Core::Property *property);
+    int findRule(const StyleSheet *style_sheet, const int line_number);
     OpenedDocument *document;
     Element *currentElement;
     QList<PropertySet*> propertySetList;
+    QList<PropertySet*> builtPropertySetList;
+    QHash<const Element*, QList<PropertySet*> > snapshots;
+    int snapshotGeneration;
     PropertySet *currentPropertySet;
+    Element *buildingElement;
+    QHash<const StyleSheet*, QVector<int> > matchedRules;
     bool itWillBeInherited;
     QString futureBaseName;
     QStringList futurePseudoClassList;
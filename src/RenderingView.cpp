@@ -105,6 +105,7 @@ void RenderingView::reloadDocument()
     currentDocument->rocketDocument = RocketHelper::loadDocumentFromMemory(currentDocument->toPlainText());
     currentDocument->rocketDocument->RemoveReference();
     currentDocument->rocketDocument->Show();
+    currentDocument->updateDependencies();
     repaint();
 }
 
@@ -4,18 +4,27 @@
 #include <Rocket/Core.h>
 #include "RocketSystem.h"
 #include "ActionManager.h"
-#include "ActionGroup.h"
 #include "ActionSetInlineProperty.h"
 #include <QString>
 #include "OpenedDocument.h"
 
+// Bumped whenever the styles of loaded elements may have changed, so that what was computed
+// from them can be dropped; element pointers of unloaded documents may also be reused.
+static int styleGeneration = 0;
+// Bumped whenever documents are unloaded, which frees their elements; loading frees nothing.
+static int documentGeneration = 0;
+
 RMLDocument * RocketHelper::loadDocumentFromMemory(const QString &file_content)
 {
+    invalidateStyles();
     return RocketSystem::getInstance().getContext()->LoadDocumentFromMemory(file_content.toUtf8().data());
 }
 
 void RocketHelper::unloadDocument(RMLDocument * rml_document)
 {
+    invalidateStyles();
+    documentGeneration++;
+    ActionManager::getInstance().forgetElements();
     RocketSystem::getInstance().getContext()->UnloadDocument(rml_document);
     Rocket::Core::Factory::ClearStyleSheetCache();
     RocketSystem::getInstance().getContext()->Update(); // force the actual unload instead of setting a flag
@@ -23,6 +32,9 @@ void RocketHelper::unloadDocument(RMLDocument * rml_document)
 
 void RocketHelper::unloadAllDocument()
 {
+    invalidateStyles();
+    documentGeneration++;
+    ActionManager::getInstance().forgetElements();
     RocketSystem::getInstance().getContext()->UnloadAllDocuments();
     Rocket::Core::Factory::ClearStyleSheetCache();
     RocketSystem::getInstance().getContext()->Update();
@@ -62,6 +74,28 @@ void RocketHelper::drawBoxAroundElement(Element *element, const Color4b &color)
     }
 }
 
+// Overrides the property on the live element only; the files are left as they are. The new value
+// keeps the origin of the one it replaces, so the property tree still lists it under its rule.
+
+void RocketHelper::setElementProperty(Element *element, const QString &property_name, const QString &property_value)
+{
+    const Rocket::Core::Property *current_property = element->GetProperty(property_name.toUtf8().data());
+    Rocket::Core::PropertyDictionary properties;
+    Rocket::Core::String source;
+    int source_line_number = 0;
+
+    if (current_property) {
+        source = current_property->source;
+        source_line_number = current_property->source_line_number;
+    }
+
+    if (!Rocket::Core::StyleSheetSpecification::ParsePropertyDeclaration(properties, property_name.toUtf8().data(), property_value.toUtf8().data(), source, source_line_number))
+        return;
+
+    for (Rocket::Core::PropertyMap::const_iterator it = properties.GetProperties().begin(); it != properties.GetProperties().end(); ++it)
+        element->SetProperty(it->first, it->second);
+}
+
 void RocketHelper::replaceInlinedProperty(Element *element,const QString &property_name, const QString &property_value)
 {
     QString properties;
@@ -167,12 +201,10 @@ void RocketHelper::incrementInlinedDimensions(OpenedDocument *document, Element
     if (height < 10)
         height = 10;
 
-    ActionGroup *actionGroup = new ActionGroup();
-
-    actionGroup->add(new ActionSetInlineProperty(document,element,"width", QString::number(width)));
-    actionGroup->add(new ActionSetInlineProperty(document,element,"height", QString::number(height)));
-
-    ActionManager::getInstance().applyNew(actionGroup);
+    ActionManager::getInstance().beginGroup();
+    ActionManager::getInstance().applyNew(new ActionSetInlineProperty(document,element,"width", QString::number(width)));
+    ActionManager::getInstance().applyNew(new ActionSetInlineProperty(document,element,"height", QString::number(height)));
+    ActionManager::getInstance().endGroup();
 }
 
 Vector2f RocketHelper::getBottomRightPosition(Element *element)
@@ -210,3 +242,18 @@ Element *RocketHelper::getElementUnderMouse()
 {
     return RocketSystem::getInstance().getContext()->GetHoverElement();
 }
+
+int RocketHelper::getStyleGeneration()
+{
+    return styleGeneration;
+}
+
+int RocketHelper::getDocumentGeneration()
+{
+    return documentGeneration;
+}
+
+void RocketHelper::invalidateStyles()
+{
+    styleGeneration++;
+}
@@ -18,6 +18,7 @@ public:
     static void unloadAllDocument();
     static void highlightElement(Element *element);
     static void drawBoxAroundElement(Element *element, const Color4b &color);
+    static void setElementProperty(Element *element, const QString &property_name, const QString &property_value);
     static void replaceInlinedProperty(Element *element, const QString &property_name, const QString &property_value);
     static void addInlinedProperty(Element *element, const QString &property_name, const QString &property_value);
     static void removeInlinedProperty(Element *element, const QString &property_name);
@@ -26,6 +27,9 @@ public:
     static Vector2f getBottomRightPosition(Element *element);
     static Vector2f getTopRightPosition(Element *element);
     static Element *getElementUnderMouse();
+    static int getStyleGeneration();
+    static int getDocumentGeneration();
+    static void invalidateStyles();
 };
 
 #endif
@@ -16,7 +16,8 @@
 RocketSystem::RocketSystem() :
     renderInterface(),
     context( 0 ), context_w( 0 ), context_h( 0 ),
-    eventListener( 0 )
+    eventListener( 0 ),
+    itHasLocalizationTags( false )
 {
     t.start();
 }
@@ -31,54 +32,107 @@ float RocketSystem::GetElapsedTime()
     return t.elapsed();
 }
 
+// Called by libRocket for every text node on every load, so strings without an opening tag
+// are rejected on the raw bytes, and translated strings are memoised until the language changes.
+
 int RocketSystem::TranslateString(Rocket::Core::String& translated, const Rocket::Core::String& input)
 {
-    QString
-        translated_string,
-        input_string;
-    
+    static const int kTranslationCacheMaximumSize = 8192;
+    QByteArray translated_string;
+    QHash<QByteArray, QByteArray>::const_iterator cached;
+    int opening_index;
+    int closing_index = 0;
+    int previous_end = 0;
+    bool it_is_translated = false;
+
     if(!LocalizationManagerInterface::hasInstance())
     {
         translated = input;
         return 0;
     }
 
+    if(!itHasLocalizationTags)
+    {
+        localizationOpeningTag = ProjectManager::getInstance().getLocalizationOpeningTag().toUtf8();
+        localizationClosingTag = ProjectManager::getInstance().getLocalizationClosingTag().toUtf8();
+        itHasLocalizationTags = true;
+    }
 
-    input_string = input.CString();
+    const QByteArray input_string = QByteArray::fromRawData(input.CString(), input.Length());
 
-    if(input_string.contains(ProjectManager::getInstance().getLocalizationOpeningTag()))
+    if(localizationOpeningTag.isEmpty() || (opening_index = input_string.indexOf(localizationOpeningTag)) == -1)
     {
-        QString localization_identifier;
-        int starting_index = input_string.indexOf(ProjectManager::getInstance().getLocalizationOpeningTag()) + ProjectManager::getInstance().getLocalizationOpeningTag().size();
-        
-        
-        int identifier_size = input_string.indexOf(ProjectManager::getInstance().getLocalizationClosingTag(),starting_index) - starting_index;
-
-        localization_identifier = input_string.mid(starting_index, identifier_size);
-        
-        translated_string = LocalizationManagerInterface::getInstance().getLocalizationForIdentifier(localization_identifier.trimmed());
-        
-        translated_string = input_string.replace(ProjectManager::getInstance().getLocalizationOpeningTag()+localization_identifier+ProjectManager::getInstance().getLocalizationClosingTag(), translated_string);
-
-        if(translated_string.isEmpty())
+        translated = input;
+        return 0;
+    }
+
+    cached = translationCache.constFind(input_string);
+
+    if(cached != translationCache.constEnd())
+    {
+        if(cached.value().isNull())
         {
-            printf("warning: could not find localization identifier \"%s\"\n", localization_identifier.toLatin1().data() );
             translated = input;
             return 0;
         }
-        else
+
+        translated = Rocket::Core::String(cached.value().constData(), cached.value().constData() + cached.value().size());
+        return 1;
+    }
+
+    for(; opening_index != -1; opening_index = input_string.indexOf(localizationOpeningTag, closing_index))
+    {
+        const int starting_index = opening_index + localizationOpeningTag.size();
+        QString localization_identifier;
+        QString localization;
+
+        closing_index = input_string.indexOf(localizationClosingTag, starting_index);
+
+        if(closing_index == -1)
+            break;
+
+        localization_identifier = QString::fromUtf8(input_string.constData() + starting_index, closing_index - starting_index).trimmed();
+        closing_index += localizationClosingTag.size();
+        localization = LocalizationManagerInterface::getInstance().getLocalizationForIdentifier(localization_identifier);
+
+        if(localization.isEmpty())
         {
-            translated = translated_string.toUtf8();
-            return 1;
+            printf("warning: could not find localization identifier \"%s\"\n", localization_identifier.toLatin1().data() );
+            continue;
         }
+
+        translated_string.append(input_string.constData() + previous_end, opening_index - previous_end);
+        translated_string.append(localization.toUtf8());
+        previous_end = closing_index;
+        it_is_translated = true;
     }
-    else
+
+    if(translationCache.size() >= kTranslationCacheMaximumSize)
+        translationCache.clear();
+
+    // fromRawData() does not own the bytes, the cache key must be a real copy.
+    const QByteArray key(input_string.constData(), input_string.size());
+
+    if(!it_is_translated)
     {
+        translationCache.insert(key, QByteArray());
         translated = input;
         return 0;
     }
 
-    
+    translated_string.append(input_string.constData() + previous_end, input_string.size() - previous_end);
+    translationCache.insert(key, translated_string);
+    translated = Rocket::Core::String(translated_string.constData(), translated_string.constData() + translated_string.size());
+
+    return 1;
+}
+
+// Must be called when the language, the string table or the project localization tags change.
+
+void RocketSystem::invalidateTranslations()
+{
+    translationCache.clear();
+    itHasLocalizationTags = false;
 }
 
 bool RocketSystem::initialize()
@@ -3,6 +3,8 @@
 
 #include <QString>
 #include <QTime>
+#include <QByteArray>
+#include <QHash>
 #include "RocketRenderInterface.h"
 #include <Rocket/Core/SystemInterface.h>
 #include "Rockete.h"
@@ -44,6 +46,7 @@ public:
     virtual float GetElapsedTime();
 
     virtual int TranslateString(Rocket::Core::String& translated, const Rocket::Core::String& input);
+    void invalidateTranslations();
 
 private:
 
@@ -63,6 +66,10 @@ private:
     int context_w, context_h;
     EventListener *eventListener;
     QTime t;
+    QByteArray localizationOpeningTag;
+    QByteArray localizationClosingTag;
+    bool itHasLocalizationTags;
+    QHash<QByteArray, QByteArray> translationCache;
     static RocketSystem * instance;
 
 };
@@ -34,6 +34,10 @@
 #include "QDLabel.h"
 #include "LocalizationManagerInterface.h"
 #include "OpenedLuaScript.h"
+#include "ProjectSearchIndex.h"
+#include "CompletionService.h"
+#include "FileWriter.h"
+#include "LatencyTracer.h"
 #include "qtplist/PListParser.h"
 
 const int kTexturePreviewTabIndex = 1;
@@ -109,7 +113,7 @@ void logMessageOutput( QtMsgType type, const QMessageLogContext &context, const
 
 
 Rockete::Rockete(QWidget *parent, Qt::WindowFlags flags)
-    : QMainWindow(parent, flags), isReloadingFile(false)
+    : QMainWindow(parent, flags), languageBox(NULL), languageBoxAction(NULL), isReloadingFile(false), projectSearchQuery(-1)
 {
     instance = this;
 
@@ -130,8 +134,8 @@ Rockete::Rockete(QWidget *parent, Qt::WindowFlags flags)
     ui.labelCuttingRightCapLabel->setAttribute(Qt::WA_MacSmallSize);
     ui.labelCuttingMask->setAttribute(Qt::WA_MacSmallSize);
     ui.checkBoxCuttingMask->setAttribute(Qt::WA_MacSmallSize);
-    ui.documentHierarchyTreeWidget->setAttribute(Qt::WA_MacSmallSize);
-    ui.documentHierarchyTreeWidget->setIndentation(15); // ui 10 is too small for osx
+    ui.documentHierarchyTreeView->setAttribute(Qt::WA_MacSmallSize);
+    ui.documentHierarchyTreeView->setIndentation(15); // ui 10 is too small for osx
     ui.splitter->setHandleWidth(4); // default 7 is bit too big
     ui.rightPaneSplitter->setHandleWidth(4);
     ui.leftPaneSplitter->setHandleWidth(4);
@@ -192,26 +196,17 @@ Rockete::Rockete(QWidget *parent, Qt::WindowFlags flags)
 
     attributeTreeModel = new AttributeTreeModel();
     propertyTreeModel = new PropertyTreeModel();
+    ui.propertyTreeView->setModel(propertyTreeModel);
 
-    if(LocalizationManagerInterface::hasInstance())
-    {
-        int langs = 0; foreach(LocalizationManagerInterface::LocalizationLanguage language, LocalizationManagerInterface::getInstance().getSupportedLanguages())
-        {
-            languageBox->addItem(LocalizationManagerInterface::getInstance().getLanguageNameForLanguage(language), (int)language); ++langs;
-        }
+    // The box is kept for the whole session and only shown when the project provides languages.
+    languageBox = new QComboBox(this);
+    languageBox->setEditable(false);
+    languageBox->setInsertPolicy( QComboBox::InsertAlphabetically );
 
-        if (langs) {
-            languageBox = new QComboBox(this);
-            languageBox->setEditable(false);
-            languageBox->setInsertPolicy( QComboBox::InsertAlphabetically );
-
-            connect(languageBox, SIGNAL(activated(const QString&)), (QObject*)this, SLOT(languageBoxActivated()));
-            ui.mainToolBar->addSeparator();
-            ui.mainToolBar->addWidget(languageBox);
-
-            ui.statusBar->showMessage( "Localization Activated", 10000 );
-        }
-    }
+    connect(languageBox, SIGNAL(activated(const QString&)), (QObject*)this, SLOT(languageBoxActivated()));
+    ui.mainToolBar->addSeparator();
+    languageBoxAction = ui.mainToolBar->addWidget(languageBox);
+    fillLanguageBox();
 
     QAction *new_action = new QAction(QIcon(":/images/new_button.png"), "create button", this);
     connect(new_action, SIGNAL(triggered()), (QObject*)this, SLOT(newButtonWizardActivated()));
@@ -282,7 +277,7 @@ Rockete::Rockete(QWidget *parent, Qt::WindowFlags flags)
     connect(fileWatcher, SIGNAL(fileChanged(const QString &)), (QObject*)this, SLOT(fileHasChanged(const QString &)));
 
     hierarchyEventFilter = new DocumentHierarchyEventFilter();
-    ui.documentHierarchyTreeWidget->viewport()->installEventFilter(hierarchyEventFilter);
+    ui.documentHierarchyTreeView->viewport()->installEventFilter(hierarchyEventFilter);
 
     ui.snippetsListWidget->initialize();
 
@@ -295,6 +290,19 @@ Rockete::Rockete(QWidget *parent, Qt::WindowFlags flags)
     QShortcut *triggerFind = new QShortcut(QKeySequence::Find, this);
     connect(triggerFind, SIGNAL(activated()), (QObject*)this, SLOT(findTriggered()));
 
+    QShortcut *triggerFindInProject = new QShortcut(QKeySequence("Ctrl+Shift+F"), this);
+    connect(triggerFindInProject, SIGNAL(activated()), (QObject*)this, SLOT(findInProjectTriggered()));
+
+    QShortcut *triggerJumpToSymbol = new QShortcut(QKeySequence("Ctrl+Shift+O"), this);
+    connect(triggerJumpToSymbol, SIGNAL(activated()), (QObject*)this, SLOT(jumpToSymbolTriggered()));
+
+    // project search:
+    connect(ui.projectSearchLineEdit, SIGNAL(returnPressed()), this, SLOT(projectSearchRequested()));
+    connect(ui.projectSearchResultsTreeWidget, SIGNAL(itemActivated(QTreeWidgetItem*, int)), this, SLOT(projectSearchResultActivated(QTreeWidgetItem*, int)));
+    connect(&ProjectSearchIndex::getInstance(), SIGNAL(resultFound(int, const QString &, int, int, const QString &)), this, SLOT(projectSearchResultFound(int, const QString &, int, int, const QString &)));
+    connect(&ProjectSearchIndex::getInstance(), SIGNAL(searchFinished(int, int, int)), this, SLOT(projectSearchFinished(int, int, int)));
+    connect(&ProjectSearchIndex::getInstance(), SIGNAL(indexingFinished(int)), this, SLOT(projectIndexingFinished(int)));
+
     // texture preview:
     connect(ui.texturePreviewLabel, SIGNAL(resizeLabel(QResizeEvent*)), (QObject*)this, SLOT(resizeTexturePreview(QResizeEvent*)));
 
@@ -313,6 +321,14 @@ Rockete::Rockete(QWidget *parent, Qt::WindowFlags flags)
     connect(ui.horizontalCuttingPreviewSize, SIGNAL(valueChanged(int)), (QObject*)this, SLOT(cuttingPrevSizeChanged(int)));
     connect(ui.checkBoxCuttingMask, SIGNAL(toggled(bool)), this, SLOT(cuttingMaskToggle(bool)));
 
+    connect(ui.diagnosticsListWidget, SIGNAL(itemActivated(QListWidgetItem*)), this, SLOT(diagnosticsItemActivated(QListWidgetItem*)));
+
+    // editor latency:
+    connect(&LatencyTracer::getInstance(), SIGNAL(traceEnded()), this, SLOT(latencyTraceEnded()));
+    connect(ui.bottomTabWidget, SIGNAL(currentChanged(int)), this, SLOT(latencyTraceEnded()));
+    connect(ui.latencyResetButton, SIGNAL(clicked()), this, SLOT(latencyResetClicked()));
+    connect(ui.latencyExportButton, SIGNAL(clicked()), this, SLOT(latencyExportClicked()));
+
     ui.searchReplaceDockWidget->hide();
 
     // set initial tab:
@@ -353,8 +369,6 @@ void Rockete::fillPropertyView()
     if(getCurrentDocument())
     {
         propertyTreeModel->setupData(getCurrentDocument(), getCurrentDocument()->selectedElement);
-        ui.propertyTreeView->reset();
-        ui.propertyTreeView->setModel(propertyTreeModel);
         ui.propertyTreeView->expandAll();
         ui.propertyTreeView->header()->setSectionResizeMode(0, QHeaderView::ResizeToContents);
         ui.propertyTreeView->header()->setSectionResizeMode(1, QHeaderView::Stretch);
@@ -380,24 +394,30 @@ void Rockete::selectElement(Element *element)
         fillAttributeView();
         fillPropertyView();
         
-        foreach(QTreeWidgetItem *item, ui.documentHierarchyTreeWidget->findItems(element->GetTagName().CString(), Qt::MatchRecursive))
+        QModelIndex index = getCurrentDocument()->getHierarchyModel()->getIndex(element);
+        if(index.isValid())
         {
-            if((Element *)item->data(0,Qt::UserRole).value<void*>() == element)
-            {
-                ui.documentHierarchyTreeWidget->setCurrentItem(item);
-                break;
-            }
+            ui.documentHierarchyTreeView->setCurrentIndex(index);
         }
     }
 }
 
 void Rockete::reloadCurrentDocument()
 {
+    // The document and its style sheets are read from disk.
+    for (int i = 0; i < ui.codeTabWidget->count(); ++i)
+    {
+        OpenedFile *file = qobject_cast<OpenedFile *>(ui.codeTabWidget->widget(i));
+        if (file)
+            file->flushScheduledSave();
+    }
+
+    FileWriter::getInstance().waitForDone();
+
     if (getCurrentDocument())
     {
         renderingView->reloadDocument();
-        selectedTreeViewItem = NULL;
-        getCurrentDocument()->populateHierarchyTreeView(ui.documentHierarchyTreeWidget);
+        getCurrentDocument()->populateHierarchyTreeView(ui.documentHierarchyTreeView, true);
     }
 }
 
@@ -492,6 +512,33 @@ void Rockete::setZoomLevel(float level)
     vertRuler->setRulerZoom(level);
 }
 
+void Rockete::fillDiagnosticsList(OpenedFile *file)
+{
+    const int tab_index = ui.bottomTabWidget->indexOf(ui.diagnosticsTab);
+
+    if (file != ui.codeTabWidget->currentWidget())
+        return;
+
+    ui.diagnosticsListWidget->clear();
+
+    if (!file || file->getDiagnostics().isEmpty())
+    {
+        ui.bottomTabWidget->setTabText(tab_index, "Diagnostics");
+        return;
+    }
+
+    foreach (const DocumentValidator::Diagnostic &diagnostic, file->getDiagnostics())
+    {
+        QListWidgetItem *item = new QListWidgetItem(QString("%1:%2: %3").arg(diagnostic.line + 1).arg(diagnostic.column + 1).arg(diagnostic.message));
+
+        item->setData(Qt::UserRole, diagnostic.line);
+        item->setData(Qt::UserRole + 1, diagnostic.column);
+        ui.diagnosticsListWidget->addItem(item);
+    }
+
+    ui.bottomTabWidget->setTabText(tab_index, QString("Diagnostics (%1)").arg(file->getDiagnostics().size()));
+}
+
 // Public slots:
 
 void Rockete::menuOpenClicked()
@@ -549,7 +596,18 @@ void Rockete::menuSaveClicked()
     Q_ASSERT(file);
 
     file->save();
-    ui.codeTabWidget->setTabText(ui.codeTabWidget->currentIndex(), file->fileInfo.fileName());
+    fileSaved(file);
+}
+
+void Rockete::fileSaved(OpenedFile *file)
+{
+    updateTabText(file);
+
+    // Style sheets and templates the displayed document does not use cannot change its rendering.
+    if (getCurrentDocument() && file != getCurrentDocument() && !getCurrentDocument()->getDependencies().dependsOn(file->fileInfo.fileName())
+        && (file->fileInfo.suffix() == "rcss" || file->fileInfo.suffix() == "rml"))
+        return;
+
     reloadCurrentDocument();
 }
 
@@ -563,7 +621,9 @@ void Rockete::menuSaveAsClicked()
     Q_ASSERT(file);
     QString file_path = QFileDialog::getSaveFileName( this, tr( "Save as..." ), "", tr("libRocket Markup Language (*.rml);;libRocket CSS (*.rcss)") );
 
-    file->saveAs(file_path);
+    if(file_path.isEmpty() || !file->saveAs(file_path))
+        return;
+
     openFile(file_path);
 }
 
@@ -583,6 +643,8 @@ void Rockete::codeTextChanged()
 
 void Rockete::codeTabChanged( int index )
 {
+    fillDiagnosticsList(qobject_cast<OpenedFile *>(ui.codeTabWidget->widget(index)));
+
     if(index < 0 || isReloadingFile)
     {
         return;
@@ -594,8 +656,7 @@ void Rockete::codeTabChanged( int index )
         if(document != getCurrentDocument())
         {
             renderingView->changeCurrentDocument(document);
-            selectedTreeViewItem = NULL;
-            getCurrentDocument()->populateHierarchyTreeView(ui.documentHierarchyTreeWidget);
+            getCurrentDocument()->populateHierarchyTreeView(ui.documentHierarchyTreeView);
         }
     }
 
@@ -626,7 +687,11 @@ void Rockete::codeTabRequestClose(int index)
     }
 
     if(response==QMessageBox::Yes)
-        closeTab(index,true);
+    {
+        // The tab stays open when it could not be saved.
+        if(!closeTab(index,true) && !changed_outside.isEmpty())
+            fileChangedOutsideArray[index] = changed_outside;
+    }
     else if(response==QMessageBox::No)
         closeTab(index,false);
 }
@@ -758,12 +823,14 @@ void Rockete::menuUndoClicked()
 {
     ActionManager::getInstance().applyPrevious();
     fillAttributeView();
+    fillPropertyView();
 }
 
 void Rockete::menuRedoClicked()
 {
     ActionManager::getInstance().applyNext();
     fillAttributeView();
+    fillPropertyView();
 }
 
 void Rockete::menuReloadAssetsClicked()
@@ -777,6 +844,8 @@ void Rockete::menuReloadAssetsClicked()
             document->selectedElement = NULL;
             document->rocketDocument = RocketHelper::loadDocumentFromMemory(document->toPlainText());
             document->rocketDocument->RemoveReference();
+            document->updateDependencies();
+            document->updateHierarchyModel();
         }
     }
 }
@@ -786,18 +855,10 @@ void Rockete::menuFormatTextClicked()
     if(ui.codeTabWidget->count()==0)
         return;
 
-    QDomDocument dom_document;
     OpenedFile *file = qobject_cast<OpenedFile *>(ui.codeTabWidget->currentWidget());
     Q_ASSERT(file);
 
-    if (!file->fileInfo.fileName().contains("rml"))
-    {
-        return;
-    }
-
-    dom_document.setContent(file->toPlainText());
-    QString reformatted_content = dom_document.toString(Settings::getTabSize());
-    file->setTextEditContent(reformatted_content, true);
+    file->format();
 }
 
 void Rockete::propertyViewClicked(const QModelIndex &/*index*/)
@@ -844,7 +905,11 @@ void Rockete::menuBackgroundChangeImage()
 void Rockete::languageBoxActivated()
 {
     if(LocalizationManagerInterface::hasInstance())
+    {
         LocalizationManagerInterface::getInstance().setLanguage((LocalizationManagerInterface::LocalizationLanguage)languageBox->itemData(languageBox->currentIndex()).toInt());
+        RocketSystem::getInstance().invalidateTranslations();
+        reloadCurrentDocument();
+    }
 }
 
 void Rockete::newButtonWizardActivated()
@@ -1088,14 +1153,18 @@ void Rockete::cuttingPreviewTabChange(int tab)
         labelCuttingMask->hide();
 }
 
-void Rockete::documentHierarchyDoubleClicked(QTreeWidgetItem *item, int/* column*/)
+void Rockete::documentHierarchyDoubleClicked(const QModelIndex &index)
 {
     QString elementId;
-    QTreeWidgetItem *nextItem = NULL;
+    QModelIndex nextIndex;
     int parentCount = 0;
     QStringList rcssList;
+    DocumentHierarchyModel *hierarchyModel = getCurrentDocument()->getHierarchyModel();
+    const QString tagName = index.sibling(index.row(), 0).data().toString();
+    const QString idName = index.sibling(index.row(), 1).data().toString();
+    const QString className = index.sibling(index.row(), 2).data().toString();
 
-    selectElement((Element *)item->data(0,Qt::UserRole).value<void*>());
+    selectElement(hierarchyModel->getElement(index));
     rcssList = getCurrentDocument()->getRCSSFileList();
 
     if(hierarchyEventFilter->ShiftPressed)
@@ -1107,20 +1176,20 @@ void Rockete::documentHierarchyDoubleClicked(QTreeWidgetItem *item, int/* column
         ui.statusBar->clearMessage();
 
         // "full" definition by id
-        if(!item->text(1).isEmpty())
+        if(!idName.isEmpty())
         {
-            string_to_find = item->text(0);
+            string_to_find = tagName;
             string_to_find += "#";
-            string_to_find += item->text(1);
+            string_to_find += idName;
 
             strings_to_find << string_to_find;
         }
 
         // specific definition by class
-        if(!item->text(2).isEmpty())
+        if(!className.isEmpty())
         {
-            foreach(QString rcss_class, item->text(2).split(' ')){
-                string_to_find = item->text(0);
+            foreach(QString rcss_class, className.split(' ')){
+                string_to_find = tagName;
                 string_to_find += ".";
                 string_to_find += rcss_class;
 
@@ -1129,9 +1198,9 @@ void Rockete::documentHierarchyDoubleClicked(QTreeWidgetItem *item, int/* column
         }
 
         // class definition
-        if(!item->text(2).isEmpty())
+        if(!className.isEmpty())
         {
-            foreach(QString rcss_class, item->text(2).split(' ')){
+            foreach(QString rcss_class, className.split(' ')){
                 string_to_find = ".";
                 string_to_find += rcss_class;
 
@@ -1140,7 +1209,7 @@ void Rockete::documentHierarchyDoubleClicked(QTreeWidgetItem *item, int/* column
         }
 
         // tag definition
-        strings_to_find << item->text(0);
+        strings_to_find << tagName;
 
         foreach(QString search_string, strings_to_find) {
             foreach (QString file, rcssList) {
@@ -1170,17 +1239,14 @@ void Rockete::documentHierarchyDoubleClicked(QTreeWidgetItem *item, int/* column
     getCurrentDocument()->setTextCursor(cursor);
     ui.codeTabWidget->setCurrentIndex(getTabIndexFromFileName(getCurrentDocument()->fileInfo.fileName().toUtf8().data()));
 
-    if(selectedTreeViewItem)
-    {
-        selectedTreeViewItem->setTextColor(0, QColor::fromRgb(0,0,0));
-    }
+    hierarchyModel->setHighlightedIndex(QModelIndex());
 
-    nextItem = item;
+    nextIndex = index.sibling(index.row(), 0);
     do 
     {
-        elementId = nextItem->text(1);
+        elementId = nextIndex.sibling(nextIndex.row(), 1).data().toString();
         
-        if(elementId.isEmpty() && ( !nextItem->parent()))
+        if(elementId.isEmpty() && ( !nextIndex.parent().isValid()))
         {
             ui.statusBar->showMessage( "No ID", 3000 );
             return;
@@ -1188,7 +1254,7 @@ void Rockete::documentHierarchyDoubleClicked(QTreeWidgetItem *item, int/* column
         
         if(elementId.isEmpty())
         {
-            nextItem = nextItem->parent();
+            nextIndex = nextIndex.parent();
         }
 
         parentCount++;
@@ -1205,8 +1271,7 @@ void Rockete::documentHierarchyDoubleClicked(QTreeWidgetItem *item, int/* column
         return;
     }
 
-    selectedTreeViewItem = nextItem;
-    selectedTreeViewItem->setTextColor(0, QColor::fromRgb(0,255,0));
+    hierarchyModel->setHighlightedIndex(nextIndex);
 
     if(parentCount>1)
     {
@@ -1219,8 +1284,21 @@ void Rockete::documentHierarchyDoubleClicked(QTreeWidgetItem *item, int/* column
 void Rockete::fileHasChanged(const QString &path)
 {
     QFileInfo file_info = path;
-    int tab_index = getTabIndexFromFileName(file_info.fileName().toUtf8().data());
-    fileChangedOutsideArray[tab_index] = path;
+    int tab_index;
+
+    if (FileWriter::getInstance().isOwnWrite(path))
+    {
+        // Saving replaces the file, which drops it from the watcher.
+        if (file_info.exists() && !fileWatcher->files().contains(path))
+            fileWatcher->addPath(path);
+
+        return;
+    }
+
+    tab_index = getTabIndexFromFileName(file_info.fileName().toUtf8().data());
+
+    if (tab_index >= 0)
+        fileChangedOutsideArray[tab_index] = path;
 }
 
 void Rockete::findTriggered()
@@ -1238,45 +1316,8 @@ void Rockete::findPreviousTriggered()
     OpenedFile *file = qobject_cast<OpenedFile *>(ui.codeTabWidget->currentWidget());
     Q_ASSERT(file);
 
-    bool found_string;
-
-    file->highlightString(ui.searchComboBox->currentText());
-
-    if(!ui.searchComboBox->currentText().isEmpty())
-    {
-        if(ui.matchCaseCheckBox->isChecked())
-        {
-            found_string = file->find(ui.searchComboBox->currentText(), QTextDocument::FindBackward | QTextDocument::FindCaseSensitively);
-        }
-        else
-        {
-            found_string = file->find(ui.searchComboBox->currentText(), QTextDocument::FindBackward);
-        }
-    }
-    else
-    {
-        return;
-    }
-
-    if(!found_string)
-    {
-        QTextCursor previousCursor = file->textCursor();
-        QTextCursor findCursor = file->textCursor();
-        findCursor.movePosition(QTextCursor::End);
-        file->setTextCursor(findCursor);
-
-        if(ui.matchCaseCheckBox->isChecked())
-        {
-            found_string = file->find(ui.searchComboBox->currentText(), QTextDocument::FindBackward | QTextDocument::FindCaseSensitively);
-        }
-        else
-        {
-            found_string = file->find(ui.searchComboBox->currentText(), QTextDocument::FindBackward);
-        }
-
-        if(!found_string)
-            file->setTextCursor(previousCursor);
-    }
+    file->setSearchPattern(ui.searchComboBox->currentText(), ui.matchCaseCheckBox->isChecked(), ui.regularExpressionCheckBox->isChecked());
+    file->findNextMatch(true);
 }
 
 void Rockete::findNextTriggered()
@@ -1287,44 +1328,8 @@ void Rockete::findNextTriggered()
     OpenedFile *file = qobject_cast<OpenedFile *>(ui.codeTabWidget->currentWidget());
     Q_ASSERT(file);
 
-    bool found_string;
-    file->highlightString(ui.searchComboBox->currentText());
-
-    if(!ui.searchComboBox->currentText().isEmpty())
-    {
-        if(ui.matchCaseCheckBox->isChecked())
-        {
-            found_string = file->find(ui.searchComboBox->currentText(), QTextDocument::FindCaseSensitively);
-        }
-        else
-        {
-            found_string = file->find(ui.searchComboBox->currentText());
-        }
-    }
-    else
-    {
-        return;
-    }
-
-    if(!found_string)
-    {
-        QTextCursor previousCursor = file->textCursor();
-        QTextCursor findCursor = file->textCursor();
-        findCursor.setPosition(0);
-        file->setTextCursor(findCursor);
-
-        if(ui.matchCaseCheckBox->isChecked())
-        {
-            found_string = file->find(ui.searchComboBox->currentText(), QTextDocument::FindCaseSensitively);
-        }
-        else
-        {
-            found_string = file->find(ui.searchComboBox->currentText());
-        }
-
-        if(!found_string)
-            file->setTextCursor(previousCursor);
-    }
+    file->setSearchPattern(ui.searchComboBox->currentText(), ui.matchCaseCheckBox->isChecked(), ui.regularExpressionCheckBox->isChecked());
+    file->findNextMatch();
 }
 
 void Rockete::replaceTriggered()
@@ -1335,52 +1340,48 @@ void Rockete::replaceTriggered()
     OpenedFile *file = qobject_cast<OpenedFile *>(ui.codeTabWidget->currentWidget());
     Q_ASSERT(file);
 
-    if(file->textCursor().hasSelection())
-    {
-        file->textCursor().insertText(ui.replaceComboBox->currentText());
-    }
+    file->setSearchPattern(ui.searchComboBox->currentText(), ui.matchCaseCheckBox->isChecked(), ui.regularExpressionCheckBox->isChecked());
+    file->replaceSelectedMatch(ui.replaceComboBox->currentText());
 
     checkTextChanged(-1);
 
     // return; here to behave like a "real" replace instead of a "replace & find"
 
-    if(!file->find(ui.searchComboBox->currentText(),(ui.matchCaseCheckBox->isChecked() ? QTextDocument::FindCaseSensitively : (QTextDocument::FindFlags)0 )) &&
-        file->find(ui.searchComboBox->currentText(), QTextDocument::FindBackward | (ui.matchCaseCheckBox->isChecked() ? QTextDocument::FindCaseSensitively : (QTextDocument::FindFlags)0 )) )
-    { // reached end of file but there are more text to find
-        QTextCursor findCursor = file->textCursor();
-        findCursor.setPosition(0);
-        file->setTextCursor(findCursor);
-        file->find(ui.searchComboBox->currentText(),(ui.matchCaseCheckBox->isChecked() ? QTextDocument::FindCaseSensitively : (QTextDocument::FindFlags)0 ));
-    }
+    file->findNextMatch();
 }
 
 void Rockete::replaceAllTriggered()
 {
+    int match_count;
+
     if(ui.codeTabWidget->count()==0)
         return;
 
     OpenedFile *file = qobject_cast<OpenedFile *>(ui.codeTabWidget->currentWidget());
     Q_ASSERT(file);
 
-    file->textCursor().beginEditBlock();
-    while (file->find(ui.searchComboBox->currentText(),(ui.matchCaseCheckBox->isChecked() ? QTextDocument::FindCaseSensitively : (QTextDocument::FindFlags)0 )) ||
-            file->find(ui.searchComboBox->currentText(), QTextDocument::FindBackward | (ui.matchCaseCheckBox->isChecked() ? QTextDocument::FindCaseSensitively : (QTextDocument::FindFlags)0 )))
+    file->setSearchPattern(ui.searchComboBox->currentText(), ui.matchCaseCheckBox->isChecked(), ui.regularExpressionCheckBox->isChecked());
+    match_count = file->countMatches();
+
+    if(match_count == 0)
     {
-        if(file->textCursor().hasSelection())
-        {
-            file->textCursor().insertText(ui.replaceComboBox->currentText());
-        }
+        QMessageBox::information(this, "Replace All", "No occurrence found.");
+        return;
     }
-    file->textCursor().endEditBlock();
+
+    if(QMessageBox::question(this, "Please confirm", QString("Replace %1 occurrence(s) in %2?").arg(match_count).arg(file->fileInfo.fileName()), QMessageBox::Yes, QMessageBox::Cancel) != QMessageBox::Yes)
+        return;
+
+    file->replaceAllMatches(ui.replaceComboBox->currentText());
     checkTextChanged(-1);
 }
 
 void Rockete::replaceAllInAllTriggered()
 {
-    if(ui.codeTabWidget->count()==0)
-        return;
+    int match_count = 0;
+    int file_count = 0;
 
-    if(QMessageBox::question(this,"Please confirm", "Are you sure?", QMessageBox::Yes, QMessageBox::Cancel) != QMessageBox::Yes)
+    if(ui.codeTabWidget->count()==0)
         return;
 
     for(int i = 0; i < ui.codeTabWidget->count(); i++)
@@ -1388,17 +1389,30 @@ void Rockete::replaceAllInAllTriggered()
         OpenedFile *file = qobject_cast<OpenedFile *>(ui.codeTabWidget->widget(i));
         Q_ASSERT(file);
 
-        file->textCursor().beginEditBlock();
-        while (file->find(ui.searchComboBox->currentText(),(ui.matchCaseCheckBox->isChecked() ? QTextDocument::FindCaseSensitively : (QTextDocument::FindFlags)0 )) ||
-            file->find(ui.searchComboBox->currentText(), QTextDocument::FindBackward | (ui.matchCaseCheckBox->isChecked() ? QTextDocument::FindCaseSensitively : (QTextDocument::FindFlags)0 )))
+        file->setSearchPattern(ui.searchComboBox->currentText(), ui.matchCaseCheckBox->isChecked(), ui.regularExpressionCheckBox->isChecked());
+
+        if(int file_match_count = file->countMatches())
         {
-            if(file->textCursor().hasSelection())
-            {
-                file->textCursor().insertText(ui.replaceComboBox->currentText());
-            }
+            match_count += file_match_count;
+            file_count++;
         }
-        file->textCursor().endEditBlock();
-        checkTextChanged(i);
+    }
+
+    if(match_count == 0)
+    {
+        QMessageBox::information(this, "Replace All In All Files", "No occurrence found.");
+        return;
+    }
+
+    if(QMessageBox::question(this, "Please confirm", QString("Replace %1 occurrence(s) in %2 file(s)?").arg(match_count).arg(file_count), QMessageBox::Yes, QMessageBox::Cancel) != QMessageBox::Yes)
+        return;
+
+    for(int i = 0; i < ui.codeTabWidget->count(); i++)
+    {
+        OpenedFile *file = qobject_cast<OpenedFile *>(ui.codeTabWidget->widget(i));
+
+        if(file->replaceAllMatches(ui.replaceComboBox->currentText()) > 0)
+            checkTextChanged(i);
     }
 }
 
@@ -1450,6 +1464,134 @@ void Rockete::snippetsListDoubleClicked(QListWidgetItem *item)
     openFile(((CodeSnippet *)item->data(Qt::UserRole).value<void*>())->FilePath);
 }
 
+void Rockete::diagnosticsItemActivated(QListWidgetItem *item)
+{
+    OpenedFile *file = qobject_cast<OpenedFile *>(ui.codeTabWidget->currentWidget());
+
+    if (file)
+        goToLine(file, item->data(Qt::UserRole).toInt(), item->data(Qt::UserRole + 1).toInt());
+}
+
+void Rockete::findInProjectTriggered()
+{
+    ui.bottomTabWidget->setCurrentWidget(ui.projectSearchTab);
+    ui.projectSearchLineEdit->setFocus(Qt::OtherFocusReason);
+    ui.projectSearchLineEdit->selectAll();
+}
+
+void Rockete::jumpToSymbolTriggered()
+{
+    OpenedFile *file = qobject_cast<OpenedFile *>(ui.codeTabWidget->currentWidget());
+
+    if (file)
+        file->showSymbolPopup();
+}
+
+void Rockete::projectSearchRequested()
+{
+    ui.projectSearchResultsTreeWidget->clear();
+
+    if (ui.projectSearchLineEdit->text().isEmpty())
+    {
+        ProjectSearchIndex::getInstance().cancelSearch();
+        projectSearchQuery = -1;
+        ui.projectSearchStatusLabel->clear();
+        return;
+    }
+
+    projectSearchQuery = ProjectSearchIndex::getInstance().search(ui.projectSearchLineEdit->text(), ui.projectSearchMatchCaseCheckBox->isChecked(), ui.projectSearchRegularExpressionCheckBox->isChecked());
+    ui.projectSearchStatusLabel->setText("Searching...");
+}
+
+void Rockete::projectSearchResultFound(int query, const QString &file_path, int line, int column, const QString &line_text)
+{
+    QTreeWidgetItem *item;
+
+    if (query != projectSearchQuery)
+        return;
+
+    item = new QTreeWidgetItem(ui.projectSearchResultsTreeWidget);
+    item->setText(0, QFileInfo(file_path).fileName());
+    item->setToolTip(0, file_path);
+    item->setText(1, QString::number(line + 1));
+    item->setText(2, line_text);
+    item->setData(0, Qt::UserRole, file_path);
+    item->setData(1, Qt::UserRole, line);
+    item->setData(2, Qt::UserRole, column);
+}
+
+void Rockete::projectSearchFinished(int query, int match_count, int file_count)
+{
+    if (query != projectSearchQuery)
+        return;
+
+    ui.projectSearchStatusLabel->setText(QString("%1 match(es) in %2 file(s)").arg(match_count).arg(file_count));
+}
+
+void Rockete::projectIndexingFinished(int file_count)
+{
+    if (projectSearchQuery == -1)
+        ui.projectSearchStatusLabel->setText(QString("%1 file(s) indexed").arg(file_count));
+}
+
+void Rockete::projectSearchResultActivated(QTreeWidgetItem *item, int /*column*/)
+{
+    const int tab_index = openFile(item->data(0, Qt::UserRole).toString());
+    OpenedFile *file;
+
+    if (tab_index < 0)
+        return;
+
+    if ((file = qobject_cast<OpenedFile *>(ui.codeTabWidget->widget(tab_index))))
+        goToLine(file, item->data(1, Qt::UserRole).toInt(), item->data(2, Qt::UserRole).toInt());
+}
+
+// The table is only filled while the latency tab is shown.
+
+void Rockete::latencyTraceEnded()
+{
+    if (ui.bottomTabWidget->currentWidget() != ui.latencyTab)
+        return;
+
+    ui.latencyTreeWidget->clear();
+
+    for (int bucket = 0; bucket < LatencyTracer::SizeBucketCount; ++bucket)
+    {
+        for (int phase = 0; phase < LatencyTracer::PhaseCount; ++phase)
+        {
+            const LatencyTracer::Percentiles percentiles = LatencyTracer::getInstance().getPercentiles((LatencyTracer::SizeBucket)bucket, (LatencyTracer::Phase)phase);
+            QTreeWidgetItem *item;
+
+            if (percentiles.count == 0)
+                continue;
+
+            item = new QTreeWidgetItem(ui.latencyTreeWidget);
+            item->setText(0, LatencyTracer::getSizeBucketName((LatencyTracer::SizeBucket)bucket));
+            item->setText(1, LatencyTracer::getPhaseName((LatencyTracer::Phase)phase));
+            item->setText(2, QString::number(percentiles.count));
+            item->setText(3, QString::number(percentiles.p50));
+            item->setText(4, QString::number(percentiles.p95));
+            item->setText(5, QString::number(percentiles.p99));
+        }
+    }
+}
+
+void Rockete::latencyResetClicked()
+{
+    LatencyTracer::getInstance().reset();
+}
+
+void Rockete::latencyExportClicked()
+{
+    const QString file_path = QFileDialog::getSaveFileName(this, tr("Export latency..."), "", tr("CSV file (*.csv)"));
+
+    if (file_path.isEmpty())
+        return;
+
+    if (!LatencyTracer::getInstance().exportCsv(file_path))
+        QMessageBox::warning(this, "Rockete: export failed", file_path + " could not be written.");
+}
+
 // Protected:
 
 void Rockete::keyPressEvent(QKeyEvent *event)
@@ -1521,16 +1663,18 @@ void Rockete::closeEvent(QCloseEvent *event)
             response = QMessageBox::Yes;
         }
 
-        if(response==QMessageBox::Yes)
-            closeTab(0, true);
-        else if(response==QMessageBox::No)
+        if(response==QMessageBox::No)
             closeTab(0, false);
-        else
+        else if(response!=QMessageBox::Yes || !closeTab(0, true))
         {
+            // Cancelled, or the file could not be saved.
             event->ignore();
             return;
         }
     }
+
+    FileWriter::getInstance().waitForDone();
+    ProjectSearchIndex::getInstance().shutdown();
     
     event->accept();
 
@@ -1547,6 +1691,10 @@ int Rockete::openFile(const QString &filePath)
 
     if(filePath.contains("memory]")) //librocket name for files in memory is [document in memory] since its not opened in the tabs it tries to open it...
         return -1;
+
+    // A file just saved may still be in the writer queue.
+    FileWriter::getInstance().waitForDone();
+
     if(file_info.suffix() == "rproj") {
         openProject(file_info.absolutePath().toUtf8().constData());
         return -1;
@@ -1630,6 +1778,19 @@ int Rockete::openFile(const QString &filePath)
     return -1;
 }
 
+void Rockete::updateTabText(OpenedFile *file)
+{
+    const int tab_index = ui.codeTabWidget->indexOf(file);
+
+    if (tab_index < 0)
+        return;
+
+    if (file->document()->isModified())
+        ui.codeTabWidget->setTabText(tab_index, "*" + file->fileInfo.fileName());
+    else
+        ui.codeTabWidget->setTabText(tab_index, file->fileInfo.fileName());
+}
+
 void Rockete::checkTextChanged(int index)
 {
     if(ui.codeTabWidget->count()==0)
@@ -1647,7 +1808,7 @@ void Rockete::checkTextChanged(int index)
         QString tab_text = ui.codeTabWidget->tabText(index);
         if (!tab_text.startsWith("*"))
         {
-            ui.codeTabWidget->setTabText(ui.codeTabWidget->currentIndex(), "*" + tab_text);
+            ui.codeTabWidget->setTabText(index, "*" + tab_text);
         }
     }
 }
@@ -1690,6 +1851,7 @@ void Rockete::newProject()
 void Rockete::openProject(const char *file_path, bool restart)
 {
     QFileInfo file_info(file_path);
+    QStringList sprite_names;
 
     if (file_info.suffix() == "rproj")
     {
@@ -1697,6 +1859,9 @@ void Rockete::openProject(const char *file_path, bool restart)
         if (!ProjectManager::getInstance().Initialize(file_path))
             return; // no file or wrong file
 
+        RocketSystem::getInstance().invalidateTranslations();
+        fillLanguageBox();
+
         ui.projectFilesTreeWidget->clear();
         ui.projectFilesTreeWidget->clear();
         texturesAtlasInf.clear();
@@ -1723,6 +1888,15 @@ void Rockete::openProject(const char *file_path, bool restart)
         populateTreeView("Word Lists", ProjectManager::getInstance().getWordListPath());
         populateTreeView("Snippets", ProjectManager::getInstance().getSnippetsFolderPath());
 
+        ProjectSearchIndex::getInstance().setProject(ProjectManager::getInstance().getInterfacePaths() + ProjectManager::getInstance().getTexturePaths() + QStringList(ProjectManager::getInstance().getSnippetsFolderPath()), projectFile);
+
+        foreach(const QString &atlas_filename, texturesAtlasInf.keys())
+            sprite_names << texturesAtlasInf[atlas_filename].keys();
+
+        CompletionService::getInstance().loadWordLists(ProjectManager::getInstance().getWordListPath());
+        CompletionService::getInstance().setSpriteNames(sprite_names);
+        CompletionService::getInstance().setProject(ProjectManager::getInstance().getInterfacePaths());
+
         if (!texturesAtlasInf.isEmpty())
             if(updateTextureInfoFiles() && !restart)
                 // reload project if files has been created
@@ -1756,6 +1930,7 @@ int Rockete::openDocument(const char *file_path)
     new_document->initialize();
     new_document->rocketDocument = RocketHelper::loadDocumentFromMemory(new_document->toPlainText());
     new_document->rocketDocument->RemoveReference();
+    new_document->updateDependencies();
 
     return ui.codeTabWidget->addTab(new_document, file_info.fileName());
 }
@@ -2356,19 +2531,47 @@ void Rockete::loadPlugins()
     }
 }
 
-void Rockete::closeTab(int index, bool must_save)
+void Rockete::fillLanguageBox()
 {
-    if(ui.codeTabWidget->count()==0)
+    if (!languageBox)
         return;
 
+    languageBox->clear();
+
+    if(LocalizationManagerInterface::hasInstance())
+    {
+        foreach(LocalizationManagerInterface::LocalizationLanguage language, LocalizationManagerInterface::getInstance().getSupportedLanguages())
+        {
+            languageBox->addItem(LocalizationManagerInterface::getInstance().getLanguageNameForLanguage(language), (int)language);
+        }
+    }
+
+    languageBoxAction->setVisible(languageBox->count() > 0);
+
+    if (languageBox->count() > 0)
+    {
+        LocalizationManagerInterface::getInstance().setLanguage((LocalizationManagerInterface::LocalizationLanguage)languageBox->itemData(languageBox->currentIndex()).toInt());
+        ui.statusBar->showMessage( "Localization Activated", 10000 );
+    }
+}
+
+// Returns false, leaving the tab open, when the file had to be saved and could not be; the save
+// is done at once, as the tab will not be there to hear of a failed write.
+
+bool Rockete::closeTab(int index, bool must_save)
+{
+    if(ui.codeTabWidget->count()==0)
+        return true;
+
     QWidget *removed_widget = ui.codeTabWidget->widget(index);
     OpenedFile *file = qobject_cast<OpenedFile *>(removed_widget);
     OpenedDocument *doc = qobject_cast<OpenedDocument *>(removed_widget);
 
     Q_ASSERT(file);
 
-    if(must_save)
-        file->save();
+    if(must_save && !file->saveNow())
+        return false;
+
     qInfo("removing path: %s\n", file->fileInfo.filePath().toUtf8().data());
     fileChangedOutsideArray.remove(index);
     fileWatcher->removePath(file->fileInfo.filePath());
@@ -2377,13 +2580,18 @@ void Rockete::closeTab(int index, bool must_save)
     {
         if(getCurrentDocument() && getCurrentDocument()->rocketDocument == doc->rocketDocument)
         {
-            ui.documentHierarchyTreeWidget->clear();
+            ui.documentHierarchyTreeView->setModel(NULL);
             renderingView->changeCurrentDocument(NULL);
         }
 
         RocketHelper::unloadDocument(doc->rocketDocument);
+
+        // What the history holds may point into the document.
+        ActionManager::getInstance().clear();
     }
     delete(removed_widget);
+
+    return true;
 }
 
 void Rockete::addRulers()
@@ -2427,4 +2635,19 @@ void Rockete::logHtmlMessage(QString aMsg)
                 ui.logWindow->append(aMsg);
 }
 
+void Rockete::goToLine(OpenedFile *file, const int line, const int column)
+{
+    QTextBlock block = file->document()->findBlockByNumber(line);
+    QTextCursor cursor;
+
+    if (!block.isValid())
+        return;
+
+    cursor = QTextCursor(block);
+    cursor.setPosition(block.position() + qMin(column, block.length() - 1));
+    file->setTextCursor(cursor);
+    file->centerCursor();
+    file->setFocus();
+}
+
 Rockete *Rockete::instance = NULL;
@@ -74,6 +74,8 @@ public:
     void fillPropertyView();
     void selectElement(Element *element);
     void reloadCurrentDocument();
+    void fileSaved(OpenedFile *file);
+    void updateTabText(OpenedFile *file);
     int getTabIndexFromFileName(const char * name); // TODO: clean up this... its a bit dirty. At least use full path.
     OpenedDocument *getCurrentTabDocument(int index = -1);
     OpenedStyleSheet *getCurrentTabStyleSheet(int index = -1);
@@ -89,6 +91,7 @@ public:
     SnippetsManager *getSnippetsManager(){return ui.snippetsListWidget;}
 
     void logMessage(QString aMsg);
+    void fillDiagnosticsList(OpenedFile *file);
 
 public slots:
     void menuOpenClicked();
@@ -119,7 +122,7 @@ public slots:
     void newButtonWizardActivated();
     void fileTreeDoubleClicked(QTreeWidgetItem *item, int column);
     void fileTreeClicked(QTreeWidgetItem *item, int column);
-    void documentHierarchyDoubleClicked(QTreeWidgetItem *item, int column);
+    void documentHierarchyDoubleClicked(const QModelIndex &index);
     void fileHasChanged(const QString &path);
     void findTriggered();
     void findPreviousTriggered();
@@ -130,6 +133,17 @@ public slots:
     void addSnippetClicked();
     void removeSnippetClicked();
     void snippetsListDoubleClicked(QListWidgetItem *item);
+    void diagnosticsItemActivated(QListWidgetItem *item);
+    void findInProjectTriggered();
+    void jumpToSymbolTriggered();
+    void projectSearchRequested();
+    void projectSearchResultFound(int query, const QString &file_path, int line, int column, const QString &line_text);
+    void projectSearchFinished(int query, int match_count, int file_count);
+    void projectIndexingFinished(int file_count);
+    void projectSearchResultActivated(QTreeWidgetItem *item, int column);
+    void latencyTraceEnded();
+    void latencyResetClicked();
+    void latencyExportClicked();
     void resizeTexturePreview(QResizeEvent * event);
     void resizeCuttingPreview(QResizeEvent * event);
     void spinCuttingChanged(int value);
@@ -157,7 +171,8 @@ private:
     QString readSpriteSheetInfo(QTreeWidgetItem *item, const QString &texture);
     void populateTreeView(const QString &top_item_name, const QString &directory_path);
     void loadPlugins();
-    void closeTab(int index, bool must_save = true);
+    void fillLanguageBox();
+    bool closeTab(int index, bool must_save = true);
     void addRulers();
     void updateCuttingTab(const QString &file, const QString &texture, int l, int b, int w, int h);
     void updateCuttingInfo(int lvalue, int tvalue, int rvalue, int bvalue);
@@ -169,6 +184,7 @@ private:
     void openPreviewWindow(int w, int h);
 
     void logHtmlMessage(QString aMsg);
+    void goToLine(OpenedFile *file, const int line, const int column);
 
     Ui::rocketeClass ui;
     RenderingView *renderingView;
@@ -177,12 +193,13 @@ private:
     QList<QAction*> recentFileActionList;
     QComboBox *searchBox;
     QComboBox *languageBox;
+    QAction *languageBoxAction;
     QLabel *labelZoom, *labelPos, *labelCuttingMask, *labelScreenSize;
     QFileSystemWatcher *fileWatcher;
     bool isReloadingFile;
+    int projectSearchQuery;
     QMap<int, QString> fileChangedOutsideArray;
     WizardButton *wizard;
-    QTreeWidgetItem *selectedTreeViewItem;
     DocumentHierarchyEventFilter *hierarchyEventFilter;
     QDRuler *horzRuler, *vertRuler;
     QImage selectedTexture; // selected texture image/subimage
@@ -0,0 +1,529 @@
+#include "StringTableLocalizationManager.h"
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QXmlStreamReader>
+#include <string.h>
+
+static const char kTableMagic[4] = { 'R', 'S', 'T', 'B' };
+static const quint32 kTableVersion = 1;
+
+struct LanguageName
+{
+    LocalizationManagerInterface::LocalizationLanguage language;
+    const char *name;
+    const char *code;
+};
+
+static const LanguageName kLanguageNames[] = {
+    { LocalizationManagerInterface::English, "English", "en" },
+    { LocalizationManagerInterface::French, "French", "fr" },
+    { LocalizationManagerInterface::Italian, "Italian", "it" },
+    { LocalizationManagerInterface::Spanish, "Spanish", "es" },
+    { LocalizationManagerInterface::Dutch, "Dutch", "nl" },
+    { LocalizationManagerInterface::German, "German", "de" },
+    { LocalizationManagerInterface::EnglishUs, "English (US)", "en-us" },
+    { LocalizationManagerInterface::FrenchCa, "French (CA)", "fr-ca" },
+    { LocalizationManagerInterface::Chinese, "Chinese", "zh" },
+    { LocalizationManagerInterface::Japanese, "Japanese", "ja" },
+    { LocalizationManagerInterface::Portuguese, "Portuguese", "pt" },
+    { LocalizationManagerInterface::Korean, "Korean", "ko" }
+};
+
+StringTableLocalizationManager::StringTableLocalizationManager()
+: tableData(NULL), tableSize(0), header(NULL), hashTable(NULL), identifierEntries(NULL), translationEntries(NULL), languageIndex(-1)
+{
+}
+
+StringTableLocalizationManager::~StringTableLocalizationManager()
+{
+    unload();
+}
+
+bool StringTableLocalizationManager::canLoad(const QString &strings_file_path)
+{
+    const QString suffix = QFileInfo(strings_file_path).suffix().toLower();
+
+    return suffix == "csv" || suffix == "xlf" || suffix == "xliff" || suffix == "rstb";
+}
+
+// The compiled table sits next to its source and is rebuilt only when the source is newer.
+
+void StringTableLocalizationManager::initialize(const QString &strings_file_path)
+{
+    const QFileInfo source_info(strings_file_path);
+    QString table_path = strings_file_path;
+    bool it_is_compiled = false;
+
+    unload();
+
+    if (source_info.suffix().toLower() != "rstb") {
+        const QFileInfo table_info(table_path = strings_file_path + ".rstb");
+
+        if (!table_info.exists() || table_info.lastModified() < source_info.lastModified()) {
+            if (!compileTable(strings_file_path, table_path)) {
+                qDebug() << "Could not compile localization table" << strings_file_path;
+                return;
+            }
+
+            it_is_compiled = true;
+        }
+    }
+
+    if (mapTable(table_path))
+        return;
+
+    unload();
+
+    // A table written by another version is rebuilt from its source.
+    if (!it_is_compiled && table_path != strings_file_path && compileTable(strings_file_path, table_path) && mapTable(table_path))
+        return;
+
+    unload();
+    qDebug() << "Could not load localization table" << table_path;
+}
+
+QString StringTableLocalizationManager::getLocalizationForIdentifier(const QString &identifier)
+{
+    const QByteArray key = identifier.toUtf8();
+    quint32 hash;
+    quint32 mask;
+
+    if (!header || languageIndex == -1 || header->stringCount == 0)
+        return QString();
+
+    hash = hashIdentifier(key.constData(), key.size());
+    mask = header->hashTableSize - 1;
+
+    for (quint32 slot = hash & mask, probe = 0; probe < header->hashTableSize; slot = (slot + 1) & mask, ++probe) {
+        const HashEntry &entry = hashTable[slot];
+
+        if (entry.index == 0)
+            return QString();
+
+        if (entry.hash != hash)
+            continue;
+
+        const StringEntry &identifier_entry = identifierEntries[entry.index - 1];
+
+        if (identifier_entry.length != (quint32)key.size() || memcmp(tableData + identifier_entry.offset, key.constData(), key.size()) != 0)
+            continue;
+
+        const StringEntry &translation_entry = translationEntries[languageIndex * header->stringCount + entry.index - 1];
+
+        return QString::fromUtf8((const char *)tableData + translation_entry.offset, translation_entry.length);
+    }
+
+    return QString();
+}
+
+void StringTableLocalizationManager::setLanguage(LocalizationLanguage language)
+{
+    languageIndex = supportedLanguages.indexOf(language);
+}
+
+const QList<LocalizationManagerInterface::LocalizationLanguage> &StringTableLocalizationManager::getSupportedLanguages()
+{
+    return supportedLanguages;
+}
+
+QString StringTableLocalizationManager::getLanguageNameForLanguage(LocalizationLanguage language)
+{
+    for (size_t i = 0; i < sizeof(kLanguageNames) / sizeof(kLanguageNames[0]); ++i) {
+        if (kLanguageNames[i].language == language)
+            return kLanguageNames[i].name;
+    }
+
+    return QString();
+}
+
+// Private:
+
+void StringTableLocalizationManager::unload()
+{
+    if (tableData)
+        tableFile.unmap(const_cast<uchar *>(tableData));
+
+    tableFile.close();
+    tableData = NULL;
+    tableSize = 0;
+    header = NULL;
+    hashTable = NULL;
+    identifierEntries = NULL;
+    translationEntries = NULL;
+    supportedLanguages.clear();
+    languageIndex = -1;
+}
+
+// Checks every offset once here so that lookups can trust the mapped data.
+
+bool StringTableLocalizationManager::mapTable(const QString &table_path)
+{
+    const quint32 *languages;
+    qint64 entries_end;
+    qint64 string_entry_count;
+
+    tableFile.setFileName(table_path);
+
+    if (!tableFile.open(QFile::ReadOnly))
+        return false;
+
+    tableSize = tableFile.size();
+
+    if (tableSize < (qint64)sizeof(FileHeader) || !(tableData = tableFile.map(0, tableSize)))
+        return false;
+
+    header = (const FileHeader *)tableData;
+
+    if (memcmp(header->magic, kTableMagic, sizeof(kTableMagic)) != 0 || header->version != kTableVersion
+        || header->hashTableSize == 0 || (header->hashTableSize & (header->hashTableSize - 1)) != 0 || header->hashTableSize <= header->stringCount) {
+        header = NULL;
+        return false;
+    }
+
+    string_entry_count = (qint64)header->stringCount * (header->languageCount + 1);
+    entries_end = sizeof(FileHeader) + (qint64)header->languageCount * sizeof(quint32) + (qint64)header->hashTableSize * sizeof(HashEntry) + string_entry_count * sizeof(StringEntry);
+
+    if (entries_end > tableSize) {
+        header = NULL;
+        return false;
+    }
+
+    languages = (const quint32 *)(tableData + sizeof(FileHeader));
+    hashTable = (const HashEntry *)(languages + header->languageCount);
+    identifierEntries = (const StringEntry *)(hashTable + header->hashTableSize);
+    translationEntries = identifierEntries + header->stringCount;
+
+    for (qint64 i = 0; i < string_entry_count; ++i) {
+        const StringEntry &entry = identifierEntries[i];
+
+        if ((qint64)entry.offset + entry.length > tableSize) {
+            header = NULL;
+            return false;
+        }
+    }
+
+    for (quint32 i = 0; i < header->hashTableSize; ++i) {
+        if (hashTable[i].index > header->stringCount) {
+            header = NULL;
+            return false;
+        }
+    }
+
+    for (quint32 i = 0; i < header->languageCount; ++i) {
+        supportedLanguages << (LocalizationLanguage)languages[i];
+    }
+
+    return true;
+}
+
+bool StringTableLocalizationManager::compileTable(const QString &source_path, const QString &table_path)
+{
+    StringTable table;
+    const QString suffix = QFileInfo(source_path).suffix().toLower();
+
+    if (suffix == "csv") {
+        if (!parseCsv(source_path, table))
+            return false;
+    }
+    else if (!parseXliff(source_path, table)) {
+        return false;
+    }
+
+    return writeTable(table, table_path);
+}
+
+// First row: identifier column, then one column per language (name or code, e.g. "French" or "fr").
+
+bool StringTableLocalizationManager::parseCsv(const QString &source_path, StringTable &table)
+{
+    QFile file(source_path);
+    QString content;
+    QList<QStringList> rows;
+    QStringList row;
+    QString field;
+    QHash<QByteArray, int> identifier_map;
+    QVector<int> column_languages;
+    QChar separator = ',';
+    bool it_is_quoted = false;
+
+    if (!file.open(QFile::ReadOnly | QFile::Text))
+        return false;
+
+    QTextStream stream(&file);
+    stream.setCodec("UTF-8");
+    content = stream.readAll();
+
+    if (content.left(content.indexOf('\n')).count(';') > content.left(content.indexOf('\n')).count(','))
+        separator = ';';
+
+    for (int i = 0; i < content.length(); ++i) {
+        const QChar c = content[i];
+
+        if (it_is_quoted) {
+            if (c == '"') {
+                if (i + 1 < content.length() && content[i + 1] == '"')
+                    field += content[++i];
+                else
+                    it_is_quoted = false;
+            }
+            else {
+                field += c;
+            }
+        }
+        else if (c == '"') {
+            it_is_quoted = true;
+        }
+        else if (c == separator) {
+            row << field;
+            field.clear();
+        }
+        else if (c == '\n') {
+            row << field;
+            rows << row;
+            row.clear();
+            field.clear();
+        }
+        else if (c != '\r') {
+            field += c;
+        }
+    }
+
+    if (!field.isEmpty() || !row.isEmpty()) {
+        row << field;
+        rows << row;
+    }
+
+    if (rows.size() < 2 || rows.first().size() < 2)
+        return false;
+
+    for (int column = 1; column < rows.first().size(); ++column) {
+        column_languages << addLanguage(table, rows.first()[column]);
+    }
+
+    for (int i = 1; i < rows.size(); ++i) {
+        const QStringList &current_row = rows[i];
+        int string_index;
+
+        if (current_row.isEmpty() || current_row.first().trimmed().isEmpty())
+            continue;
+
+        string_index = addIdentifier(table, identifier_map, current_row.first());
+
+        for (int column = 1; column < current_row.size() && column <= column_languages.size(); ++column) {
+            const int language_index = column_languages[column - 1];
+
+            if (language_index != -1)
+                table.translations[language_index][string_index] = current_row[column].toUtf8();
+        }
+    }
+
+    return !table.languages.isEmpty();
+}
+
+// XLIFF 1.2 (<file source-language target-language>/<trans-unit id>) and 2.0 (<xliff srcLang trgLang>/<unit id>).
+
+bool StringTableLocalizationManager::parseXliff(const QString &source_path, StringTable &table)
+{
+    QFile file(source_path);
+    QHash<QByteArray, int> identifier_map;
+    int source_language = -1;
+    int target_language = -1;
+    int string_index = -1;
+
+    if (!file.open(QFile::ReadOnly))
+        return false;
+
+    QXmlStreamReader reader(&file);
+
+    while (!reader.atEnd()) {
+        if (reader.readNext() != QXmlStreamReader::StartElement)
+            continue;
+
+        const QStringRef name = reader.name();
+
+        if (name == "xliff" || name == "file") {
+            const QString source_attribute = name == "xliff" ? "srcLang" : "source-language";
+            const QString target_attribute = name == "xliff" ? "trgLang" : "target-language";
+
+            if (reader.attributes().hasAttribute(source_attribute))
+                source_language = addLanguage(table, reader.attributes().value(source_attribute).toString());
+
+            if (reader.attributes().hasAttribute(target_attribute))
+                target_language = addLanguage(table, reader.attributes().value(target_attribute).toString());
+        }
+        else if (name == "trans-unit" || name == "unit") {
+            const QString identifier = reader.attributes().value("id").toString();
+
+            string_index = identifier.trimmed().isEmpty() ? -1 : addIdentifier(table, identifier_map, identifier);
+        }
+        else if (string_index != -1 && (name == "source" || name == "target")) {
+            const int language_index = name == "source" ? source_language : target_language;
+            const QString text = reader.readElementText(QXmlStreamReader::IncludeChildElements);
+
+            if (language_index != -1)
+                table.translations[language_index][string_index] = text.toUtf8();
+        }
+    }
+
+    if (reader.hasError()) {
+        qDebug() << "Error parsing" << source_path << ":" << reader.errorString() << "line" << reader.lineNumber();
+        return false;
+    }
+
+    return !table.languages.isEmpty();
+}
+
+bool StringTableLocalizationManager::writeTable(const StringTable &table, const QString &table_path)
+{
+    FileHeader file_header;
+    const HashEntry empty_entry = { 0, 0 };
+    QVector<HashEntry> hash_entries;
+    QVector<StringEntry> string_entries;
+    QByteArray blob;
+    QSaveFile file(table_path);
+    quint32 hash_table_size = 16;
+    quint32 blob_offset;
+
+    while (hash_table_size < (quint32)table.identifiers.size() * 2)
+        hash_table_size *= 2;
+
+    memcpy(file_header.magic, kTableMagic, sizeof(kTableMagic));
+    file_header.version = kTableVersion;
+    file_header.languageCount = table.languages.size();
+    file_header.stringCount = table.identifiers.size();
+    file_header.hashTableSize = hash_table_size;
+    file_header.reserved = 0;
+
+    blob_offset = sizeof(FileHeader) + file_header.languageCount * sizeof(quint32) + hash_table_size * sizeof(HashEntry)
+        + file_header.stringCount * (file_header.languageCount + 1) * sizeof(StringEntry);
+
+    hash_entries.fill(empty_entry, hash_table_size);
+
+    for (int i = 0; i < table.identifiers.size(); ++i) {
+        const QByteArray &identifier = table.identifiers[i];
+        const quint32 hash = hashIdentifier(identifier.constData(), identifier.size());
+        quint32 slot = hash & (hash_table_size - 1);
+        StringEntry entry;
+
+        while (hash_entries[slot].index != 0)
+            slot = (slot + 1) & (hash_table_size - 1);
+
+        hash_entries[slot].hash = hash;
+        hash_entries[slot].index = i + 1;
+
+        entry.offset = blob_offset + blob.size();
+        entry.length = identifier.size();
+        string_entries << entry;
+        blob.append(identifier);
+    }
+
+    // Identical translations share their bytes in the blob.
+    for (int language_index = 0; language_index < table.languages.size(); ++language_index) {
+        QHash<QByteArray, quint32> blob_map;
+
+        foreach (const QByteArray &translation, table.translations[language_index]) {
+            StringEntry entry;
+
+            if (!blob_map.contains(translation)) {
+                blob_map.insert(translation, blob_offset + blob.size());
+                blob.append(translation);
+            }
+
+            entry.offset = blob_map.value(translation);
+            entry.length = translation.size();
+            string_entries << entry;
+        }
+    }
+
+    if (!file.open(QFile::WriteOnly))
+        return false;
+
+    file.write((const char *)&file_header, sizeof(FileHeader));
+
+    foreach (LocalizationLanguage language, table.languages) {
+        const quint32 value = language;
+        file.write((const char *)&value, sizeof(quint32));
+    }
+
+    file.write((const char *)hash_entries.constData(), hash_entries.size() * sizeof(HashEntry));
+    file.write((const char *)string_entries.constData(), string_entries.size() * sizeof(StringEntry));
+    file.write(blob);
+
+    return file.commit();
+}
+
+int StringTableLocalizationManager::addLanguage(StringTable &table, const QString &language_name)
+{
+    LocalizationLanguage language;
+    int language_index;
+
+    if (!getLanguageForName(language_name, language)) {
+        qDebug() << "Unknown localization language" << language_name;
+        return -1;
+    }
+
+    language_index = table.languages.indexOf(language);
+
+    if (language_index != -1)
+        return language_index;
+
+    table.languages << language;
+    table.translations.append(QVector<QByteArray>(table.identifiers.size()));
+
+    return table.languages.size() - 1;
+}
+
+int StringTableLocalizationManager::addIdentifier(StringTable &table, QHash<QByteArray, int> &identifier_map, const QString &identifier)
+{
+    const QByteArray key = identifier.trimmed().toUtf8();
+    QHash<QByteArray, int>::const_iterator found = identifier_map.constFind(key);
+
+    if (found != identifier_map.constEnd())
+        return found.value();
+
+    identifier_map.insert(key, table.identifiers.size());
+    table.identifiers << key;
+
+    for (int i = 0; i < table.translations.size(); ++i) {
+        table.translations[i].append(QByteArray());
+    }
+
+    return table.identifiers.size() - 1;
+}
+
+bool StringTableLocalizationManager::getLanguageForName(const QString &language_name, LocalizationLanguage &language)
+{
+    QString name = language_name.trimmed().toLower();
+
+    name.replace('_', '-');
+
+    for (size_t i = 0; i < sizeof(kLanguageNames) / sizeof(kLanguageNames[0]); ++i) {
+        if (name == QString(kLanguageNames[i].name).toLower() || name == kLanguageNames[i].code) {
+            language = kLanguageNames[i].language;
+            return true;
+        }
+    }
+
+    // Regional variants without an entry of their own fall back to the base language.
+    if (name.contains('-'))
+        return getLanguageForName(name.section('-', 0, 0), language);
+
+    return false;
+}
+
+// FNV-1a; only needs to be stable between the compiler and the lookup.
+
+quint32 StringTableLocalizationManager::hashIdentifier(const char *data, const int length)
+{
+    quint32 hash = 2166136261u;
+
+    for (int i = 0; i < length; ++i) {
+        hash ^= (uchar)data[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
@@ -0,0 +1,90 @@
+#ifndef STRINGTABLELOCALIZATIONMANAGER_H
+#define STRINGTABLELOCALIZATIONMANAGER_H
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "LocalizationManagerInterface.h"
+
+// Built-in localization provider used when no plugin is installed. A CSV or XLIFF string
+// table is compiled once into a binary file next to it, which is then memory mapped:
+// lookups hash the identifier, and switching language only changes the column read.
+
+class StringTableLocalizationManager : public LocalizationManagerInterface
+{
+public:
+    StringTableLocalizationManager();
+    virtual ~StringTableLocalizationManager();
+
+    static StringTableLocalizationManager & getStringTableInstance() {
+        static StringTableLocalizationManager instance;
+        return instance;
+    }
+
+    static bool canLoad(const QString &strings_file_path);
+    static bool isInstalled() {return instance == &getStringTableInstance();}
+    static void install() {setInstance(&getStringTableInstance());}
+    static void uninstall() {if (isInstalled()) setInstance(NULL);}
+
+    virtual void initialize(const QString &strings_file_path);
+    virtual QString getLocalizationForIdentifier(const QString &identifier);
+    virtual void setLanguage(LocalizationLanguage language);
+    virtual const QList<LocalizationLanguage> &getSupportedLanguages();
+    virtual QString getLanguageNameForLanguage(LocalizationLanguage language);
+
+private:
+    struct FileHeader
+    {
+        char magic[4];
+        quint32 version;
+        quint32 languageCount;
+        quint32 stringCount;
+        quint32 hashTableSize;
+        quint32 reserved;
+    };
+
+    struct HashEntry
+    {
+        quint32 hash;
+        quint32 index; // string index + 1, 0 for an empty slot
+    };
+
+    struct StringEntry
+    {
+        quint32 offset;
+        quint32 length;
+    };
+
+    struct StringTable
+    {
+        QList<LocalizationLanguage> languages;
+        QVector<QByteArray> identifiers;
+        QVector< QVector<QByteArray> > translations; // [language][string]
+    };
+
+    void unload();
+    bool mapTable(const QString &table_path);
+    static bool compileTable(const QString &source_path, const QString &table_path);
+    static bool parseCsv(const QString &source_path, StringTable &table);
+    static bool parseXliff(const QString &source_path, StringTable &table);
+    static bool writeTable(const StringTable &table, const QString &table_path);
+    static int addLanguage(StringTable &table, const QString &language_name);
+    static int addIdentifier(StringTable &table, QHash<QByteArray, int> &identifier_map, const QString &identifier);
+    static bool getLanguageForName(const QString &language_name, LocalizationLanguage &language);
+    static quint32 hashIdentifier(const char *data, const int length);
+
+    QFile tableFile;
+    const uchar *tableData;
+    qint64 tableSize;
+    const FileHeader *header;
+    const HashEntry *hashTable;
+    const StringEntry *identifierEntries;
+    const StringEntry *translationEntries;
+    QList<LocalizationLanguage> supportedLanguages;
+    int languageIndex;
+};
+
+#endif
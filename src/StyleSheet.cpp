@@ -1,6 +1,175 @@
 #include "StyleSheet.h"
 
-#include <QMessageBox>
+#include <algorithm>
+#include <QVarLengthArray>
+
+struct RcssToken
+{
+    enum Type { End, Whitespace, Comment, Word, String, Delimiter };
+
+    Type type;
+    int start;
+    int length;
+    QChar character;
+
+    int end() const { return start + length; }
+    bool is(const char c) const { return type == Delimiter && character == QLatin1Char(c); }
+};
+
+// Cuts a RCSS text into words, strings, comments and single character delimiters. Strings and
+// comments are read whole, so the braces and semicolons they hold are never taken for syntax;
+// the comments met are recorded.
+
+class RcssTokenizer
+{
+public:
+    RcssTokenizer(const QString &tokenized_text, QVector<StyleSheet::SourceSpan> &comment_spans)
+        : text(tokenized_text), position(0), comments(comment_spans), itHasPeeked(false), itPeekedAfterSpace(false)
+    {
+    }
+
+    // Next token that is neither whitespace nor a comment; it_follows_space is set when some
+    // were skipped before it.
+    RcssToken next(bool *it_follows_space = NULL)
+    {
+        RcssToken token;
+        bool it_is_after_space = false;
+
+        if (itHasPeeked) {
+            itHasPeeked = false;
+
+            if (it_follows_space)
+                *it_follows_space = itPeekedAfterSpace;
+
+            return peekedToken;
+        }
+
+        for (token = read(); token.type == RcssToken::Whitespace || token.type == RcssToken::Comment; token = read())
+            it_is_after_space = true;
+
+        if (it_follows_space)
+            *it_follows_space = it_is_after_space;
+
+        return token;
+    }
+
+    RcssToken peek()
+    {
+        if (!itHasPeeked) {
+            peekedToken = next(&itPeekedAfterSpace);
+            itHasPeeked = true;
+        }
+
+        return peekedToken;
+    }
+
+    int getPosition() const { return itHasPeeked ? peekedToken.start : position; }
+
+private:
+    static bool isWordCharacter(const QChar c)
+    {
+        return c.isLetterOrDigit() || c == '-' || c == '_' || c == '%';
+    }
+
+    RcssToken read()
+    {
+        RcssToken token;
+
+        token.start = position;
+        token.character = position < text.length() ? text[position] : QChar();
+
+        if (position >= text.length()) {
+            token.type = RcssToken::End;
+        }
+        else if (token.character.isSpace()) {
+            token.type = RcssToken::Whitespace;
+
+            while (position < text.length() && text[position].isSpace())
+                position++;
+        }
+        else if (token.character == '/' && position + 1 < text.length() && text[position + 1] == '*') {
+            const int comment_end = text.indexOf(QLatin1String("*/"), position + 2);
+            StyleSheet::SourceSpan span;
+
+            token.type = RcssToken::Comment;
+            position = comment_end == -1 ? text.length() : comment_end + 2;
+            span.start = token.start;
+            span.length = position - token.start;
+            comments << span;
+        }
+        else if (token.character == '"' || token.character == '\'') {
+            // An unterminated string ends with its line.
+            token.type = RcssToken::String;
+            position++;
+
+            while (position < text.length() && text[position] != token.character && text[position] != '\n') {
+                if (text[position] == '\\')
+                    position++;
+
+                position++;
+            }
+
+            if (position < text.length() && text[position] == token.character)
+                position++;
+
+            position = qMin(position, text.length());
+        }
+        else if (isWordCharacter(token.character)) {
+            token.type = RcssToken::Word;
+
+            while (position < text.length() && isWordCharacter(text[position]))
+                position++;
+        }
+        else {
+            token.type = RcssToken::Delimiter;
+            position++;
+        }
+
+        token.length = position - token.start;
+
+        return token;
+    }
+
+    const QString &text;
+    int position;
+    QVector<StyleSheet::SourceSpan> &comments;
+    RcssToken peekedToken;
+    bool itHasPeeked;
+    bool itPeekedAfterSpace;
+};
+
+static StyleSheet::SourceSpan makeSpan(const int start, const int end)
+{
+    StyleSheet::SourceSpan span;
+
+    span.start = start;
+    span.length = end - start;
+
+    return span;
+}
+
+// Consumes the tokens up to the delimiter closing opening_token, nested pairs included, and
+// returns the last token read. A '{' is left unread, so an unclosed selector part cannot
+// swallow the rule body.
+
+static RcssToken skipEnclosedTokens(RcssTokenizer &tokenizer, const RcssToken &opening_token)
+{
+    const char opening = opening_token.character.toLatin1();
+    const char closing = opening == '(' ? ')' : ']';
+    RcssToken token = opening_token;
+    int depth = 1;
+
+    while (depth > 0 && tokenizer.peek().type != RcssToken::End && !tokenizer.peek().is('{')) {
+        token = tokenizer.next();
+
+        if (token.is(opening))
+            depth++;
+        else if (token.is(closing))
+            depth--;
+    }
+
+    return token;
+}
 
 // Public:
 
@@ -13,201 +182,421 @@ StyleSheet::~StyleSheet()
     clear();
 }
 
+// Returns false when the text ends inside a rule; what was read until then is kept.
+
 bool StyleSheet::parse(const QString &content)
 {
-    int current_index = 0;
-    int bracket_begin_index = 0;
-    int bracket_end_index = 0;
+    bool it_is_complete = true;
 
-    while(1) {
-        bracket_begin_index = content.indexOf('{',current_index);
+    clear();
+    source = content;
+    lineStarts << 0;
 
-        if (bracket_begin_index != -1) {
-            bracket_end_index = content.indexOf('}',bracket_begin_index);
+    for (int position = 0; position < source.length(); ++position) {
+        if (source[position] == '\n')
+            lineStarts << position + 1;
+    }
 
-            if (bracket_end_index != -1) {
-                PropertyBlock *current_block;
-                QString unparsed_properties;
-                QString unparsed_owners;
-                QStringList unparsed_owner_list;
-                QStringList unparsed_property_list;
+    RcssTokenizer tokenizer(source, comments);
 
-                current_block = new PropertyBlock;
+    while (tokenizer.peek().type != RcssToken::End) {
+        if (tokenizer.peek().is('@'))
+            it_is_complete = parseAtRule(tokenizer) && it_is_complete;
+        else
+            it_is_complete = parseRule(tokenizer) && it_is_complete;
+    }
 
-                unparsed_owners = content.mid(current_index, bracket_begin_index - current_index - 1);
-                unparsed_properties = content.mid(bracket_begin_index+1, bracket_end_index - bracket_begin_index - 1);
+    buildIndex();
 
-                unparsed_owner_list = unparsed_owners.split(',');
-                unparsed_property_list = unparsed_properties.split(';');
+    return it_is_complete;
+}
 
-                foreach (const QString & unparsed_owner, unparsed_owner_list) {
-                    PropertyOwner *new_owner = parseOwner(unparsed_owner.trimmed());
-                    if(new_owner)
-                    {
-                        current_block->ownerList.push_back(new_owner);
-                    }
-                }
+void StyleSheet::clear()
+{
+    source.clear();
+    lineStarts.clear();
+    names.clear();
+    utf8Names.clear();
+    nameIds.clear();
+    nameLists.clear();
+    compounds.clear();
+    selectors.clear();
+    selectorRules.clear();
+    declarations.clear();
+    rules.clear();
+    atRules.clear();
+    comments.clear();
+    idSelectors.clear();
+    classSelectors.clear();
+    tagSelectors.clear();
+    universalSelectors.clear();
+}
 
-                foreach (const QString & unparsed_property, unparsed_property_list) {
-                    Property *new_property = parseProperty(unparsed_property.trimmed());
-                    if(new_property)
-                    {
-                        current_block->propertyList.push_back(new_property);
-                    }
-                }
+// Only the selectors filed under the element's id, classes and tag, plus the universal ones,
+// are evaluated; they are sorted back into source order, so rules are reported in that order,
+// each once.
 
-                propertyBlockList.push_back(current_block);
-            }
-            else {
-                return false;
-                break;
-            }
-        }
-        else {
-            break;
-        }
+bool StyleSheet::findMatchingProperties(QVector<int> &rule_indices, const Element *element) const
+{
+    QVector<int> candidates = universalSelectors;
+    const QByteArray class_names(element->GetClassNames().CString());
+    bool it_has_result = false;
+    int last_rule_index = -1;
+
+    addCandidates(candidates, idSelectors, QByteArray(element->GetId().CString()));
+    addCandidates(candidates, tagSelectors, QByteArray(element->GetTagName().CString()));
 
-        current_index = bracket_end_index+1;
+    foreach (const QByteArray &class_name, class_names.split(' ')) {
+        if (!class_name.isEmpty())
+            addCandidates(candidates, classSelectors, class_name);
     }
 
-    return false;
-}
+    std::sort(candidates.begin(), candidates.end());
 
-void StyleSheet::clear()
-{
-    foreach (PropertyBlock *propertyBlock, propertyBlockList) {
-        foreach (PropertyOwner *propertyOwner, propertyBlock->ownerList) {
-            delete propertyOwner;
-        }
+    foreach (const int selector_index, candidates) {
+        const int rule_index = selectorRules[selector_index];
 
-        foreach(Property *property, propertyBlock->propertyList) {
-            delete property;
-        }
+        if (rule_index == last_rule_index || !matchesSelector(selector_index, element))
+            continue;
 
-        delete propertyBlock;
+        rule_indices.push_back(rule_index);
+        last_rule_index = rule_index;
+        it_has_result = true;
     }
+
+    return it_has_result;
 }
 
-bool StyleSheet::findMatchingProperties(QList<PropertyBlock*> &result, const Element *element) const
+// The last declaration wins, as when the rule is applied.
+
+int StyleSheet::findDeclaration(const int rule_index, const QString &property_name) const
 {
-    bool it_has_result = false;
+    const Rule &rule = rules[rule_index];
+    const int name_id = getNameId(property_name);
 
-    foreach(PropertyBlock *block, propertyBlockList) {
-        foreach(PropertyOwner *owner, block->ownerList) {
-            const Element *inheriter;
+    if (name_id == -1)
+        return -1;
 
-            inheriter = findDirectInheriter(owner,element);
+    for (int index = rule.firstDeclaration + rule.declarationCount - 1; index >= rule.firstDeclaration; --index) {
+        if (declarations[index].name == name_id)
+            return index;
+    }
 
-            if (inheriter) {
-                PropertyOwner *ancester = owner->ancester;
-                bool it_matches = true;
+    return -1;
+}
 
-                while(ancester) {
-                    inheriter = findDirectInheriter(ancester,inheriter);
+// The rule whose body opens on the line, as libRocket reports the line of a property; when
+// several open on it, the first one. Rules are in source order, so it is a binary search.
 
-                    if (!inheriter) {
-                        it_matches = false;
-                        break;
-                    }
+int StyleSheet::findRule(const int line_number) const
+{
+    int low = 0;
+    int high = rules.size();
 
-                    ancester = ancester->ancester;
-                }
+    while (low < high) {
+        const int middle = (low + high) / 2;
 
-                if (it_matches) {
-                    result.push_back(block);
-                    it_has_result = true;
-                    break;
-                }
-            }
-        }
+        if (getLineNumber(rules[middle].bodyStart) < line_number)
+            low = middle + 1;
+        else
+            high = middle;
     }
 
-    return it_has_result;
+    if (low == rules.size() || getLineNumber(rules[low].bodyStart) != line_number)
+        return -1;
+
+    return low;
+}
+
+int StyleSheet::getLineNumber(const int position) const
+{
+    return int(std::upper_bound(lineStarts.begin(), lineStarts.end(), position) - lineStarts.begin()) - 1;
 }
 
 // Private:
 
-const Element *StyleSheet::findDirectInheriter(const PropertyOwner *owner, const Element *_element) const
+// An at-rule ends with a ';' or with its block, whose content is only skipped.
+
+bool StyleSheet::parseAtRule(RcssTokenizer &tokenizer)
 {
-    const Element *element = _element;
+    AtRule at_rule;
+    const RcssToken at_token = tokenizer.next();
+    RcssToken token = tokenizer.next();
+    int depth = 0;
 
-    while (element) {
-        if ((owner->tagName.isEmpty() || owner->tagName == element->GetTagName().CString())
-            && (owner->identifier.isEmpty() || owner->tagName == element->GetId().CString())
-            && (owner->className.isEmpty() || element->IsClassSet(owner->className.toLatin1().data()))
-            )
-            return element;
+    at_rule.name = token.type == RcssToken::Word ? intern(token.start, token.length) : -1;
 
-        element = element->GetParentNode();
+    for (; token.type != RcssToken::End; token = tokenizer.next()) {
+        if (token.is('{'))
+            depth++;
+        else if (token.is('}') && --depth <= 0)
+            break;
+        else if (token.is(';') && depth == 0)
+            break;
     }
 
-    return NULL;
+    at_rule.span = makeSpan(at_token.start, token.type == RcssToken::End ? tokenizer.getPosition() : token.end());
+    atRules << at_rule;
+
+    return token.type != RcssToken::End;
 }
 
-StyleSheet::PropertyOwner *StyleSheet::parseOwner(const QString &content)
+// Selectors are read compound by compound: whitespace and the '>', '+' and '~' combinators all
+// link a compound to the one on its left, which is then matched as an ancestor.
+
+bool StyleSheet::parseRule(RcssTokenizer &tokenizer)
 {
-    int index;
-    PropertyOwner *last_owner = NULL;
-    QString content_copy = content;
-    QString special;
-    QStringList content_list = content_copy.replace('\n',' ').split(' ');
+    Rule rule;
+    Compound compound;
+    QVarLengthArray<int, 4> class_names;
+    QVarLengthArray<int, 4> pseudo_class_names;
+    int previous_compound = -1;
+    int selector_end;
+    bool it_follows_space;
+    bool it_has_content = false;
+    RcssToken token = tokenizer.peek();
+
+    rule.firstSelector = selectors.size();
+    rule.firstDeclaration = declarations.size();
+    rule.declarationCount = 0;
+    rule.span.start = token.start;
+    selector_end = token.start;
+    compound.tagName = compound.identifier = -1;
+    compound.span.start = token.start;
+
+    for (;;) {
+        token = tokenizer.next(&it_follows_space);
+
+        const bool it_ends_compound = token.type == RcssToken::End || token.is('{') || token.is(',') || token.is('>') || token.is('+') || token.is('~');
+
+        if ((it_follows_space || it_ends_compound) && it_has_content) {
+            compound.firstClassName = nameLists.size();
+            compound.classNameCount = class_names.size();
+
+            for (int i = 0; i < class_names.size(); ++i)
+                nameLists << class_names[i];
+
+            compound.firstPseudoClassName = nameLists.size();
+            compound.pseudoClassNameCount = pseudo_class_names.size();
+
+            for (int i = 0; i < pseudo_class_names.size(); ++i)
+                nameLists << pseudo_class_names[i];
+
+            compound.ancestor = previous_compound;
+            compound.span.length = selector_end - compound.span.start;
+            previous_compound = compounds.size();
+            compounds << compound;
+
+            compound.tagName = compound.identifier = -1;
+            class_names.clear();
+            pseudo_class_names.clear();
+            it_has_content = false;
+        }
+
+        if (token.type == RcssToken::End) {
+            rule.bodyStart = tokenizer.getPosition();
+            rule.selectorCount = selectors.size() - rule.firstSelector;
+            rule.selectorSpan = makeSpan(rule.span.start, selector_end);
+            rule.span = makeSpan(rule.span.start, tokenizer.getPosition());
+            rules << rule;
+            return false;
+        }
 
-    foreach(const QString &content_list_item, content_list) {
-        PropertyOwner *current_owner = NULL;
-        QString unparsed_owner = content_list_item;
+        if (token.is('{') || token.is(',')) {
+            if (previous_compound != -1) {
+                selectors << previous_compound;
+                selectorRules << rules.size();
+            }
 
-        index = unparsed_owner.indexOf(':');
+            previous_compound = -1;
 
-        // :TODO: Handle multi-special (ex: radio:checked:hover)
+            if (token.is('{')) {
+                rule.bodyStart = token.start;
+                break;
+            }
 
-        if (index!=-1) {
-            special = unparsed_owner.mid(index+1).trimmed();
-            unparsed_owner.remove(index,content_list.last().length() - index);
+            continue;
         }
 
-        index = unparsed_owner.indexOf('.');
+        if (!it_has_content)
+            compound.span.start = token.start;
 
-        if (index!=-1) {
-            current_owner = new PropertyOwner;
-            current_owner->tagName = unparsed_owner.mid(0,index).trimmed();
-            current_owner->className = unparsed_owner.mid(index+1).trimmed();
-            current_owner->pseudoClassName = special;
+        if (token.type == RcssToken::Word) {
+            compound.tagName = intern(token.start, token.length);
+            it_has_content = true;
+        }
+        else if (token.is('*')) {
+            it_has_content = true;
         }
+        else if (token.is('.') || token.is('#') || token.is(':')) {
+            const QChar kind = token.character;
 
-        index = unparsed_owner.indexOf('#');
+            if (kind == ':' && tokenizer.peek().is(':'))
+                tokenizer.next();
 
-        if (index!=-1) {
-            current_owner = new PropertyOwner;
-            current_owner->tagName = unparsed_owner.mid(0,index).trimmed();
-            current_owner->identifier = unparsed_owner.mid(index+1).trimmed();
-            current_owner->pseudoClassName = special;
+            if (tokenizer.peek().type != RcssToken::Word)
+                continue;
+
+            token = tokenizer.next();
+
+            if (kind == '.')
+                class_names.append(intern(token.start, token.length));
+            else if (kind == '#')
+                compound.identifier = intern(token.start, token.length);
+            else
+                pseudo_class_names.append(intern(token.start, token.length));
+
+            // The argument of a structural pseudo-class, as in nth-child(2n+1), is not a selector.
+            if (kind == ':' && tokenizer.peek().is('('))
+                token = skipEnclosedTokens(tokenizer, tokenizer.next());
+
+            it_has_content = true;
+        }
+        else if (token.is('[')) {
+            // Attribute selectors are not supported; they are skipped whole.
+            token = skipEnclosedTokens(tokenizer, token);
+            it_has_content = true;
         }
+        else if (!token.is('>') && !token.is('+') && !token.is('~')) {
+            // Other delimiters are not supported; they are skipped.
+            continue;
+        }
+
+        selector_end = token.end();
+    }
+
+    rule.selectorCount = selectors.size() - rule.firstSelector;
+    rule.selectorSpan = makeSpan(rule.span.start, selector_end);
 
-        if (!current_owner) {
-            current_owner = new PropertyOwner;
-            current_owner->tagName = unparsed_owner.trimmed();
-            current_owner->pseudoClassName = special;
+    const bool it_is_closed = parseDeclarations(tokenizer, rule);
+
+    rule.span = makeSpan(rule.span.start, tokenizer.getPosition());
+    rules << rule;
+
+    return it_is_closed;
+}
+
+// Reads "name: value" pairs up to the closing brace, which is consumed. The value span goes
+// from its first to its last token; a malformed declaration is skipped up to the next ';'.
+
+bool StyleSheet::parseDeclarations(RcssTokenizer &tokenizer, Rule &rule)
+{
+    for (;;) {
+        RcssToken token = tokenizer.next();
+        Declaration declaration;
+
+        if (token.type == RcssToken::End)
+            return false;
+
+        if (token.is('}'))
+            return true;
+
+        if (token.is(';'))
+            continue;
+
+        if (token.type == RcssToken::Word && tokenizer.peek().is(':')) {
+            declaration.name = intern(token.start, token.length);
+            declaration.nameSpan = makeSpan(token.start, token.end());
+            tokenizer.next();
+            declaration.valueSpan = makeSpan(tokenizer.peek().start, tokenizer.peek().start);
+
+            while (tokenizer.peek().type != RcssToken::End && !tokenizer.peek().is(';') && !tokenizer.peek().is('}'))
+                declaration.valueSpan = makeSpan(declaration.valueSpan.start, tokenizer.next().end());
+
+            declaration.span = makeSpan(declaration.nameSpan.start, declaration.valueSpan.end());
+            declarations << declaration;
+            rule.declarationCount++;
+            continue;
         }
 
-        if (last_owner)
-            current_owner->ancester = last_owner;
+        while (tokenizer.peek().type != RcssToken::End && !tokenizer.peek().is(';') && !tokenizer.peek().is('}'))
+            tokenizer.next();
+    }
+}
+
+// The name is looked up without copying the source; it is only copied the first time.
+
+int StyleSheet::intern(const int start, const int length)
+{
+    const QString name = QString::fromRawData(source.unicode() + start, length);
+    QHash<QString, int>::const_iterator it = nameIds.constFind(name);
+
+    if (it != nameIds.constEnd())
+        return it.value();
+
+    const QString copied_name(name.unicode(), length);
 
-        last_owner = current_owner;
+    nameIds.insert(copied_name, names.size());
+    names << copied_name;
+    utf8Names << copied_name.toUtf8();
+
+    return names.size() - 1;
+}
+
+void StyleSheet::buildIndex()
+{
+    for (int selector_index = 0; selector_index < selectors.size(); ++selector_index) {
+        const Compound &compound = compounds[selectors[selector_index]];
+
+        if (compound.identifier != -1)
+            idSelectors[compound.identifier] << selector_index;
+        else if (compound.classNameCount > 0)
+            classSelectors[nameLists[compound.firstClassName]] << selector_index;
+        else if (compound.tagName != -1)
+            tagSelectors[compound.tagName] << selector_index;
+        else
+            universalSelectors << selector_index;
     }
+}
 
-    return last_owner;
+void StyleSheet::addCandidates(QVector<int> &candidates, const QHash<int, QVector<int> > &buckets, const QByteArray &name) const
+{
+    const int name_id = name.isEmpty() ? -1 : nameIds.value(QString::fromUtf8(name), -1);
+
+    if (name_id != -1)
+        candidates += buckets.value(name_id);
 }
 
-StyleSheet::Property *StyleSheet::parseProperty(const QString &content)
+// The rightmost compound must match the element; then each compound on its left must match
+// some ancestor, closer ancestors first. It stops at the first compound left unmatched.
+
+bool StyleSheet::matchesSelector(const int selector_index, const Element *element) const
 {
-    Property *result = NULL;
-    int index = content.indexOf(':');
+    const Compound *compound = &compounds[selectors[selector_index]];
+    const Element *inheriter = element;
+
+    if (!matchesCompound(*compound, element))
+        return false;
+
+    while (compound->ancestor != -1) {
+        compound = &compounds[compound->ancestor];
+
+        do {
+            inheriter = inheriter->GetParentNode();
+        } while (inheriter && !matchesCompound(*compound, inheriter));
+
+        if (!inheriter)
+            return false;
+    }
+
+    return true;
+}
+
+// Pseudo-classes are ignored: the properties of every state of an element are listed. Names
+// are compared in UTF-8, as libRocket stores them, without converting anything.
+
+bool StyleSheet::matchesCompound(const Compound &compound, const Element *element) const
+{
+    if (compound.tagName != -1 && utf8Names[compound.tagName] != element->GetTagName().CString())
+        return false;
+
+    if (compound.identifier != -1 && utf8Names[compound.identifier] != element->GetId().CString())
+        return false;
 
-    if (index!=-1) {
-        result = new Property;
-        result->name = content.mid(0,index).trimmed();
-        result->value = content.mid(index+1).trimmed();
+    for (int index = compound.firstClassName; index < compound.firstClassName + compound.classNameCount; ++index) {
+        if (!element->IsClassSet(utf8Names[nameLists[index]].constData()))
+            return false;
     }
 
-    return result;
+    return true;
 }
@@ -1,46 +1,123 @@
 #ifndef STYLESHEET_H
 #define STYLESHEET_H
 
+#include <QByteArray>
 #include <QString>
-#include <QList>
 #include <QStringList>
+#include <QHash>
+#include <QVector>
 #include "RocketHelper.h"
 
+class RcssTokenizer;
+
+// Parsed RCSS text. A single pass over the tokens fills flat arrays: rules refer to ranges of
+// selectors and declarations, selectors to chains of compound selectors, and every name is
+// interned once. Each item keeps its span in the source, which is kept as well, so that a
+// declaration can be mapped back to the exact text it came from. Offsets are in characters.
+// Selectors are also indexed by the key of their rightmost compound (id, else first class, else
+// tag, else universal), so matching an element only evaluates the buckets it can fall in.
+// Lines are counted from 0, as libRocket reports them in the source of a property.
+
 class StyleSheet
 {
 public:
-    struct PropertyOwner
+    struct SourceSpan
+    {
+        SourceSpan() : start(0), length(0) {}
+        int start;
+        int length;
+        int end() const { return start + length; }
+    };
+
+    // One compound selector, such as div.menu:hover; ancestor is the compound on its left, or -1.
+    // Names are interned name ids, -1 when absent; class and pseudo-class ids are in nameLists.
+    struct Compound
+    {
+        int tagName;
+        int identifier;
+        int firstClassName;
+        int classNameCount;
+        int firstPseudoClassName;
+        int pseudoClassNameCount;
+        int ancestor;
+        SourceSpan span;
+    };
+
+    struct Declaration
     {
-        PropertyOwner() : ancester(NULL) {};
-        ~PropertyOwner() { if(ancester) delete ancester; }
-        PropertyOwner *ancester;
-        QString tagName;
-        QString className;
-        QString identifier;
-        QString pseudoClassName;
+        int name;
+        SourceSpan nameSpan;
+        SourceSpan valueSpan;
+        SourceSpan span;
     };
-    struct Property
+
+    // Selectors are indices of rightmost compounds, in the selector array; bodyStart is the
+    // position of the '{'.
+    struct Rule
     {
-        QString name;
-        QString value;
+        int firstSelector;
+        int selectorCount;
+        int firstDeclaration;
+        int declarationCount;
+        int bodyStart;
+        SourceSpan selectorSpan;
+        SourceSpan span;
     };
-    struct PropertyBlock
+
+    struct AtRule
     {
-        QList<PropertyOwner*> ownerList;
-        QList<Property*> propertyList;
+        int name;
+        SourceSpan span;
     };
+
     StyleSheet();
     ~StyleSheet();
     bool parse(const QString &content);
     void clear();
-    bool findMatchingProperties(QList<PropertyBlock*> &result, const Element *element) const;
+    bool findMatchingProperties(QVector<int> &rule_indices, const Element *element) const;
+
+    int getRuleCount() const { return rules.size(); }
+    const Rule &getRule(const int rule_index) const { return rules[rule_index]; }
+    const Compound &getSelector(const int selector_index) const { return compounds[selectors[selector_index]]; }
+    const Compound &getCompound(const int compound_index) const { return compounds[compound_index]; }
+    const Declaration &getDeclaration(const int declaration_index) const { return declarations[declaration_index]; }
+    int findDeclaration(const int rule_index, const QString &property_name) const;
+    int findRule(const int line_number) const;
+    int getLineNumber(const int position) const;
+    const QVector<AtRule> &getAtRules() const { return atRules; }
+    const QVector<SourceSpan> &getComments() const { return comments; }
+    const QString &getName(const int name_id) const { return names[name_id]; }
+    int getNameId(const QString &name) const { return nameIds.value(name, -1); }
+    int getListedNameId(const int name_list_index) const { return nameLists[name_list_index]; }
+    QStringRef getText(const SourceSpan &span) const { return source.midRef(span.start, span.length); }
 
 private:
-    const Element *findDirectInheriter(const PropertyOwner *owner, const Element *element) const;
-    PropertyOwner *parseOwner(const QString &content);
-    Property *parseProperty(const QString &content);
+    bool parseAtRule(RcssTokenizer &tokenizer);
+    bool parseRule(RcssTokenizer &tokenizer);
+    bool parseDeclarations(RcssTokenizer &tokenizer, Rule &rule);
+    int intern(const int start, const int length);
+    void buildIndex();
+    void addCandidates(QVector<int> &candidates, const QHash<int, QVector<int> > &buckets, const QByteArray &name) const;
+    bool matchesSelector(const int selector_index, const Element *element) const;
+    bool matchesCompound(const Compound &compound, const Element *element) const;
 
-    QList<PropertyBlock*> propertyBlockList;
+    QString source;
+    QVector<int> lineStarts;
+    QStringList names;
+    QVector<QByteArray> utf8Names;
+    QHash<QString, int> nameIds;
+    QVector<int> nameLists;
+    QVector<Compound> compounds;
+    QVector<int> selectors;
+    QVector<int> selectorRules;
+    QVector<Declaration> declarations;
+    QVector<Rule> rules;
+    QVector<AtRule> atRules;
+    QVector<SourceSpan> comments;
+    QHash<int, QVector<int> > idSelectors;
+    QHash<int, QVector<int> > classSelectors;
+    QHash<int, QVector<int> > tagSelectors;
+    QVector<int> universalSelectors;
 };
 
 #endif
@@ -0,0 +1,143 @@
+#include "SymbolPopup.h"
+
+#include <algorithm>
+#include <QApplication>
+#include <QKeyEvent>
+#include <QPair>
+#include <QVBoxLayout>
+
+static const int maximumListedSymbolCount = 500;
+
+static bool isWordStart(const QString &text, const int index)
+{
+    if (index == 0)
+        return true;
+
+    const QChar previous = text[index - 1];
+
+    return !previous.isLetterOrDigit() || (previous.isLower() && text[index].isUpper());
+}
+
+static bool hasHigherScore(const QPair<int, int> &first, const QPair<int, int> &second)
+{
+    return first.first > second.first;
+}
+
+// Public:
+
+SymbolPopup::SymbolPopup(QWidget *parent, const QList<CodeEditor::OutlineEntry> &outline)
+    : QFrame(parent, Qt::Popup), entries(outline)
+{
+    QVBoxLayout *layout = new QVBoxLayout(this);
+
+    setAttribute(Qt::WA_DeleteOnClose);
+    setFrameStyle(QFrame::Box | QFrame::Plain);
+    resize(400, 300);
+
+    filterLineEdit = new QLineEdit(this);
+    symbolList = new QListWidget(this);
+    layout->setContentsMargins(2, 2, 2, 2);
+    layout->addWidget(filterLineEdit);
+    layout->addWidget(symbolList);
+
+    filterLineEdit->installEventFilter(this);
+    connect(filterLineEdit, SIGNAL(textChanged(const QString &)), this, SLOT(filterChanged(const QString &)));
+    connect(filterLineEdit, SIGNAL(returnPressed()), this, SLOT(returnPressed()));
+    connect(symbolList, SIGNAL(itemActivated(QListWidgetItem *)), this, SLOT(itemActivated(QListWidgetItem *)));
+
+    filterChanged(QString());
+    filterLineEdit->setFocus();
+}
+
+// The pattern characters must appear in order, ignoring case. Consecutive characters and
+// characters starting a word (after '#', '.', '-', a space or a case change) score higher, and
+// so do shorter texts. Returns -1 when the text does not match.
+
+int SymbolPopup::getFuzzyScore(const QString &pattern, const QString &text)
+{
+    int score = 0;
+    int text_index = 0;
+    int previous_index = -2;
+
+    for (int pattern_index = 0; pattern_index < pattern.length(); ++pattern_index) {
+        const QChar c = pattern[pattern_index].toLower();
+
+        while (text_index < text.length() && text[text_index].toLower() != c)
+            ++text_index;
+
+        if (text_index == text.length())
+            return -1;
+
+        score += 1;
+
+        if (text_index == previous_index + 1)
+            score += 5;
+
+        if (isWordStart(text, text_index))
+            score += 8;
+
+        previous_index = text_index++;
+    }
+
+    return score * 100 - text.length();
+}
+
+// Protected:
+
+bool SymbolPopup::eventFilter(QObject *object, QEvent *event)
+{
+    if (object == filterLineEdit && event->type() == QEvent::KeyPress) {
+        const int key = static_cast<QKeyEvent *>(event)->key();
+
+        if (key == Qt::Key_Up || key == Qt::Key_Down || key == Qt::Key_PageUp || key == Qt::Key_PageDown) {
+            QApplication::sendEvent(symbolList, event);
+            return true;
+        }
+
+        if (key == Qt::Key_Escape) {
+            close();
+            return true;
+        }
+    }
+
+    return QFrame::eventFilter(object, event);
+}
+
+// Private slots:
+
+void SymbolPopup::filterChanged(const QString &text)
+{
+    QList< QPair<int, int> > matches;
+
+    for (int i = 0; i < entries.size(); ++i) {
+        const int score = text.isEmpty() ? 0 : getFuzzyScore(text, entries[i].name);
+
+        if (score >= 0)
+            matches << qMakePair(score, i);
+    }
+
+    std::stable_sort(matches.begin(), matches.end(), hasHigherScore);
+
+    symbolList->clear();
+
+    for (int i = 0; i < matches.size() && i < maximumListedSymbolCount; ++i) {
+        const CodeEditor::OutlineEntry &entry = entries[matches[i].second];
+        QListWidgetItem *item = new QListWidgetItem(QString("%1    (line %2)").arg(entry.name).arg(entry.lineNumber + 1), symbolList);
+
+        item->setData(Qt::UserRole, entry.position);
+    }
+
+    symbolList->setCurrentRow(0);
+}
+
+void SymbolPopup::itemActivated(QListWidgetItem *item)
+{
+    emit symbolChosen(item->data(Qt::UserRole).toInt());
+    close();
+}
+
+void SymbolPopup::returnPressed()
+{
+    if (symbolList->currentItem())
+        itemActivated(symbolList->currentItem());
+}
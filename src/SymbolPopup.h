@@ -0,0 +1,38 @@
+#ifndef SYMBOLPOPUP_H
+#define SYMBOLPOPUP_H
+
+#include <QFrame>
+#include <QLineEdit>
+#include <QListWidget>
+#include "CodeEditor.h"
+
+// Jump-to-symbol popup: lists the outline of an editor, filtered by fuzzy matching as the user
+// types, best matches first. Closing it deletes it.
+
+class SymbolPopup : public QFrame
+{
+    Q_OBJECT
+
+public:
+    SymbolPopup(QWidget *parent, const QList<CodeEditor::OutlineEntry> &outline);
+
+    static int getFuzzyScore(const QString &pattern, const QString &text);
+
+signals:
+    void symbolChosen(int position);
+
+protected:
+    virtual bool eventFilter(QObject *object, QEvent *event);
+
+private slots:
+    void filterChanged(const QString &text);
+    void itemActivated(QListWidgetItem *item);
+    void returnPressed();
+
+private:
+    QList<CodeEditor::OutlineEntry> entries;
+    QLineEdit *filterLineEdit;
+    QListWidget *symbolList;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef SYNTAXHIGHLIGHTER_H
+#define SYNTAXHIGHLIGHTER_H
+
+#include <QtGui/QSyntaxHighlighter>
+#include <QTextBlock>
+
+// Base of the editor highlighters. By default every block is highlighted; once a block range is
+// set, blocks outside of it are left as they are, state included, so that an edit never cascades
+// through the rest of a huge file. The range is moved along as the view scrolls.
+
+class SyntaxHighlighter : public QSyntaxHighlighter
+{
+    Q_OBJECT
+
+public:
+    explicit SyntaxHighlighter(QTextDocument *document)
+        : QSyntaxHighlighter(document), firstBlockNumber(0), lastBlockNumber(-1), itIsLimited(false)
+    {
+    }
+
+    void setHighlightedBlockRange(const int first_block_number, const int last_block_number)
+    {
+        firstBlockNumber = first_block_number;
+        lastBlockNumber = last_block_number;
+        itIsLimited = true;
+    }
+
+    bool isLimited() const { return itIsLimited; }
+
+protected:
+    bool skipDeferredBlock()
+    {
+        if (!itIsLimited)
+            return false;
+
+        const int block_number = currentBlock().blockNumber();
+
+        if (block_number >= firstBlockNumber && block_number <= lastBlockNumber)
+            return false;
+
+        setCurrentBlockState(currentBlock().userState());
+        return true;
+    }
+
+private:
+    int firstBlockNumber;
+    int lastBlockNumber;
+    bool itIsLimited;
+};
+
+#endif
@@ -6,7 +6,6 @@
 #include "ActionManager.h"
 #include "ActionSetInlineProperty.h"
 #include "ActionInsertElement.h"
-#include "ActionGroup.h"
 #include <QLabel>
 #include <QToolBar>
 #include <QVBoxLayout>
@@ -181,10 +180,10 @@ void ToolDiv::setLeftAlignment()
     document = Rockete::getInstance().getCurrentDocument();
 
     if (document && document->selectedElement) {
-        ActionGroup *actionGroup = new ActionGroup();
-        actionGroup->add(new ActionSetInlineProperty(document, document->selectedElement, "display", "inline-block"));
-        actionGroup->add(new ActionSetInlineProperty(document, document->selectedElement, "float", "left"));
-        ActionManager::getInstance().applyNew(actionGroup);
+        ActionManager::getInstance().beginGroup();
+        ActionManager::getInstance().applyNew(new ActionSetInlineProperty(document, document->selectedElement, "display", "inline-block"));
+        ActionManager::getInstance().applyNew(new ActionSetInlineProperty(document, document->selectedElement, "float", "left"));
+        ActionManager::getInstance().endGroup();
     }
 }
 
@@ -195,10 +194,10 @@ void ToolDiv::setRightAlignment()
     document = Rockete::getInstance().getCurrentDocument();
 
     if (document && document->selectedElement) {
-        ActionGroup *actionGroup = new ActionGroup();
-        actionGroup->add(new ActionSetInlineProperty(document, document->selectedElement, "display", "inline-block"));
-        actionGroup->add(new ActionSetInlineProperty(document, document->selectedElement, "float", "right"));
-        ActionManager::getInstance().applyNew(actionGroup);
+        ActionManager::getInstance().beginGroup();
+        ActionManager::getInstance().applyNew(new ActionSetInlineProperty(document, document->selectedElement, "display", "inline-block"));
+        ActionManager::getInstance().applyNew(new ActionSetInlineProperty(document, document->selectedElement, "float", "right"));
+        ActionManager::getInstance().endGroup();
     }
 }
 
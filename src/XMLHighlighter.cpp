@@ -1,113 +1,154 @@
 #include "XMLHighlighter.h"
 #include "CodeEditor.h"
+#include "LatencyTracer.h"
 
 XMLHighlighter::XMLHighlighter(QTextDocument *document)
-: QSyntaxHighlighter(document)
+: SyntaxHighlighter(document), itHasUserFormat(false)
 {
-    QTextCharFormat keywordFormat;
-    QTextCharFormat xmlElementFormat;
-    QTextCharFormat xmlAttributeFormat;
-    QTextCharFormat singleLineCommentFormat;
+    formats[Keyword].setForeground(Qt::darkMagenta);
+    formats[Keyword].setFontWeight(QFont::Bold);
 
-    keywordFormat.setForeground(Qt::darkMagenta);
-    keywordFormat.setFontWeight(QFont::Bold);
+    formats[Element].setFontWeight(QFont::Bold);
+    formats[Element].setForeground(Qt::darkGreen);
 
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\b?xml\\b"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("/>"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp(">"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("<"), keywordFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("</"), keywordFormat));
+    formats[Attribute].setFontItalic(true);
+    formats[Attribute].setForeground(Qt::blue);
 
-    xmlElementFormat.setFontWeight(QFont::Bold);
-    xmlElementFormat.setForeground(Qt::darkGreen);
+    formats[Value].setForeground(Qt::red);
 
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\b[A-Za-z0-9_]+(?=[\\s/>])"), xmlElementFormat));
+    formats[CommentText].setForeground(Qt::gray);
 
-    xmlAttributeFormat.setFontItalic(true);
-    xmlAttributeFormat.setForeground(Qt::blue);
-
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("\\b[A-Za-z0-9_]+(?=\\=)"), xmlAttributeFormat));
-
-    valueFormat.setForeground(Qt::red);
-    valueStartExpression = QRegExp("\"");
-    valueEndExpression = QRegExp("\"(?=[\\s></])");
-
-    singleLineCommentFormat.setForeground(Qt::gray);
-
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("<!--[^\n]*-->"), singleLineCommentFormat));
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp("placeholder_rule_for_search_highlight"), keywordFormat));
+    formats[Entity].setForeground(Qt::darkMagenta);
 }
 
-void XMLHighlighter::setHighlightedString(const QString &str)
-{
-    QTextCharFormat keywordFormat;
-
-    keywordFormat.setBackground(Qt::green);
-    
-    highlightingRules.removeLast();
-    highlightingRules.push_back(QPair<QRegExp,QTextCharFormat>(QRegExp(str), keywordFormat));
-    rehighlight();
-}
+// One sweep over the block: characters are classified, the table gives the next state, and
+// consecutive characters of the same kind are formatted as a single run. Comments, quoted
+// values and tags spanning several lines carry over through the block state.
 
 void XMLHighlighter::highlightBlock(const QString &text)
 {
-    int index;
-    int length;
-    int startIndex;
-    int endIndex;
-    int commentLength;
-    QTextCharFormat user_format;
-    QTextCharFormat new_format;
-
-    if(currentBlockUserData())
-    {
-        user_format = ((CodeEditor::BlockData *)currentBlockUserData())->format;
-    }
-    
-    for(int i=0; i<highlightingRules.length();++i)
-    {
-        const QRegExp & expression = highlightingRules[i].first;
-        const QTextCharFormat & format = highlightingRules[i].second;
-
-        setCurrentBlockState(0);
-        startIndex = 0;
-
-        if(previousBlockState() != 1)
-        {
-            startIndex = valueStartExpression.indexIn(text);
+    LatencyTracer::Scope scope(LatencyTracer::Highlighting);
+
+    if (skipDeferredBlock())
+        return;
+
+    enum Token { NAME, LT, GT, SLASH, QUOTE, APOSTROPHE, OTHER };
+    static const int transitions[7][7] = {
+        { Text,          TagStart, Text, Text,        Text,        Text,        Text }, // Text
+        { TagName,       TagStart, Text, TagStart,    DoubleQuote, SingleQuote, Tag }, // TagStart
+        { TagName,       TagStart, Text, Tag,         DoubleQuote, SingleQuote, Tag }, // TagName
+        { AttributeName, TagStart, Text, Tag,         DoubleQuote, SingleQuote, Tag }, // Tag
+        { AttributeName, TagStart, Text, Tag,         DoubleQuote, SingleQuote, Tag }, // AttributeName
+        { DoubleQuote,   DoubleQuote, DoubleQuote, DoubleQuote, Tag, DoubleQuote, DoubleQuote }, // DoubleQuote
+        { SingleQuote,   SingleQuote, SingleQuote, SingleQuote, SingleQuote, Tag, SingleQuote } // SingleQuote
+    };
+
+    const int length = text.length();
+    int state = previousBlockState();
+    int run_start = 0;
+    Kind run_kind = Plain;
+    int i = 0;
+
+    itHasUserFormat = currentBlockUserData() != NULL;
+
+    if (itHasUserFormat)
+        userFormat = ((CodeEditor::BlockData *)currentBlockUserData())->format;
+
+    if (state < Text || state > Comment)
+        state = Text;
+
+    while (i < length) {
+        const QChar c = text.at(i);
+        Kind kind = Plain;
+        int token;
+        int new_state;
+        int token_length = 1;
+
+        if (state == Comment) {
+            const int comment_end = text.indexOf(QLatin1String("-->"), i);
+
+            token_length = comment_end == -1 ? length - i : comment_end + 3 - i;
+            kind = CommentText;
+            new_state = comment_end == -1 ? Comment : Text;
+        }
+        else if (state == Text && c == '<' && text.midRef(i, 4) == QLatin1String("<!--")) {
+            token_length = 4;
+            kind = CommentText;
+            new_state = Comment;
         }
+        else if (state == Text && c == '&') {
+            int entity_end = i + 1;
 
-        while(startIndex >= 0)
-        {
-            endIndex = valueEndExpression.indexIn(text, startIndex);
+            if (entity_end < length && text.at(entity_end) == '#')
+                ++entity_end;
 
-            if(endIndex == -1)
-            {
-                setCurrentBlockState(1);
-                commentLength = text.length() - startIndex;
-            }
-            else
-            {
-                commentLength = endIndex - startIndex + valueEndExpression.matchedLength();
+            while (entity_end < length && text.at(entity_end).isLetterOrDigit())
+                ++entity_end;
+
+            if (entity_end < length && text.at(entity_end) == ';' && entity_end > i + 1) {
+                token_length = entity_end + 1 - i;
+                kind = Entity;
             }
-            new_format = valueFormat;
-            if(currentBlockUserData())
-                new_format.merge(user_format);
-            setFormat(startIndex, commentLength, new_format);
 
-            startIndex = valueStartExpression.indexIn(text, startIndex + commentLength);
+            new_state = Text;
         }
+        else {
+            switch (c.unicode()) {
+            case '<': token = LT; break;
+            case '>': token = GT; break;
+            case '/': token = SLASH; break;
+            case '"': token = QUOTE; break;
+            case '\'': token = APOSTROPHE; break;
+            default:
+                token = c.isLetterOrDigit() || c == '_' || c == '-' || c == ':' || c == '.' || c == '?' || c == '!' ? NAME : OTHER;
+                break;
+            }
 
-        index = expression.indexIn(text);
+            new_state = transitions[state][token];
+
+            if (state == DoubleQuote || state == SingleQuote || new_state == DoubleQuote || new_state == SingleQuote)
+                kind = Value;
+            else if (token == LT || (state != Text && (token == GT || token == SLASH)))
+                kind = Keyword;
+            else if (token == NAME && c == '?' && state != Text)
+                kind = Keyword;
+            else if (new_state == TagName)
+                kind = Element;
+            else if (new_state == AttributeName)
+                kind = Attribute;
+        }
 
-        while(index >= 0)
-        {
-            length = expression.matchedLength();
-            new_format = format;
-            if(currentBlockUserData())
-                new_format.merge(user_format);
-            setFormat(index, length, new_format);
-            index = expression.indexIn(text, index + length);
+        if (kind != run_kind) {
+            highlight(run_start, i - run_start, run_kind);
+            run_start = i;
+            run_kind = kind;
         }
+
+        state = new_state;
+        i += token_length;
     }
-}
\ No newline at end of file
+
+    highlight(run_start, length - run_start, run_kind);
+
+    if (state == TagStart || state == TagName || state == AttributeName)
+        state = Tag;
+
+    setCurrentBlockState(state);
+}
+
+// Private:
+
+void XMLHighlighter::highlight(int start, int length, Kind kind)
+{
+    QTextCharFormat format;
+
+    if (length <= 0 || kind == Plain)
+        return;
+
+    format = formats[kind];
+
+    if (itHasUserFormat)
+        format.merge(userFormat);
+
+    setFormat(start, length, format);
+}
@@ -1,29 +1,50 @@
 #ifndef XMLHIGHLIGHTER_H
 #define XMLHIGHLIGHTER_H
 
-#include <QtGui/QSyntaxHighlighter>
-#include <QList>
-#include <QPair>
-#include <QRegExp>
+#include "SyntaxHighlighter.h"
+#include <QTextCharFormat>
 
-class XMLHighlighter : public QSyntaxHighlighter
+class XMLHighlighter : public SyntaxHighlighter
 {
     Q_OBJECT
 
 public:
     XMLHighlighter(QTextDocument *document);
-    void setHighlightedString(const QString &str);
 
 
 protected:
     void highlightBlock(const QString &text);
 
 private:
-    typedef QPair<QRegExp,QTextCharFormat> RulePair;
-    QList<RulePair> highlightingRules;
-    QTextCharFormat valueFormat;
-    QRegExp valueStartExpression;
-    QRegExp valueEndExpression;
+    enum State
+    {
+        Text,
+        TagStart,
+        TagName,
+        Tag,
+        AttributeName,
+        DoubleQuote,
+        SingleQuote,
+        Comment
+    };
+
+    enum Kind
+    {
+        Plain,
+        Keyword,
+        Element,
+        Attribute,
+        Value,
+        CommentText,
+        Entity,
+        KindCount
+    };
+
+    void highlight(int start, int length, Kind kind);
+
+    QTextCharFormat formats[KindCount];
+    QTextCharFormat userFormat;
+    bool itHasUserFormat;
 };
 
 #endif